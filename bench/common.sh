@@ -0,0 +1,82 @@
+# Shared setup for the benchmark scripts, meant to be sourced.
+#
+# bench_setup re-executes the calling script inside a private D-Bus session and
+# starts a private Xvfb server, so a running miniterm or the user's desktop is
+# never involved. The user's configuration is replaced by the defaults, or by
+# the file named in MINITERM_BENCH_CONFIG.
+
+# Prints the wall clock time in microseconds.
+now_us() {
+	echo $(($(date +%s%N) / 1000))
+}
+
+bench_setup() {
+	if [ -z "${MINITERM_BENCH_SESSION:-}" ]; then
+		if ! command -v dbus-run-session >/dev/null; then
+			echo "dbus-run-session is required" >&2
+			exit 1
+		fi
+		export MINITERM_BENCH_SESSION=1
+		exec dbus-run-session -- sh "$0" "$@"
+	fi
+
+	bench_dir=$(mktemp -d "${TMPDIR:-/tmp}/miniterm-bench.XXXXXX")
+	bench_pids=
+	trap bench_cleanup EXIT
+	trap 'exit 1' INT TERM
+
+	export XDG_CONFIG_HOME="$bench_dir/config"
+	mkdir -p "$XDG_CONFIG_HOME/miniterm"
+	if [ -n "${MINITERM_BENCH_CONFIG:-}" ]; then
+		cp "$MINITERM_BENCH_CONFIG" \
+			"$XDG_CONFIG_HOME/miniterm/miniterm.conf"
+	fi
+
+	if ! command -v Xvfb >/dev/null; then
+		echo "Xvfb is required" >&2
+		exit 1
+	fi
+	Xvfb -displayfd 3 -screen 0 1920x1080x24 -nolisten tcp \
+		3>"$bench_dir/display" 2>/dev/null &
+	xvfb_pid=$!
+	while [ ! -s "$bench_dir/display" ]; do
+		if ! kill -0 "$xvfb_pid" 2>/dev/null; then
+			echo "Xvfb failed to start" >&2
+			exit 1
+		fi
+		sleep 0.05
+	done
+	export DISPLAY=":$(cat "$bench_dir/display")"
+}
+
+bench_cleanup() {
+	for pid in $bench_pids; do
+		kill "$pid" 2>/dev/null || true
+	done
+	if [ -n "${xvfb_pid:-}" ]; then
+		kill "$xvfb_pid" 2>/dev/null || true
+	fi
+	rm -rf "$bench_dir"
+}
+
+# bench_summarize PREFIX FILE
+#
+# Reads "METRIC VALUE" lines from FILE and prints one line per metric:
+#   PREFIX.METRIC n=COUNT p50=VALUE p95=VALUE p99=VALUE
+# using nearest rank percentiles.
+bench_summarize() {
+	sort -k1,1 -k2,2n "$2" | awk -v prefix="$1" '
+		function pick(p,    i) {
+			i = int((p * n + 99) / 100)
+			return v[i < 1 ? 1 : i]
+		}
+		function flush() {
+			if (n == 0)
+				return
+			printf "%s.%s n=%d p50=%s p95=%s p99=%s\n", prefix, \
+				metric, n, pick(50), pick(95), pick(99)
+		}
+		$1 != metric { flush(); metric = $1; n = 0 }
+		{ v[++n] = $2 }
+		END { flush() }'
+}
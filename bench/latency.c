@@ -0,0 +1,244 @@
+/*
+ * Copyright (c) 2018 Jason Waataja
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/*
+ * Types synthetic keystrokes into a MinitermTerminal running cat, whose input
+ * is echoed by the pty, and reports the latency percentiles the terminal
+ * measured for each stage from the key event to the frame showing the echo.
+ * It needs an X server, run it through the miniterm-bench-latency target.
+ */
+
+#include <gtk/gtk.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "latency.h"
+#include "settings.h"
+#include "terminal.h"
+
+/* Time for the window to map and get focus before typing starts. */
+#define SETTLE_MS 500
+/* Keys typed before pressing return, so lines stay short. */
+#define LINE_LENGTH 64
+/* Output of the terminal busy in the background. */
+#define BACKGROUND_COMMAND "yes miniterm-bench-background-output"
+
+typedef struct _Run Run;
+
+struct _Run {
+	GtkWidget *window;
+	MinitermTerminal *terminal;
+	int keys_left;
+	int interval_ms;
+	unsigned int typed;
+};
+
+/* Returns a new window with a terminal starting to run command. */
+static GtkWidget *open_terminal(MinitermSettings *settings,
+	const char *command, MinitermTerminal **terminal);
+/* Types keys into the terminal and adds its histograms to latency. */
+static void run_keys(MinitermSettings *settings, int keys, int interval_ms,
+	bool background, MinitermHistogram *latency);
+
+/* Exits if a command couldn't be spawned. */
+static void spawn_cb(MinitermTerminal *terminal, GPid pid, GError *error,
+	gpointer user_data);
+static gboolean start_cb(gpointer user_data);
+static gboolean type_cb(gpointer user_data);
+static gboolean finish_cb(gpointer user_data);
+static void send_key(GtkWidget *window, guint keyval, GdkEventType type);
+
+static GtkWidget *
+open_terminal(MinitermSettings *settings, const char *command,
+	MinitermTerminal **terminal)
+{
+	GtkWidget *window = gtk_window_new(GTK_WINDOW_TOPLEVEL);
+	*terminal = miniterm_terminal_new(true, NULL, GTK_WINDOW(window));
+	gtk_container_add(GTK_CONTAINER(window),
+		miniterm_terminal_get_container(*terminal));
+	miniterm_terminal_set_settings(*terminal, settings);
+	gtk_widget_show_all(window);
+	miniterm_terminal_spawn(
+		*terminal, NULL, command, NULL, spawn_cb, NULL);
+	return window;
+}
+
+static void
+run_keys(MinitermSettings *settings, int keys, int interval_ms,
+	bool background, MinitermHistogram *latency)
+{
+	MinitermTerminal *busy = NULL;
+	GtkWidget *busy_window = NULL;
+	if (background)
+		busy_window =
+			open_terminal(settings, BACKGROUND_COMMAND, &busy);
+
+	Run run = {0};
+	run.keys_left = keys;
+	run.interval_ms = interval_ms;
+	run.window = open_terminal(settings, "cat", &run.terminal);
+	/* Without a window manager this focuses the window directly. */
+	gtk_window_present(GTK_WINDOW(run.window));
+	gtk_widget_grab_focus(GTK_WIDGET(run.terminal));
+	g_timeout_add(SETTLE_MS, start_cb, &run);
+	gtk_main();
+
+	if (!gtk_window_is_active(GTK_WINDOW(run.window)))
+		fprintf(stderr, "The window wasn't focused, so its redraws "
+				"were throttled.\n");
+	const MinitermHistogram *measured =
+		miniterm_terminal_get_latency(run.terminal);
+	for (int stage = 0; stage < MINITERM_LATENCY_STAGES; ++stage) {
+		latency[stage].count += measured[stage].count;
+		for (int i = 0; i < MINITERM_HISTOGRAM_BUCKETS; ++i)
+			latency[stage].buckets[i] +=
+				measured[stage].buckets[i];
+	}
+	gtk_widget_destroy(run.window);
+	if (busy_window != NULL)
+		gtk_widget_destroy(busy_window);
+}
+
+static void
+spawn_cb(MinitermTerminal *terminal, GPid pid, GError *error,
+	gpointer user_data)
+{
+	(void)terminal;
+	(void)pid;
+	(void)user_data;
+	if (error != NULL) {
+		fprintf(stderr, "%s\n", error->message);
+		exit(EXIT_FAILURE);
+	}
+}
+
+static gboolean
+start_cb(gpointer user_data)
+{
+	Run *run = user_data;
+	g_timeout_add(run->interval_ms, type_cb, run);
+	return G_SOURCE_REMOVE;
+}
+
+static gboolean
+type_cb(gpointer user_data)
+{
+	Run *run = user_data;
+	if (run->keys_left-- <= 0) {
+		/* Give the last keystroke time to be drawn. */
+		g_timeout_add(SETTLE_MS, finish_cb, NULL);
+		return G_SOURCE_REMOVE;
+	}
+	const guint keyval = ++run->typed % LINE_LENGTH == 0
+		? GDK_KEY_Return
+		: GDK_KEY_a + run->typed % 26;
+	send_key(run->window, keyval, GDK_KEY_PRESS);
+	send_key(run->window, keyval, GDK_KEY_RELEASE);
+	return G_SOURCE_CONTINUE;
+}
+
+static gboolean
+finish_cb(gpointer user_data)
+{
+	(void)user_data;
+	gtk_main_quit();
+	return G_SOURCE_REMOVE;
+}
+
+static void
+send_key(GtkWidget *window, guint keyval, GdkEventType type)
+{
+	GdkWindow *gdk_window = gtk_widget_get_window(window);
+	GdkDisplay *display = gdk_window_get_display(gdk_window);
+	GdkEvent *event = gdk_event_new(type);
+	event->key.window = g_object_ref(gdk_window);
+	event->key.send_event = TRUE;
+	/* Real key events use the monotonic clock in milliseconds too. */
+	event->key.time = (guint32)(g_get_monotonic_time() / 1000);
+	event->key.keyval = keyval;
+	GdkKeymapKey *keys = NULL;
+	int key_count = 0;
+	if (gdk_keymap_get_entries_for_keyval(
+		    gdk_keymap_get_for_display(display), keyval, &keys,
+		    &key_count)) {
+		event->key.hardware_keycode = keys[0].keycode;
+		event->key.group = keys[0].group;
+		g_free(keys);
+	}
+	GdkSeat *seat = gdk_display_get_default_seat(display);
+	gdk_event_set_device(event, gdk_seat_get_keyboard(seat));
+	gtk_main_do_event(event);
+	gdk_event_free(event);
+}
+
+int
+main(int argc, char *argv[])
+{
+	char *config_path = NULL;
+	int keys = 200;
+	int interval_ms = 50;
+	int runs = 3;
+	gboolean background = FALSE;
+	const GOptionEntry entries[] = {
+		{"keys", 'k', 0, G_OPTION_ARG_INT, &keys,
+			"Keystrokes per run (default: 200).", "N"},
+		{"interval", 'i', 0, G_OPTION_ARG_INT, &interval_ms,
+			"Milliseconds between keystrokes (default: 50).", "MS"},
+		{"runs", 'r', 0, G_OPTION_ARG_INT, &runs,
+			"Number of runs (default: 3).", "N"},
+		{"background", 'b', 0, G_OPTION_ARG_NONE, &background,
+			"Also flood another terminal with output.", 0},
+		{"config", 'c', 0, G_OPTION_ARG_FILENAME, &config_path,
+			"Use settings from this file instead of the defaults.",
+			"FILE"},
+		{NULL}};
+	GError *error = NULL;
+	if (!gtk_init_with_args(&argc, &argv, NULL, entries, NULL, &error)) {
+		fprintf(stderr, "%s\n", error->message);
+		g_error_free(error);
+		return EXIT_FAILURE;
+	}
+
+	MinitermSettings *settings = config_path
+		? miniterm_settings_load(config_path)
+		: miniterm_settings_new();
+	settings->measure_latency = true;
+	MinitermHistogram latency[MINITERM_LATENCY_STAGES] = {{0}};
+	for (int run = 0; run < runs; ++run)
+		run_keys(settings, keys, interval_ms, background, latency);
+	miniterm_settings_unref(settings);
+
+	for (int stage = 0; stage < MINITERM_LATENCY_STAGES; ++stage) {
+		const MinitermHistogram *histogram = &latency[stage];
+		printf("latency.%s background=%d n=%" G_GUINT64_FORMAT
+		       " p50=%" G_GINT64_FORMAT " p95=%" G_GINT64_FORMAT
+		       " p99=%" G_GINT64_FORMAT "\n",
+			miniterm_latency_stage_name(stage), background ? 1 : 0,
+			histogram->count,
+			miniterm_histogram_percentile(histogram, 50),
+			miniterm_histogram_percentile(histogram, 95),
+			miniterm_histogram_percentile(histogram, 99));
+	}
+	g_free(config_path);
+	return EXIT_SUCCESS;
+}
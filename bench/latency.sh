@@ -0,0 +1,14 @@
+#!/bin/sh
+# Runs the input latency benchmark headless.
+#
+# Usage: latency.sh MINITERM_LATENCY [ARGS...]
+#
+# ARGS are passed on, see MINITERM_LATENCY --help. Prints one line per stage,
+# with percentiles in microseconds:
+#   latency.STAGE background=0|1 n=COUNT p50=VALUE p95=VALUE p99=VALUE
+set -eu
+
+. "$(dirname "$0")/common.sh"
+
+bench_setup "$@"
+"$@"
@@ -0,0 +1,189 @@
+#!/bin/sh
+# Measures what each window costs, with all windows in one instance (single)
+# and with every window in its own process (separate), and fails if the cost
+# per window exceeds the limits in THRESHOLDS.
+#
+# Usage: memory.sh MINITERM THRESHOLDS [WINDOWS...]
+#
+# WINDOWS are the numbers of windows to open, 1 10 50 100 by default, the
+# smallest first. Every window runs a shell that prints 2000 lines and sleeps.
+# Prints one line per mode and number of windows, totals over the miniterm
+# processes, not their children:
+#   memory.MODE windows=N rss_kb=... pss_kb=... fds=... scrollback_mb=...
+#   rss_kb_per_window=... pss_kb_per_window=... fds_per_window=...
+# The per window figures are the growth over the smallest number of windows,
+# divided by the windows added. THRESHOLDS holds lines of the form
+#   MODE.METRIC LIMIT
+# which are checked against the largest number of windows. Lines starting with
+# # are ignored.
+set -eu
+
+. "$(dirname "$0")/common.sh"
+
+miniterm=$1
+thresholds=$2
+bench_setup "$@"
+shift 2
+counts=${*:-1 10 50 100}
+
+if [ ! -r "$thresholds" ]; then
+	echo "Can't read $thresholds" >&2
+	exit 1
+fi
+
+export MINITERM_TRACE="$bench_dir/trace"
+results="$bench_dir/results"
+: >"$results"
+
+child="sh -c 'seq 2000; exec sleep 86400'"
+
+# wait_for_count EVENT N: waits up to 60 s until EVENT was recorded N times.
+wait_for_count() {
+	tries=0
+	while [ "$(grep -c "^$1 " "$MINITERM_TRACE")" -lt "$2" ]; do
+		tries=$((tries + 1))
+		if [ "$tries" -gt 6000 ]; then
+			echo "Timed out waiting for $2 $1 events" >&2
+			return 1
+		fi
+		sleep 0.01
+	done
+}
+
+# start_bus: starts a private D-Bus session and sets bus to its address.
+start_bus() {
+	: >"$bench_dir/bus"
+	dbus-daemon --session --nofork --print-address=3 3>"$bench_dir/bus" &
+	bench_pids="$bench_pids $!"
+	while [ ! -s "$bench_dir/bus" ]; do
+		sleep 0.01
+	done
+	bus=$(head -n 1 "$bench_dir/bus")
+}
+
+# measure MODE N BASELINE: prints the usage of the processes in $instances,
+# reached through the buses in $buses if set, and appends it to results.
+# BASELINE holds the windows, rss, pss and fds of the smallest number of
+# windows, or is empty.
+measure() {
+	rss=0
+	pss=0
+	fds=0
+	scrollback=0
+	set -- "$@" $buses
+	mode=$1
+	windows=$2
+	baseline=$3
+	shift 3
+	for pid in $instances; do
+		usage=$(awk '/^Rss:/ { r = $2 } /^Pss:/ { p = $2 }
+			END { print r, p }' "/proc/$pid/smaps_rollup")
+		rss=$((rss + ${usage% *}))
+		pss=$((pss + ${usage#* }))
+		fds=$((fds + $(ls "/proc/$pid/fd" | wc -l)))
+		if [ $# -gt 0 ]; then
+			export DBUS_SESSION_BUS_ADDRESS="$1"
+			shift
+		fi
+		mb=$("$miniterm" --scrollback-usage |
+			awk '$1 == "total:" { print $2 }')
+		scrollback=$(awk -v a="$scrollback" -v b="$mb" \
+			'BEGIN { print a + b }')
+	done
+	echo "$mode $windows $rss $pss $fds $scrollback $baseline" | awk '{
+		printf "memory.%s windows=%d rss_kb=%d pss_kb=%d fds=%d " \
+			"scrollback_mb=%.1f", $1, $2, $3, $4, $5, $6
+		if (NF == 10 && $2 > $7) {
+			n = $2 - $7
+			printf " rss_kb_per_window=%.0f", ($3 - $8) / n
+			printf " pss_kb_per_window=%.0f", ($4 - $9) / n
+			printf " fds_per_window=%.2f", ($5 - $10) / n
+		}
+		printf "\n"
+	}' | tee -a "$results"
+}
+
+# stop: stops the miniterm processes and the buses of the last measurement.
+stop() {
+	for pid in $instances; do
+		kill "$pid" 2>/dev/null || true
+		wait "$pid" 2>/dev/null || true
+	done
+	if [ -n "$buses" ]; then
+		kill $bench_pids 2>/dev/null || true
+		bench_pids=
+	fi
+}
+
+session_bus=$DBUS_SESSION_BUS_ADDRESS
+for mode in single separate; do
+	baseline=
+	for windows in $counts; do
+		: >"$MINITERM_TRACE"
+		instances=
+		buses=
+		for i in $(seq "$windows"); do
+			if [ "$mode" = separate ]; then
+				# Own bus, so it becomes its own instance.
+				start_bus
+				buses="$buses $bus"
+				DBUS_SESSION_BUS_ADDRESS=$bus \
+					"$miniterm" -e "$child" &
+				instances="$instances $!"
+			elif [ -z "$instances" ]; then
+				"$miniterm" -e "$child" &
+				instances=$!
+				wait_for_count first-draw 1
+			else
+				# Forwarded, returns once the instance has it.
+				"$miniterm" -e "$child"
+			fi
+		done
+		wait_for_count first-output "$windows"
+		wait_for_count first-draw "$windows"
+		# Let the output and the scrollback settle.
+		sleep 1
+		line=$(measure "$mode" "$windows" "$baseline")
+		echo "$line"
+		# windows, rss, pss and fds of the smallest run.
+		if [ -z "$baseline" ]; then
+			baseline=$(echo "$line" | awk '{
+				for (i = 2; i <= 5; ++i) {
+					sub(/.*=/, "", $i)
+					printf "%s%s", $i, i < 5 ? " " : "\n"
+				}
+			}')
+		fi
+		stop
+		export DBUS_SESSION_BUS_ADDRESS="$session_bus"
+	done
+done
+
+# Later lines overwrite earlier ones, leaving the largest number of windows.
+awk 'NR == FNR {
+		if ($1 !~ /^#/ && NF == 2)
+			limit[$1] = $2
+		next
+	}
+	{
+		mode = substr($1, length("memory.") + 1)
+		for (i = 2; i <= NF; ++i) {
+			split($i, pair, "=")
+			value[mode "." pair[1]] = pair[2]
+		}
+	}
+	END {
+		status = 0
+		for (key in limit) {
+			if (!(key in value)) {
+				print "memory.check " key " skipped"
+			} else if (value[key] + 0 > limit[key] + 0) {
+				print "memory.check " key "=" value[key] \
+					" exceeds " limit[key]
+				status = 1
+			} else {
+				print "memory.check " key "=" value[key] " ok"
+			}
+		}
+		exit status
+	}' "$thresholds" "$results"
@@ -0,0 +1,272 @@
+/*
+ * Copyright (c) 2018 Jason Waataja
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/*
+ * Feeds captures recorded with miniterm --capture through a MinitermTerminal,
+ * with the recorded resizes, and reports how fast they render. By default the
+ * output is fed as fast as the terminal takes it, with --paced at the recorded
+ * timing. It needs an X server, run it through the miniterm-bench-replay
+ * target.
+ */
+
+#include <gtk/gtk.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <vte/vte.h>
+
+#include "capture.h"
+#include "settings.h"
+#include "terminal.h"
+
+/* Window title fed after the capture. */
+#define DONE_TITLE "miniterm-bench-done"
+/* Interval of the timer used to detect main loop stalls. */
+#define HEARTBEAT_MS 5
+/* Bytes fed per main loop iteration when not paced, about a pty read. */
+#define FEED_CHUNK (64 * 1024)
+#define MIB (1024 * 1024)
+
+typedef struct _Run Run;
+
+struct _Run {
+	VteTerminal *vte;
+	MinitermCaptureReader *reader;
+	/* The next record to feed, valid while pending is set. */
+	MinitermCaptureRecord record;
+	bool pending;
+	bool paced;
+	gint64 start;
+	gint64 end;
+	guint64 bytes;
+	unsigned int records;
+	unsigned int frames;
+	/* How far feeding fell behind the recorded timing, in microseconds. */
+	gint64 max_lag;
+	/* Main loop stalls, in microseconds. */
+	gint64 last_beat;
+	gint64 blocked;
+	gint64 max_stall;
+};
+
+/* Replays the capture at path once. Returns false if it can't be opened. */
+static bool run_capture(
+	MinitermSettings *settings, const char *path, bool paced);
+/* Reads the next record into run, clearing pending at the end. */
+static void read_record(Run *run);
+/* Applies the pending record and reads the next. Returns the bytes fed. */
+static size_t feed_record(Run *run);
+/* Feeds the records that are due, then waits for the next if paced. */
+static gboolean feed_cb(gpointer user_data);
+static gboolean draw_cb(GtkWidget *widget, cairo_t *cr, gpointer user_data);
+static void title_cb(VteTerminal *vte, gpointer user_data);
+static gboolean heartbeat_cb(gpointer user_data);
+
+static bool
+run_capture(MinitermSettings *settings, const char *path, bool paced)
+{
+	Run run = {0};
+	GError *error = NULL;
+	run.reader = miniterm_capture_reader_new(path, &error);
+	if (run.reader == NULL) {
+		fprintf(stderr, "%s\n", error->message);
+		g_error_free(error);
+		return false;
+	}
+	run.paced = paced;
+	GtkWidget *window = gtk_window_new(GTK_WINDOW_TOPLEVEL);
+	MinitermTerminal *terminal =
+		miniterm_terminal_new(true, NULL, GTK_WINDOW(window));
+	run.vte = VTE_TERMINAL(terminal);
+	gtk_container_add(GTK_CONTAINER(window),
+		miniterm_terminal_get_container(terminal));
+	miniterm_terminal_set_settings(terminal, settings);
+	g_signal_connect_after(terminal, "draw", G_CALLBACK(draw_cb), &run);
+	g_signal_connect(terminal, "window-title-changed",
+		G_CALLBACK(title_cb), &run);
+	gtk_widget_show_all(window);
+
+	read_record(&run);
+	run.start = run.last_beat = g_get_monotonic_time();
+	/* Below redrawing, so frames come in between like with a real pty. */
+	g_idle_add(feed_cb, &run);
+	const unsigned int heartbeat =
+		g_timeout_add(HEARTBEAT_MS, heartbeat_cb, &run);
+	gtk_main();
+	g_source_remove(heartbeat);
+
+	/* The peak of the whole process, so earlier runs count too. */
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	char *name = g_path_get_basename(path);
+	char *extension = strrchr(name, '.');
+	if (extension != NULL && extension != name)
+		*extension = '\0';
+	const double seconds = (run.end - run.start) / 1e6;
+	const double mb = (double)run.bytes / MIB;
+	printf("replay.%s mode=%s mb=%.1f records=%u seconds=%.3f "
+	       "mb_per_s=%.1f frames=%u blocked_ms=%.1f max_stall_ms=%.1f "
+	       "max_lag_ms=%.1f peak_rss_kb=%ld\n",
+		name, paced ? "paced" : "fast", mb, run.records, seconds,
+		mb / seconds, run.frames, run.blocked / 1e3,
+		run.max_stall / 1e3, run.max_lag / 1e3, usage.ru_maxrss);
+	fflush(stdout);
+	g_free(name);
+	gtk_widget_destroy(window);
+	miniterm_capture_reader_free(run.reader);
+	return true;
+}
+
+static void
+read_record(Run *run)
+{
+	GError *error = NULL;
+	run->pending =
+		miniterm_capture_reader_next(run->reader, &run->record, &error);
+	/* A capture cut short when its terminal closed still replays. */
+	if (error != NULL) {
+		fprintf(stderr, "%s\n", error->message);
+		g_error_free(error);
+	}
+}
+
+static size_t
+feed_record(Run *run)
+{
+	size_t length = 0;
+	if (run->record.kind == MINITERM_CAPTURE_RESIZE) {
+		vte_terminal_set_size(
+			run->vte, run->record.columns, run->record.rows);
+	} else {
+		length = run->record.length;
+		vte_terminal_feed(run->vte, run->record.data, length);
+		run->bytes += length;
+	}
+	++run->records;
+	read_record(run);
+	return length;
+}
+
+static gboolean
+feed_cb(gpointer user_data)
+{
+	Run *run = user_data;
+	const gint64 now = g_get_monotonic_time();
+	size_t fed = 0;
+	while (run->pending) {
+		const gint64 due = run->start + run->record.time;
+		if (run->paced && due > now) {
+			g_timeout_add((due - now) / 1000, feed_cb, run);
+			return G_SOURCE_REMOVE;
+		}
+		if (!run->paced && fed >= FEED_CHUNK)
+			return G_SOURCE_CONTINUE;
+		if (run->paced)
+			run->max_lag = MAX(run->max_lag, now - due);
+		fed += feed_record(run);
+	}
+	/* Vte processes fed output later, the title marks the end. */
+	const char done[] = "\030\033[0m\033]0;" DONE_TITLE "\007";
+	vte_terminal_feed(run->vte, done, strlen(done));
+	return G_SOURCE_REMOVE;
+}
+
+static gboolean
+draw_cb(GtkWidget *widget, cairo_t *cr, gpointer user_data)
+{
+	(void)widget;
+	(void)cr;
+	Run *run = user_data;
+	++run->frames;
+	return FALSE;
+}
+
+static void
+title_cb(VteTerminal *vte, gpointer user_data)
+{
+	Run *run = user_data;
+	const char *title = vte_terminal_get_window_title(vte);
+	if (run->end == 0 && !run->pending
+		&& g_strcmp0(title, DONE_TITLE) == 0) {
+		run->end = g_get_monotonic_time();
+		gtk_main_quit();
+	}
+}
+
+static gboolean
+heartbeat_cb(gpointer user_data)
+{
+	Run *run = user_data;
+	const gint64 now = g_get_monotonic_time();
+	const gint64 stall = now - run->last_beat - HEARTBEAT_MS * 1000;
+	if (stall > 0) {
+		run->blocked += stall;
+		run->max_stall = MAX(run->max_stall, stall);
+	}
+	run->last_beat = now;
+	return G_SOURCE_CONTINUE;
+}
+
+int
+main(int argc, char *argv[])
+{
+	char *config_path = NULL;
+	int runs = 3;
+	gboolean paced = FALSE;
+	const GOptionEntry entries[] = {
+		{"runs", 'r', 0, G_OPTION_ARG_INT, &runs,
+			"Runs per capture (default: 3).", "N"},
+		{"config", 'c', 0, G_OPTION_ARG_FILENAME, &config_path,
+			"Use settings from this file instead of the defaults.",
+			"FILE"},
+		{"paced", 'p', 0, G_OPTION_ARG_NONE, &paced,
+			"Feed the output at the recorded timing.", 0},
+		{NULL}};
+	GError *error = NULL;
+	if (!gtk_init_with_args(
+		    &argc, &argv, "CAPTURE...", entries, NULL, &error)) {
+		fprintf(stderr, "%s\n", error->message);
+		g_error_free(error);
+		return EXIT_FAILURE;
+	}
+	if (argc < 2) {
+		fprintf(stderr, "No capture given, record one with "
+				"miniterm --capture=FILE\n");
+		return EXIT_FAILURE;
+	}
+
+	MinitermSettings *settings = config_path
+		? miniterm_settings_load(config_path)
+		: miniterm_settings_new();
+	int status = EXIT_SUCCESS;
+	for (int i = 1; i < argc && status == EXIT_SUCCESS; ++i) {
+		for (int run = 0; run < runs && status == EXIT_SUCCESS; ++run) {
+			if (!run_capture(settings, argv[i], paced))
+				status = EXIT_FAILURE;
+		}
+	}
+	miniterm_settings_unref(settings);
+	g_free(config_path);
+	return status;
+}
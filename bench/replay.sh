@@ -0,0 +1,15 @@
+#!/bin/sh
+# Runs the replay benchmark headless.
+#
+# Usage: replay.sh MINITERM_REPLAY [ARGS...] CAPTURE...
+#
+# ARGS are passed on, see MINITERM_REPLAY --help. Captures are recorded with
+# miniterm --capture=FILE. Prints one line per run:
+#   replay.CAPTURE mode=fast|paced mb=MB records=... seconds=... mb_per_s=...
+#   frames=... blocked_ms=... max_stall_ms=... max_lag_ms=... peak_rss_kb=...
+set -eu
+
+. "$(dirname "$0")/common.sh"
+
+bench_setup "$@"
+"$@"
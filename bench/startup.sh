@@ -0,0 +1,78 @@
+#!/bin/sh
+# Measures how long miniterm takes from being launched to its first frame and
+# first shell output, both as the first instance (cold) and as a client of an
+# instance that is already running (warm).
+#
+# Usage: startup.sh MINITERM [RUNS]
+#
+# Prints one line per stage with microseconds since launch:
+#   startup.MODE.STAGE n=RUNS p50=... p95=... p99=...
+# where STAGE is one of the events miniterm records when MINITERM_TRACE is set
+# (command-line, new-window, window, spawn, first-output, first-draw) or
+# client-exit, the time the launching process took to return.
+set -eu
+
+. "$(dirname "$0")/common.sh"
+
+miniterm=$1
+runs=${2:-20}
+bench_setup "$@"
+
+export MINITERM_TRACE="$bench_dir/trace"
+samples="$bench_dir/samples"
+: >"$MINITERM_TRACE"
+: >"$samples"
+
+# Linger so the window is drawn before the child exits and closes it.
+child="sh -c 'echo ready; sleep 1'"
+
+# wait_for_event EVENT ID: waits up to 10 s for EVENT, ID may be a pattern.
+wait_for_event() {
+	tries=0
+	while ! grep -q "^$1 [0-9]* $2\$" "$MINITERM_TRACE"; do
+		tries=$((tries + 1))
+		if [ "$tries" -gt 1000 ]; then
+			echo "Timed out waiting for $1" >&2
+			return 1
+		fi
+		sleep 0.01
+	done
+}
+
+# record_run MODE START: appends the stages of the latest launch to samples.
+record_run() {
+	wait_for_event window '[0-9]*' || return 0
+	id=$(awk '$1 == "window" { print $3; exit }' "$MINITERM_TRACE")
+	wait_for_event first-draw "$id" || return 0
+	# Prewarmed windows spawned their shell before this run.
+	if grep -q "^spawn [0-9]* $id\$" "$MINITERM_TRACE"; then
+		wait_for_event first-output "$id" || return 0
+	fi
+	awk -v mode="$1" -v start="$2" -v id="$id" '
+		($3 == 0 || $3 == id) && !seen[$1]++ {
+			print mode "." $1, $2 - start
+		}' "$MINITERM_TRACE" >>"$samples"
+}
+
+for run in $(seq "$runs"); do
+	: >"$MINITERM_TRACE"
+	start=$(now_us)
+	"$miniterm" -e "$child" &
+	pid=$!
+	record_run cold "$start"
+	# The instance quits once its only window closes.
+	wait "$pid" || true
+done
+
+"$miniterm" -e "sleep 86400" &
+bench_pids=$!
+wait_for_event first-draw '[0-9]*'
+for run in $(seq "$runs"); do
+	: >"$MINITERM_TRACE"
+	start=$(now_us)
+	"$miniterm" -e "$child"
+	echo "warm.client-exit $(($(now_us) - start))" >>"$samples"
+	record_run warm "$start"
+done
+
+bench_summarize startup "$samples"
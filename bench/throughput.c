@@ -0,0 +1,421 @@
+/*
+ * Copyright (c) 2018 Jason Waataja
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/*
+ * Feeds synthetic output through a MinitermTerminal, spawned the same way
+ * miniterm spawns shells, and reports how fast it is processed, or how long
+ * Ctrl+C takes to stop a flood. It needs an X server, run it through the
+ * miniterm-bench-throughput target.
+ */
+
+#include <gtk/gtk.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vte/vte.h>
+
+#include "settings.h"
+#include "terminal.h"
+
+/* Window title the generator sets after the workload. */
+#define DONE_TITLE "miniterm-bench-done"
+/* Interval of the timer used to detect main loop stalls. */
+#define HEARTBEAT_MS 5
+#define MIB (1024 * 1024)
+
+typedef struct _Run Run;
+
+struct _Run {
+	VteTerminal *vte;
+	const char *workload;
+	gint64 start;
+	gint64 end;
+	/* When Ctrl+C was sent, 0 if it wasn't. */
+	gint64 interrupt;
+	unsigned int frames;
+	/* Main loop stalls, in microseconds. */
+	gint64 last_beat;
+	gint64 blocked;
+	gint64 max_stall;
+};
+
+/* Appends the n-th unit (a line or a screen) of a workload to chunk. */
+typedef void (*GenerateFunc)(GString *chunk, unsigned int n);
+
+static void generate_ascii(GString *chunk, unsigned int n);
+static void generate_sgr(GString *chunk, unsigned int n);
+static void generate_cjk(GString *chunk, unsigned int n);
+static void generate_redraw(GString *chunk, unsigned int n);
+static void generate_long(GString *chunk, unsigned int n);
+
+static const struct {
+	const char *name;
+	GenerateFunc generate;
+} workloads[] = {
+	{"ascii", generate_ascii},
+	{"sgr", generate_sgr},
+	{"cjk", generate_cjk},
+	{"redraw", generate_redraw},
+	{"long", generate_long},
+};
+
+/* Set by SIGINT in the generator. */
+static volatile sig_atomic_t interrupted = 0;
+/* Seconds a run may take before the benchmark fails, 0 for no limit. */
+static int timeout_s = 600;
+
+/*
+ * Writes size_mb MiB of workload to stdout, or writes it until interrupted if
+ * size_mb is 0.
+ */
+static int generate(const char *workload, int size_mb);
+static void interrupt_handler(int signum);
+/* Floods the terminal and sends Ctrl+C after interrupt_ms if it is positive. */
+static void run_workload(MinitermSettings *settings, const char *self,
+	const char *workload, int size_mb, int interrupt_ms);
+
+/* Exits if the generator couldn't be spawned. */
+static void spawn_cb(MinitermTerminal *terminal, GPid pid, GError *error,
+	gpointer user_data);
+static gboolean draw_cb(GtkWidget *widget, cairo_t *cr, gpointer user_data);
+static void title_cb(VteTerminal *vte, gpointer user_data);
+/* Fails the benchmark if the generator exits without finishing. */
+static void exited_cb(VteTerminal *vte, int status, gpointer user_data);
+/* Fails the benchmark if a run takes longer than the timeout. */
+static gboolean watchdog_cb(gpointer user_data);
+static gboolean heartbeat_cb(gpointer user_data);
+/* Sends Ctrl+C the way a key press would. */
+static gboolean interrupt_cb(gpointer user_data);
+
+static void
+generate_ascii(GString *chunk, unsigned int n)
+{
+	for (unsigned int i = 0; i < 79; ++i)
+		g_string_append_c(chunk, '!' + (n + i) % 94);
+	g_string_append_c(chunk, '\n');
+}
+
+static void
+generate_sgr(GString *chunk, unsigned int n)
+{
+	for (unsigned int i = 0; i < 40; ++i) {
+		const unsigned int c = (n * 40 + i) * 7;
+		g_string_append_printf(chunk,
+			"\033[38;2;%u;%u;%um\033[48;2;%u;%u;%um%c", c % 256,
+			c / 3 % 256, c / 5 % 256, 255 - c % 256,
+			255 - c / 3 % 256, 255 - c / 5 % 256, 'a' + i % 26);
+	}
+	g_string_append(chunk, "\033[0m\n");
+}
+
+static void
+generate_cjk(GString *chunk, unsigned int n)
+{
+	for (unsigned int i = 0; i < 39; ++i) {
+		char utf8[6];
+		const int len = g_unichar_to_utf8(
+			0x4e00 + (n * 39 + i) % 0x5000, utf8);
+		g_string_append_len(chunk, utf8, len);
+	}
+	g_string_append_c(chunk, '\n');
+}
+
+static void
+generate_redraw(GString *chunk, unsigned int n)
+{
+	/* A full screen update the way top redraws. */
+	g_string_append_printf(chunk,
+		"\033[H\033[7mframe %-10u PID USER %%CPU %%MEM COMMAND"
+		"\033[K\033[0m",
+		n);
+	for (unsigned int row = 2; row <= 24; ++row) {
+		g_string_append_printf(chunk,
+			"\033[%u;1H%5u %-8s %4.1f %4.1f process-%u\033[K", row,
+			(n * 31 + row) % 32768, "user", (n + row) % 1000 / 10.0,
+			row / 10.0, (n + row) % 97);
+	}
+}
+
+static void
+generate_long(GString *chunk, unsigned int n)
+{
+	for (unsigned int i = 0; i < 16384; ++i)
+		g_string_append_c(chunk, 'a' + (n + i) % 26);
+	g_string_append_c(chunk, '\n');
+}
+
+static int
+generate(const char *workload, int size_mb)
+{
+	GenerateFunc generate_func = NULL;
+	for (size_t i = 0; i < G_N_ELEMENTS(workloads); ++i) {
+		if (strcmp(workloads[i].name, workload) == 0)
+			generate_func = workloads[i].generate;
+	}
+	if (generate_func == NULL) {
+		fprintf(stderr, "Unknown workload: %s\n", workload);
+		return EXIT_FAILURE;
+	}
+	const bool endless = size_mb == 0;
+	if (endless)
+		signal(SIGINT, interrupt_handler);
+	GString *chunk = g_string_new(NULL);
+	size_t remaining = (size_t)size_mb * MIB;
+	for (unsigned int n = 0; endless ? !interrupted : remaining > 0; ++n) {
+		g_string_truncate(chunk, 0);
+		generate_func(chunk, n);
+		const size_t len =
+			endless ? chunk->len : MIN(remaining, chunk->len);
+		fwrite(chunk->str, 1, len, stdout);
+		if (!endless)
+			remaining -= len;
+	}
+	g_string_free(chunk, TRUE);
+	/* Cancel a sequence the cut might have left open, then signal done. */
+	printf("\030\033[0m\n\033]0;" DONE_TITLE "\007");
+	fflush(stdout);
+	return EXIT_SUCCESS;
+}
+
+static void
+interrupt_handler(int signum)
+{
+	(void)signum;
+	interrupted = 1;
+}
+
+static void
+run_workload(MinitermSettings *settings, const char *self,
+	const char *workload, int size_mb, int interrupt_ms)
+{
+	Run run = {0};
+	run.workload = workload;
+	GtkWidget *window = gtk_window_new(GTK_WINDOW_TOPLEVEL);
+	MinitermTerminal *terminal =
+		miniterm_terminal_new(true, NULL, GTK_WINDOW(window));
+	run.vte = VTE_TERMINAL(terminal);
+	gtk_container_add(GTK_CONTAINER(window),
+		miniterm_terminal_get_container(terminal));
+	miniterm_terminal_set_settings(terminal, settings);
+	g_signal_connect_after(terminal, "draw", G_CALLBACK(draw_cb), &run);
+	g_signal_connect(terminal, "window-title-changed",
+		G_CALLBACK(title_cb), &run);
+	g_signal_connect(
+		terminal, "child-exited", G_CALLBACK(exited_cb), &run);
+	/*
+	 * Without a window manager the window never becomes active, so this
+	 * measures the redraw rate of an unfocused window.
+	 */
+	gtk_widget_show_all(window);
+
+	char *quoted_self = g_shell_quote(self);
+	char *command = g_strdup_printf("%s --generate %s %d", quoted_self,
+		workload, interrupt_ms > 0 ? 0 : size_mb);
+	g_free(quoted_self);
+	run.start = run.last_beat = g_get_monotonic_time();
+	miniterm_terminal_spawn(terminal, NULL, command, NULL, spawn_cb, NULL);
+	g_free(command);
+	const unsigned int heartbeat =
+		g_timeout_add(HEARTBEAT_MS, heartbeat_cb, &run);
+	if (interrupt_ms > 0)
+		g_timeout_add(interrupt_ms, interrupt_cb, &run);
+	const unsigned int watchdog = timeout_s > 0
+		? g_timeout_add_seconds(timeout_s, watchdog_cb, &run)
+		: 0;
+	gtk_main();
+	g_source_remove(heartbeat);
+	if (watchdog != 0)
+		g_source_remove(watchdog);
+
+	if (interrupt_ms > 0) {
+		printf("interrupt.%s flood_threshold=%d after_ms=%d "
+		       "interrupt_ms=%.1f frames=%u max_stall_ms=%.1f\n",
+			workload, settings->flood_threshold, interrupt_ms,
+			(run.end - run.interrupt) / 1e3, run.frames,
+			run.max_stall / 1e3);
+	} else {
+		const double seconds = (run.end - run.start) / 1e6;
+		printf("throughput.%s scrollback=%d mb=%d seconds=%.3f "
+		       "mb_per_s=%.1f frames=%u blocked_ms=%.1f "
+		       "max_stall_ms=%.1f\n",
+			workload, settings->scrollback_lines, size_mb, seconds,
+			size_mb / seconds, run.frames, run.blocked / 1e3,
+			run.max_stall / 1e3);
+	}
+	fflush(stdout);
+	gtk_widget_destroy(window);
+}
+
+static void
+spawn_cb(MinitermTerminal *terminal, GPid pid, GError *error,
+	gpointer user_data)
+{
+	(void)terminal;
+	(void)pid;
+	(void)user_data;
+	if (error != NULL) {
+		fprintf(stderr, "%s\n", error->message);
+		exit(EXIT_FAILURE);
+	}
+}
+
+static gboolean
+draw_cb(GtkWidget *widget, cairo_t *cr, gpointer user_data)
+{
+	(void)widget;
+	(void)cr;
+	Run *run = user_data;
+	++run->frames;
+	return FALSE;
+}
+
+static void
+title_cb(VteTerminal *vte, gpointer user_data)
+{
+	Run *run = user_data;
+	const char *title = vte_terminal_get_window_title(vte);
+	if (run->end == 0 && g_strcmp0(title, DONE_TITLE) == 0) {
+		run->end = g_get_monotonic_time();
+		gtk_main_quit();
+	}
+}
+
+static void
+exited_cb(VteTerminal *vte, int status, gpointer user_data)
+{
+	(void)vte;
+	Run *run = user_data;
+	if (run->end != 0)
+		return;
+	fprintf(stderr, "The %s workload exited with status %d before "
+			"finishing\n",
+		run->workload, status);
+	exit(EXIT_FAILURE);
+}
+
+static gboolean
+watchdog_cb(gpointer user_data)
+{
+	Run *run = user_data;
+	fprintf(stderr, "The %s workload didn't finish in %d seconds\n",
+		run->workload, timeout_s);
+	exit(EXIT_FAILURE);
+	return G_SOURCE_REMOVE;
+}
+
+static gboolean
+heartbeat_cb(gpointer user_data)
+{
+	Run *run = user_data;
+	const gint64 now = g_get_monotonic_time();
+	const gint64 stall = now - run->last_beat - HEARTBEAT_MS * 1000;
+	if (stall > 0) {
+		run->blocked += stall;
+		run->max_stall = MAX(run->max_stall, stall);
+	}
+	run->last_beat = now;
+	return G_SOURCE_CONTINUE;
+}
+
+static gboolean
+interrupt_cb(gpointer user_data)
+{
+	Run *run = user_data;
+	run->interrupt = g_get_monotonic_time();
+	vte_terminal_feed_child(run->vte, "\003", 1);
+	return G_SOURCE_REMOVE;
+}
+
+int
+main(int argc, char *argv[])
+{
+	if (argc == 4 && strcmp(argv[1], "--generate") == 0)
+		return generate(argv[2], atoi(argv[3]));
+
+	char *workload = NULL;
+	char *config_path = NULL;
+	char *scrollback = NULL;
+	int size_mb = 64;
+	int runs = 3;
+	int interrupt_ms = 0;
+	const GOptionEntry entries[] = {
+		{"workload", 'w', 0, G_OPTION_ARG_STRING, &workload,
+			"Only run one of ascii, sgr, cjk, redraw and long.",
+			"NAME"},
+		{"size", 's', 0, G_OPTION_ARG_INT, &size_mb,
+			"Megabytes of output per run (default: 64).", "MB"},
+		{"runs", 'r', 0, G_OPTION_ARG_INT, &runs,
+			"Runs per workload (default: 3).", "N"},
+		{"config", 'c', 0, G_OPTION_ARG_FILENAME, &config_path,
+			"Use settings from this file instead of the defaults.",
+			"FILE"},
+		{"scrollback", 'l', 0, G_OPTION_ARG_STRING, &scrollback,
+			"Comma separated scrollback sizes to compare.",
+			"LINES"},
+		{"interrupt", 'i', 0, G_OPTION_ARG_INT, &interrupt_ms,
+			"Flood the terminal and time Ctrl+C sent after this "
+			"many milliseconds.",
+			"MS"},
+		{"timeout", 't', 0, G_OPTION_ARG_INT, &timeout_s,
+			"Fail if a run takes longer than this, 0 for no limit "
+			"(default: 600).",
+			"SECONDS"},
+		{NULL}};
+	GError *error = NULL;
+	if (!gtk_init_with_args(&argc, &argv, NULL, entries, NULL, &error)) {
+		fprintf(stderr, "%s\n", error->message);
+		g_error_free(error);
+		return EXIT_FAILURE;
+	}
+	char *self = g_file_read_link("/proc/self/exe", NULL);
+	if (self == NULL)
+		self = g_strdup(argv[0]);
+
+	/* Without sizes, run once with the configured scrollback. */
+	char **scrollback_sizes =
+		g_strsplit(scrollback ? scrollback : "", ",", -1);
+	const unsigned int size_count =
+		MAX(g_strv_length(scrollback_sizes), 1);
+	for (unsigned int s = 0; s < size_count; ++s) {
+		MinitermSettings *settings = config_path
+			? miniterm_settings_load(config_path)
+			: miniterm_settings_new();
+		if (scrollback_sizes[s] != NULL)
+			settings->scrollback_lines = atoi(scrollback_sizes[s]);
+		for (size_t i = 0; i < G_N_ELEMENTS(workloads); ++i) {
+			if (workload && strcmp(workload, workloads[i].name))
+				continue;
+			for (int run = 0; run < runs; ++run)
+				run_workload(settings, self, workloads[i].name,
+					size_mb, interrupt_ms);
+		}
+		miniterm_settings_unref(settings);
+	}
+	g_strfreev(scrollback_sizes);
+	g_free(self);
+	g_free(workload);
+	g_free(config_path);
+	g_free(scrollback);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,17 @@
+#!/bin/sh
+# Runs the throughput benchmark headless.
+#
+# Usage: throughput.sh MINITERM_THROUGHPUT [ARGS...]
+#
+# ARGS are passed on, see MINITERM_THROUGHPUT --help. Prints one line per run:
+#   throughput.WORKLOAD scrollback=LINES mb=MB seconds=... mb_per_s=...
+#   frames=... blocked_ms=... max_stall_ms=...
+# or with --interrupt:
+#   interrupt.WORKLOAD flood_threshold=MB after_ms=MS interrupt_ms=...
+#   frames=... max_stall_ms=...
+set -eu
+
+. "$(dirname "$0")/common.sh"
+
+bench_setup "$@"
+"$@"
@@ -0,0 +1,965 @@
+/*
+ * Copyright (c) 2018 Jason Waataja
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "application.h"
+
+#include "log.h"
+#include "session.h"
+#include "shard.h"
+#include "trace.h"
+#include "zygote.h"
+
+struct _MinitermApplication {
+	GtkApplication parent;
+};
+
+typedef struct _MinitermApplicationPrivate MinitermApplicationPrivate;
+
+struct _MinitermApplicationPrivate {
+	/* Index of the shard this instance is, -1 for the primary instance. */
+	int shard;
+	/* Set in the primary instance when windows are sharded. */
+	MinitermDispatcher *dispatcher;
+	char *config_path;
+	/* Current settings snapshot. Replaced, never modified, on reload. */
+	MinitermSettings *settings;
+	/* NULL until startup or if the config file can't be monitored. */
+	GFileMonitor *config_monitor;
+	/*
+	 * Live terminals, most recently focused first and never focused ones
+	 * last. These aren't refed, they're removed on destroy.
+	 */
+	GList *terminals;
+	/* Idle source that enforces the scrollback budget. 0 indicates none. */
+	unsigned int rebalance_source;
+	/*
+	 * Hidden windows with a shell already running in the home directory.
+	 * They're owned by GTK like any other toplevel.
+	 */
+	GQueue *prewarmed;
+	/*
+	 * The environment prewarmed shells are started with. NULL for
+	 * miniterm's own.
+	 */
+	char **prewarm_environment;
+	/*
+	 * Another environment a command asked for a window with, the shells
+	 * are restarted with it if the next command has it too. NULL indicates
+	 * none.
+	 */
+	char **prewarm_candidate;
+	/* Idle source that fills prewarmed. 0 indicates none. */
+	unsigned int refill_source;
+	/* Registration of the statistics interface. 0 indicates none. */
+	unsigned int stats_registration;
+	/* Registration of the shard interface. 0 indicates none. */
+	unsigned int shard_registration;
+	/* Set in daemon mode, which keeps running without windows. */
+	bool daemon;
+	/*
+	 * Offscreen terminal that keeps the configured font loaded in daemon
+	 * mode, otherwise NULL.
+	 */
+	GtkWidget *warm_window;
+	/* The terminal in warm_window, owned by it. */
+	VteTerminal *warm_terminal;
+	/* Window icon, NULL if the icon theme has none. */
+	GdkPixbuf *icon;
+	bool icon_loaded;
+};
+
+/* Introspection data of the interface for querying terminal statistics. */
+static const char stats_xml[] =
+	"<node>"
+	"  <interface name='us.laelath.miniterm.Stats'>"
+	"    <method name='GetStats'>"
+	"      <arg type='aa{sv}' name='terminals' direction='out'/>"
+	"    </method>"
+	"  </interface>"
+	"</node>";
+
+G_DEFINE_TYPE_WITH_PRIVATE(
+	MinitermApplication, miniterm_application, GTK_TYPE_APPLICATION)
+
+static void miniterm_application_startup(GApplication *app);
+static void miniterm_application_shutdown(GApplication *app);
+static gboolean miniterm_application_dbus_register(GApplication *app,
+	GDBusConnection *connection, const char *object_path, GError **error);
+static void miniterm_application_dbus_unregister(GApplication *app,
+	GDBusConnection *connection, const char *object_path);
+static void miniterm_application_finalize(GObject *app);
+
+/* Handles calls to the statistics interface. */
+static void stats_method_cb(GDBusConnection *connection, const char *sender,
+	const char *object_path, const char *interface_name,
+	const char *method_name, GVariant *parameters,
+	GDBusMethodInvocation *invocation, gpointer user_data);
+
+/* Adds the latency percentiles to a terminal's statistics, if measured. */
+static void add_latency(
+	GVariantBuilder *builder, const MinitermHistogram *latency);
+
+static const GDBusInterfaceVTable stats_vtable = {stats_method_cb, NULL, NULL};
+
+/* Callback to reload settings when the config file changes on disk. */
+static void config_changed_cb(GFileMonitor *monitor, GFile *file,
+	GFile *other_file, GFileMonitorEvent event, gpointer user_data);
+/* Callback to stop tracking a terminal once it is destroyed. */
+static void terminal_destroy_cb(GtkWidget *terminal, gpointer user_data);
+/* Callback to move a terminal to the front of the focus order. */
+static gboolean terminal_focus_cb(
+	GtkWidget *terminal, GdkEvent *event, gpointer user_data);
+/* Callback to recheck the budget when a terminal's width may have changed. */
+static void terminal_size_cb(
+	GtkWidget *terminal, GdkRectangle *allocation, gpointer user_data);
+
+/* Starts enforcing the scrollback budget if it isn't already. */
+static void schedule_rebalance(MinitermApplication *app);
+/*
+ * Idle callback that splits the scrollback budget between terminals, giving
+ * the most recently focused ones their full scrollback first.
+ */
+static gboolean rebalance_cb(gpointer user_data);
+
+/* Starts filling or trimming the prewarmed windows if it isn't already. */
+static void schedule_refill(MinitermApplication *app);
+/* Idle callback that adds or removes one prewarmed window at a time. */
+static gboolean refill_cb(gpointer user_data);
+/* Callback to stop prewarming if a shell couldn't be spawned. */
+static void prewarm_spawn_cb(MinitermTerminal *terminal, GPid pid,
+	GError *error, gpointer user_data);
+/* Callback to drop a prewarmed window whose shell went away. */
+static void prewarmed_destroy_cb(GtkWidget *window, gpointer user_data);
+/*
+ * Returns whether a shell started with environment a would get the same
+ * variables as one started with b. NULL stands for miniterm's own.
+ */
+static bool environment_equal(
+	const char *const *a, const char *const *b);
+/* Returns whether a variable, as NAME=value, is compared at all. */
+static bool is_compared(const char *variable);
+/* Counts the variables of environment that are compared. */
+static unsigned int count_compared(const char *const *environment);
+
+/*
+ * Shows a terminal offscreen so the font, its glyphs and the rgba visual are
+ * loaded before the first window.
+ */
+static void warm_up(MinitermApplication *app);
+/* Callback to draw the warm terminal once its text was processed. */
+static void warm_contents_cb(VteTerminal *vte, gpointer user_data);
+
+static void
+miniterm_application_init(MinitermApplication *app)
+{
+	MinitermApplicationPrivate *priv =
+		miniterm_application_get_instance_private(app);
+	priv->shard = -1;
+	priv->dispatcher = NULL;
+	priv->config_path = miniterm_settings_get_default_path();
+	priv->settings = miniterm_settings_new();
+	priv->config_monitor = NULL;
+	priv->terminals = NULL;
+	priv->rebalance_source = 0;
+	priv->prewarmed = g_queue_new();
+	priv->prewarm_environment = NULL;
+	priv->prewarm_candidate = NULL;
+	priv->refill_source = 0;
+	priv->stats_registration = 0;
+	priv->shard_registration = 0;
+	priv->daemon = false;
+	priv->warm_window = NULL;
+	priv->warm_terminal = NULL;
+	priv->icon = NULL;
+	priv->icon_loaded = false;
+}
+
+static void
+miniterm_application_class_init(MinitermApplicationClass *kclass)
+{
+	GObjectClass *object_class = G_OBJECT_CLASS(kclass);
+	GApplicationClass *app_class = G_APPLICATION_CLASS(kclass);
+	object_class->finalize = miniterm_application_finalize;
+	app_class->startup = miniterm_application_startup;
+	app_class->shutdown = miniterm_application_shutdown;
+	app_class->dbus_register = miniterm_application_dbus_register;
+	app_class->dbus_unregister = miniterm_application_dbus_unregister;
+}
+
+static void
+miniterm_application_startup(GApplication *app)
+{
+	MinitermApplicationPrivate *priv =
+		miniterm_application_get_instance_private(
+			MINITERM_APPLICATION(app));
+	/*
+	 * Only the primary instance gets here, so remote instances never touch
+	 * the config file.
+	 */
+	if (!g_file_test(priv->config_path, G_FILE_TEST_EXISTS)) {
+		char *config_dir = g_path_get_dirname(priv->config_path);
+		g_mkdir_with_parents(config_dir, 0777);
+		miniterm_write_default_settings(priv->config_path);
+		g_free(config_dir);
+	}
+	miniterm_settings_unref(priv->settings);
+	priv->settings = miniterm_settings_load(priv->config_path);
+
+	GFile *config_file = g_file_new_for_path(priv->config_path);
+	priv->config_monitor = g_file_monitor_file(
+		config_file, G_FILE_MONITOR_NONE, NULL, NULL);
+	if (priv->config_monitor != NULL)
+		g_signal_connect(priv->config_monitor, "changed",
+			G_CALLBACK(config_changed_cb), app);
+	g_object_unref(config_file);
+
+	/* Changing the mode takes a restart, running windows can't move. */
+	GDBusConnection *connection = g_application_get_dbus_connection(app);
+	if (priv->shard < 0 && priv->settings->sharded) {
+		if (connection != NULL)
+			priv->dispatcher = miniterm_dispatcher_new(app,
+				connection,
+				priv->settings->shards > 0
+					? priv->settings->shards
+					: (int)g_get_num_processors());
+		else
+			g_printerr("Sharding needs D-Bus, hosting windows "
+				   "in one process\n");
+	}
+	/*
+	 * Fork the spawn helper while the process is small, forking it for
+	 * every child stays cheap however big miniterm grows. The dispatcher
+	 * spawns no shells.
+	 */
+	if (priv->dispatcher == NULL)
+		miniterm_zygote_start();
+	/* This initializes GTK. */
+	G_APPLICATION_CLASS(miniterm_application_parent_class)->startup(app);
+}
+
+static void
+miniterm_application_shutdown(GApplication *app)
+{
+	MinitermApplicationPrivate *priv =
+		miniterm_application_get_instance_private(
+			MINITERM_APPLICATION(app));
+	/* With sharding the windows belong to the shards, which don't save. */
+	if (priv->shard < 0 && priv->dispatcher == NULL
+		&& priv->settings->save_session) {
+		char *session = miniterm_session_get_default_directory();
+		GError *error = NULL;
+		if (!miniterm_session_save(GTK_APPLICATION(app), session,
+			    priv->settings->session_scrollback, &error)) {
+			g_printerr("Failed to save session: %s\n",
+				error->message);
+			g_error_free(error);
+		}
+		g_free(session);
+	}
+	if (priv->dispatcher != NULL) {
+		miniterm_dispatcher_free(priv->dispatcher);
+		priv->dispatcher = NULL;
+	}
+	/* Windows left open when quitting by signal still have to log. */
+	GList *windows = g_list_copy(
+		gtk_application_get_windows(GTK_APPLICATION(app)));
+	for (GList *l = windows; l != NULL; l = l->next)
+		gtk_widget_destroy(GTK_WIDGET(l->data));
+	g_list_free(windows);
+	if (priv->warm_window != NULL) {
+		gtk_widget_destroy(priv->warm_window);
+		priv->warm_window = NULL;
+		priv->warm_terminal = NULL;
+	}
+	miniterm_log_wait_freed();
+	miniterm_zygote_stop();
+	G_APPLICATION_CLASS(miniterm_application_parent_class)->shutdown(app);
+}
+
+static gboolean
+miniterm_application_dbus_register(GApplication *app,
+	GDBusConnection *connection, const char *object_path, GError **error)
+{
+	MinitermApplicationPrivate *priv =
+		miniterm_application_get_instance_private(
+			MINITERM_APPLICATION(app));
+	if (!G_APPLICATION_CLASS(miniterm_application_parent_class)
+			->dbus_register(app, connection, object_path, error))
+		return FALSE;
+	GDBusNodeInfo *info = g_dbus_node_info_new_for_xml(stats_xml, error);
+	if (info == NULL)
+		return FALSE;
+	priv->stats_registration = g_dbus_connection_register_object(
+		connection, object_path, info->interfaces[0], &stats_vtable,
+		app, NULL, error);
+	g_dbus_node_info_unref(info);
+	if (priv->stats_registration == 0)
+		return FALSE;
+	if (priv->shard >= 0) {
+		priv->shard_registration = miniterm_shard_register(
+			app, connection, object_path, error);
+		return priv->shard_registration != 0;
+	}
+	return TRUE;
+}
+
+static void
+miniterm_application_dbus_unregister(GApplication *app,
+	GDBusConnection *connection, const char *object_path)
+{
+	MinitermApplicationPrivate *priv =
+		miniterm_application_get_instance_private(
+			MINITERM_APPLICATION(app));
+	if (priv->stats_registration != 0) {
+		g_dbus_connection_unregister_object(
+			connection, priv->stats_registration);
+		priv->stats_registration = 0;
+	}
+	if (priv->shard_registration != 0) {
+		g_dbus_connection_unregister_object(
+			connection, priv->shard_registration);
+		priv->shard_registration = 0;
+	}
+	G_APPLICATION_CLASS(miniterm_application_parent_class)
+		->dbus_unregister(app, connection, object_path);
+}
+
+static void
+miniterm_application_finalize(GObject *app)
+{
+	MinitermApplicationPrivate *priv =
+		miniterm_application_get_instance_private(
+			MINITERM_APPLICATION(app));
+	for (GList *l = priv->terminals; l != NULL; l = l->next)
+		g_signal_handlers_disconnect_by_data(l->data, app);
+	g_list_free(priv->terminals);
+	if (priv->rebalance_source != 0)
+		g_source_remove(priv->rebalance_source);
+	for (GList *l = priv->prewarmed->head; l != NULL; l = l->next)
+		g_signal_handlers_disconnect_by_func(
+			l->data, prewarmed_destroy_cb, app);
+	g_queue_free(priv->prewarmed);
+	g_strfreev(priv->prewarm_environment);
+	g_strfreev(priv->prewarm_candidate);
+	if (priv->refill_source != 0)
+		g_source_remove(priv->refill_source);
+	g_clear_object(&priv->config_monitor);
+	g_clear_object(&priv->icon);
+	miniterm_settings_unref(priv->settings);
+	g_free(priv->config_path);
+	G_OBJECT_CLASS(miniterm_application_parent_class)->finalize(app);
+}
+
+MinitermApplication *
+miniterm_application_new(int shard)
+{
+	char *id = shard >= 0 ? miniterm_shard_get_id(shard)
+			      : g_strdup("us.laelath.miniterm");
+	MinitermApplication *app = g_object_new(MINITERM_TYPE_APPLICATION,
+		"application-id", id, "flags",
+		G_APPLICATION_HANDLES_COMMAND_LINE
+			| G_APPLICATION_SEND_ENVIRONMENT,
+		NULL);
+	g_free(id);
+	MinitermApplicationPrivate *priv =
+		miniterm_application_get_instance_private(app);
+	priv->shard = shard;
+	return app;
+}
+
+int
+miniterm_application_get_shard(MinitermApplication *app)
+{
+	MinitermApplicationPrivate *priv =
+		miniterm_application_get_instance_private(app);
+	return priv->shard;
+}
+
+bool
+miniterm_application_dispatch(MinitermApplication *app,
+	GApplicationCommandLine *command_line, bool tab, bool usage)
+{
+	MinitermApplicationPrivate *priv =
+		miniterm_application_get_instance_private(app);
+	if (priv->dispatcher == NULL)
+		return false;
+	miniterm_dispatcher_forward(
+		priv->dispatcher, command_line, tab, usage);
+	return true;
+}
+
+void
+miniterm_application_start_daemon(MinitermApplication *app)
+{
+	MinitermApplicationPrivate *priv =
+		miniterm_application_get_instance_private(app);
+	if (priv->daemon)
+		return;
+	priv->daemon = true;
+	g_application_hold(G_APPLICATION(app));
+	/*
+	 * The dispatcher's windows and their fonts are in the shards, have one
+	 * running before the first window.
+	 */
+	if (priv->dispatcher != NULL) {
+		miniterm_dispatcher_keep_spare(priv->dispatcher);
+		return;
+	}
+	warm_up(app);
+	if (priv->settings->prewarm > 0)
+		schedule_refill(app);
+}
+
+bool
+miniterm_application_is_daemon(MinitermApplication *app)
+{
+	MinitermApplicationPrivate *priv =
+		miniterm_application_get_instance_private(app);
+	return priv->daemon;
+}
+
+GdkPixbuf *
+miniterm_application_get_icon(MinitermApplication *app)
+{
+	MinitermApplicationPrivate *priv =
+		miniterm_application_get_instance_private(app);
+	if (!priv->icon_loaded) {
+		priv->icon = gtk_icon_theme_load_icon(
+			gtk_icon_theme_get_default(), "terminal", 48, 0, NULL);
+		priv->icon_loaded = true;
+	}
+	return priv->icon;
+}
+
+MinitermSettings *
+miniterm_application_get_settings(MinitermApplication *app)
+{
+	MinitermApplicationPrivate *priv =
+		miniterm_application_get_instance_private(app);
+	return priv->settings;
+}
+
+void
+miniterm_application_reload_settings(MinitermApplication *app)
+{
+	MinitermApplicationPrivate *priv =
+		miniterm_application_get_instance_private(app);
+	MinitermSettings *settings = miniterm_settings_load(priv->config_path);
+	miniterm_settings_unref(priv->settings);
+	priv->settings = settings;
+	for (GList *l = priv->terminals; l != NULL; l = l->next)
+		miniterm_terminal_set_settings(
+			MINITERM_TERMINAL(l->data), settings);
+	if (priv->warm_terminal != NULL && settings->font != NULL)
+		vte_terminal_set_font(priv->warm_terminal, settings->font);
+	/* The dispatcher has no windows to prewarm. */
+	if (priv->dispatcher == NULL
+		&& (!g_queue_is_empty(priv->prewarmed)
+			|| settings->prewarm > 0))
+		schedule_refill(app);
+	schedule_rebalance(app);
+}
+
+void
+miniterm_application_add_terminal(
+	MinitermApplication *app, MinitermTerminal *terminal)
+{
+	MinitermApplicationPrivate *priv =
+		miniterm_application_get_instance_private(app);
+	/* Only focusing a terminal makes it recently used. */
+	priv->terminals = g_list_append(priv->terminals, terminal);
+	g_signal_connect(
+		terminal, "destroy", G_CALLBACK(terminal_destroy_cb), app);
+	g_signal_connect(terminal, "focus-in-event",
+		G_CALLBACK(terminal_focus_cb), app);
+	g_signal_connect_after(terminal, "size-allocate",
+		G_CALLBACK(terminal_size_cb), app);
+	miniterm_terminal_set_settings(terminal, priv->settings);
+	schedule_rebalance(app);
+}
+
+char *
+miniterm_application_get_scrollback_report(MinitermApplication *app)
+{
+	MinitermApplicationPrivate *priv =
+		miniterm_application_get_instance_private(app);
+	const double mib = 1024.0 * 1024.0;
+	GString *report = g_string_new(NULL);
+	GList *windows = gtk_application_get_windows(GTK_APPLICATION(app));
+	for (GList *w = windows; w != NULL; w = w->next) {
+		/* Skip prewarmed windows, they have no history yet. */
+		if (!gtk_widget_get_visible(GTK_WIDGET(w->data)))
+			continue;
+		int tabs = 0;
+		long used = 0;
+		long limit = 0;
+		size_t size = 0;
+		for (GList *l = priv->terminals; l != NULL; l = l->next) {
+			MinitermTerminal *terminal = MINITERM_TERMINAL(l->data);
+			if (gtk_widget_get_toplevel(GTK_WIDGET(terminal))
+				!= w->data)
+				continue;
+			const long lines =
+				miniterm_terminal_get_scrollback_used(terminal);
+			++tabs;
+			used += lines;
+			limit += vte_terminal_get_scrollback_lines(
+				VTE_TERMINAL(terminal));
+			size += lines
+				* miniterm_terminal_get_line_size(terminal);
+		}
+		if (tabs == 0)
+			continue;
+		const char *title = gtk_window_get_title(GTK_WINDOW(w->data));
+		g_string_append_printf(report,
+			"%s: %d %s, %ld of %ld lines, %.1f MiB\n",
+			title != NULL ? title : "miniterm", tabs,
+			tabs == 1 ? "tab" : "tabs", used, limit, size / mib);
+	}
+
+	size_t total = 0;
+	for (GList *l = priv->terminals; l != NULL; l = l->next) {
+		MinitermTerminal *terminal = MINITERM_TERMINAL(l->data);
+		total += miniterm_terminal_get_scrollback_used(terminal)
+			* miniterm_terminal_get_line_size(terminal);
+	}
+	if (priv->settings->scrollback_budget_mb > 0)
+		g_string_append_printf(report, "total: %.1f of %d MiB\n",
+			total / mib, priv->settings->scrollback_budget_mb);
+	else
+		g_string_append_printf(
+			report, "total: %.1f MiB\n", total / mib);
+	return g_string_free(report, FALSE);
+}
+
+MinitermWindow *
+miniterm_application_take_prewarmed(MinitermApplication *app,
+	const char *working_directory, const char *const *environment)
+{
+	MinitermApplicationPrivate *priv =
+		miniterm_application_get_instance_private(app);
+	if (priv->settings->prewarm <= 0 || working_directory == NULL)
+		return NULL;
+	/*
+	 * The shells were started with another environment. A single command
+	 * from elsewhere keeps them, but once two in a row share an environment
+	 * the shells are replaced with ones started with it.
+	 */
+	if (!environment_equal(
+		    (const char *const *)priv->prewarm_environment,
+		    environment)) {
+		const bool repeated = priv->prewarm_candidate != NULL
+			&& environment_equal(
+				(const char *const *)priv->prewarm_candidate,
+				environment);
+		g_strfreev(priv->prewarm_candidate);
+		priv->prewarm_candidate = environment != NULL
+			? g_strdupv((char **)environment)
+			: g_get_environ();
+		if (!repeated)
+			return NULL;
+		g_strfreev(priv->prewarm_environment);
+		priv->prewarm_environment = g_steal_pointer(
+			&priv->prewarm_candidate);
+		GtkWidget *window;
+		while ((window = g_queue_pop_head(priv->prewarmed)) != NULL) {
+			g_signal_handlers_disconnect_by_func(
+				window, prewarmed_destroy_cb, app);
+			gtk_widget_destroy(window);
+		}
+		schedule_refill(app);
+		return NULL;
+	}
+	g_clear_pointer(&priv->prewarm_candidate, g_strfreev);
+	schedule_refill(app);
+
+	/* Prewarmed shells can't change directory, only hand out exact fits. */
+	GFile *home = g_file_new_for_path(g_get_home_dir());
+	GFile *directory = g_file_new_for_path(working_directory);
+	const bool is_home = g_file_equal(home, directory);
+	g_object_unref(home);
+	g_object_unref(directory);
+	if (!is_home || g_queue_is_empty(priv->prewarmed))
+		return NULL;
+
+	MinitermWindow *window = g_queue_pop_head(priv->prewarmed);
+	g_signal_handlers_disconnect_by_func(
+		window, prewarmed_destroy_cb, app);
+	/* It counts against the budget from now on. */
+	schedule_rebalance(app);
+	return window;
+}
+
+static void
+schedule_rebalance(MinitermApplication *app)
+{
+	MinitermApplicationPrivate *priv =
+		miniterm_application_get_instance_private(app);
+	if (priv->rebalance_source == 0)
+		priv->rebalance_source = g_idle_add_full(
+			G_PRIORITY_LOW, rebalance_cb, app, NULL);
+}
+
+static gboolean
+rebalance_cb(gpointer user_data)
+{
+	MinitermApplicationPrivate *priv =
+		miniterm_application_get_instance_private(
+			MINITERM_APPLICATION(user_data));
+	priv->rebalance_source = 0;
+	const MinitermSettings *settings = priv->settings;
+	size_t budget =
+		(size_t)MAX(settings->scrollback_budget_mb, 0) * 1024 * 1024;
+	for (GList *l = priv->terminals; l != NULL; l = l->next) {
+		MinitermTerminal *terminal = MINITERM_TERMINAL(l->data);
+		/*
+		 * Spares only hold a prompt, don't let them take budget from
+		 * terminals in use.
+		 */
+		GtkWidget *window =
+			gtk_widget_get_toplevel(GTK_WIDGET(terminal));
+		if (settings->scrollback_budget_mb <= 0
+			|| g_queue_find(priv->prewarmed, window) != NULL) {
+			miniterm_terminal_set_scrollback_limit(terminal, -1);
+			continue;
+		}
+		/*
+		 * Limits are based on the configured scrollback rather than
+		 * what is used now, so the budget holds however much output
+		 * follows.
+		 */
+		const size_t line_size =
+			miniterm_terminal_get_line_size(terminal);
+		const long lines = (long)MIN(
+			(size_t)settings->scrollback_lines, budget / line_size);
+		miniterm_terminal_set_scrollback_limit(terminal, lines);
+		budget -= lines * line_size;
+	}
+	return G_SOURCE_REMOVE;
+}
+
+static void
+schedule_refill(MinitermApplication *app)
+{
+	MinitermApplicationPrivate *priv =
+		miniterm_application_get_instance_private(app);
+	/* Stay below input and redraws of the visible windows. */
+	if (priv->refill_source == 0)
+		priv->refill_source = g_idle_add_full(
+			G_PRIORITY_LOW, refill_cb, app, NULL);
+}
+
+static gboolean
+refill_cb(gpointer user_data)
+{
+	MinitermApplication *app = MINITERM_APPLICATION(user_data);
+	MinitermApplicationPrivate *priv =
+		miniterm_application_get_instance_private(app);
+	const int count = g_queue_get_length(priv->prewarmed);
+	const int wanted = MAX(priv->settings->prewarm, 0);
+	if (count > wanted) {
+		GtkWidget *window = g_queue_pop_tail(priv->prewarmed);
+		g_signal_handlers_disconnect_by_func(
+			window, prewarmed_destroy_cb, app);
+		gtk_widget_destroy(window);
+		return G_SOURCE_CONTINUE;
+	}
+	if (count == wanted) {
+		priv->refill_source = 0;
+		return G_SOURCE_REMOVE;
+	}
+
+	MinitermWindow *window =
+		miniterm_window_new(GTK_APPLICATION(app), false, NULL);
+	g_signal_connect(
+		window, "destroy", G_CALLBACK(prewarmed_destroy_cb), app);
+	g_queue_push_tail(priv->prewarmed, window);
+	miniterm_window_spawn(window, miniterm_window_get_terminal(window),
+		g_get_home_dir(), NULL,
+		(const char *const *)priv->prewarm_environment,
+		prewarm_spawn_cb, app);
+	return G_SOURCE_CONTINUE;
+}
+
+static void
+prewarm_spawn_cb(MinitermTerminal *terminal, GPid pid, GError *error,
+	gpointer user_data)
+{
+	(void)pid;
+	if (error == NULL)
+		return;
+	/* Don't retry, the next window taken will. */
+	g_printerr("Failed to prewarm terminal: %s\n", error->message);
+	MinitermApplicationPrivate *priv =
+		miniterm_application_get_instance_private(
+			MINITERM_APPLICATION(user_data));
+	if (priv->refill_source != 0) {
+		g_source_remove(priv->refill_source);
+		priv->refill_source = 0;
+	}
+	gtk_widget_destroy(gtk_widget_get_toplevel(GTK_WIDGET(terminal)));
+}
+
+static void
+prewarmed_destroy_cb(GtkWidget *window, gpointer user_data)
+{
+	MinitermApplicationPrivate *priv =
+		miniterm_application_get_instance_private(
+			MINITERM_APPLICATION(user_data));
+	g_queue_remove(priv->prewarmed, window);
+}
+
+static bool
+environment_equal(const char *const *a, const char *const *b)
+{
+	char **own = a == NULL || b == NULL ? g_get_environ() : NULL;
+	if (a == NULL)
+		a = (const char *const *)own;
+	if (b == NULL)
+		b = (const char *const *)own;
+	/* Every compared variable of a is in b, and b has no others. */
+	bool equal = count_compared(a) == count_compared(b);
+	for (int i = 0; equal && a[i] != NULL; ++i)
+		equal = !is_compared(a[i]) || g_strv_contains(b, a[i]);
+	g_strfreev(own);
+	return equal;
+}
+
+static bool
+is_compared(const char *variable)
+{
+	/*
+	 * Launchers and shells set these anew for every command, and the
+	 * terminal a command is run from sets its own. The shell fixes up PWD
+	 * and SHLVL itself, and the new terminal sets the rest again.
+	 */
+	static const char *const ignored[] = {"DESKTOP_STARTUP_ID=",
+		"XDG_ACTIVATION_TOKEN=", "_=", "PWD=", "OLDPWD=", "SHLVL=",
+		"WINDOWID=", "TERM=", "COLORTERM=", "VTE_VERSION="};
+	for (size_t i = 0; i < G_N_ELEMENTS(ignored); ++i)
+		if (g_str_has_prefix(variable, ignored[i]))
+			return false;
+	return true;
+}
+
+static unsigned int
+count_compared(const char *const *environment)
+{
+	unsigned int count = 0;
+	for (int i = 0; environment[i] != NULL; ++i)
+		if (is_compared(environment[i]))
+			++count;
+	return count;
+}
+
+static void
+config_changed_cb(GFileMonitor *monitor, GFile *file, GFile *other_file,
+	GFileMonitorEvent event, gpointer user_data)
+{
+	(void)monitor;
+	(void)file;
+	(void)other_file;
+	/*
+	 * Editors either rewrite the file in place or rename a new one over it,
+	 * wait for the write to finish in the first case. Some delete the file
+	 * before writing the new one, reloading then would reset every terminal
+	 * to the defaults and cut its scrollback down to theirs for good, so
+	 * the deletion is left to the creation that follows.
+	 */
+	switch (event) {
+	case G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT:
+	case G_FILE_MONITOR_EVENT_CREATED:
+		miniterm_application_reload_settings(
+			MINITERM_APPLICATION(user_data));
+		break;
+	default:
+		break;
+	}
+}
+
+static void
+terminal_destroy_cb(GtkWidget *terminal, gpointer user_data)
+{
+	MinitermApplicationPrivate *priv =
+		miniterm_application_get_instance_private(
+			MINITERM_APPLICATION(user_data));
+	g_signal_handlers_disconnect_by_data(terminal, user_data);
+	priv->terminals = g_list_remove(priv->terminals, terminal);
+	/* The freed budget goes to the terminals that were cut short. */
+	schedule_rebalance(MINITERM_APPLICATION(user_data));
+}
+
+static gboolean
+terminal_focus_cb(GtkWidget *terminal, GdkEvent *event, gpointer user_data)
+{
+	(void)event;
+	MinitermApplication *app = MINITERM_APPLICATION(user_data);
+	MinitermApplicationPrivate *priv =
+		miniterm_application_get_instance_private(app);
+	if (priv->terminals != NULL && priv->terminals->data != terminal) {
+		priv->terminals = g_list_remove(priv->terminals, terminal);
+		priv->terminals = g_list_prepend(priv->terminals, terminal);
+		schedule_rebalance(app);
+	}
+	return FALSE;
+}
+
+static void
+terminal_size_cb(
+	GtkWidget *terminal, GdkRectangle *allocation, gpointer user_data)
+{
+	(void)terminal;
+	(void)allocation;
+	MinitermApplication *app = MINITERM_APPLICATION(user_data);
+	MinitermApplicationPrivate *priv =
+		miniterm_application_get_instance_private(app);
+	if (priv->settings->scrollback_budget_mb > 0)
+		schedule_rebalance(app);
+}
+
+static void
+stats_method_cb(GDBusConnection *connection, const char *sender,
+	const char *object_path, const char *interface_name,
+	const char *method_name, GVariant *parameters,
+	GDBusMethodInvocation *invocation, gpointer user_data)
+{
+	(void)connection;
+	(void)sender;
+	(void)object_path;
+	(void)interface_name;
+	(void)method_name;
+	(void)parameters;
+	/* GetStats is the only method, GDBus rejects anything else. */
+	MinitermApplicationPrivate *priv =
+		miniterm_application_get_instance_private(
+			MINITERM_APPLICATION(user_data));
+	GVariantBuilder builder;
+	g_variant_builder_init(&builder, G_VARIANT_TYPE("aa{sv}"));
+	for (GList *l = priv->terminals; l != NULL; l = l->next) {
+		MinitermTerminal *terminal = MINITERM_TERMINAL(l->data);
+		MinitermTerminalStats stats;
+		miniterm_terminal_get_stats(terminal, &stats);
+		g_variant_builder_open(&builder, G_VARIANT_TYPE_VARDICT);
+		g_variant_builder_add(&builder, "{sv}", "id",
+			g_variant_new_uint32(stats.id));
+		g_variant_builder_add(&builder, "{sv}", "title",
+			g_variant_new_string(
+				miniterm_terminal_get_title(terminal)));
+		g_variant_builder_add(&builder, "{sv}", "pid",
+			g_variant_new_int32(stats.child_pid));
+		g_variant_builder_add(&builder, "{sv}", "bytes-read",
+			g_variant_new_uint64(stats.bytes_read));
+		g_variant_builder_add(&builder, "{sv}", "bytes-per-second",
+			g_variant_new_double(stats.bytes_per_second));
+		g_variant_builder_add(&builder, "{sv}", "frames",
+			g_variant_new_uint64(stats.frames));
+		g_variant_builder_add(&builder, "{sv}", "process-time-us",
+			g_variant_new_int64(stats.process_time));
+		g_variant_builder_add(&builder, "{sv}", "draw-time-us",
+			g_variant_new_int64(stats.draw_time));
+		g_variant_builder_add(&builder, "{sv}", "scrollback-lines",
+			g_variant_new_int64(stats.scrollback_lines));
+		g_variant_builder_add(&builder, "{sv}", "scrollback-bytes",
+			g_variant_new_uint64(stats.scrollback_size));
+		add_latency(&builder, miniterm_terminal_get_latency(terminal));
+		g_variant_builder_close(&builder);
+	}
+	g_dbus_method_invocation_return_value(
+		invocation, g_variant_new("(aa{sv})", &builder));
+}
+
+static void
+add_latency(GVariantBuilder *builder, const MinitermHistogram *latency)
+{
+	static const int percents[] = {50, 95, 99};
+	if (latency == NULL)
+		return;
+	for (int stage = 0; stage < MINITERM_LATENCY_STAGES; ++stage) {
+		const char *name = miniterm_latency_stage_name(stage);
+		for (size_t i = 0; i < G_N_ELEMENTS(percents); ++i) {
+			char *key = g_strdup_printf(
+				"latency-%s-p%d-us", name, percents[i]);
+			g_variant_builder_add(builder, "{sv}", key,
+				g_variant_new_int64(
+					miniterm_histogram_percentile(
+						&latency[stage],
+						percents[i])));
+			g_free(key);
+		}
+	}
+}
+
+static void
+warm_up(MinitermApplication *app)
+{
+	MinitermApplicationPrivate *priv =
+		miniterm_application_get_instance_private(app);
+	miniterm_trace("warm-up", 0);
+	miniterm_application_get_icon(app);
+	priv->warm_window = gtk_offscreen_window_new();
+	GdkVisual *visual = gdk_screen_get_rgba_visual(
+		gtk_widget_get_screen(priv->warm_window));
+	if (visual != NULL)
+		gtk_widget_set_visual(priv->warm_window, visual);
+	/*
+	 * Vte shares font metrics and glyph caches between terminals using the
+	 * same font, and drops them a while after the last one is gone, so
+	 * this terminal stays around.
+	 */
+	GtkWidget *vte = vte_terminal_new();
+	priv->warm_terminal = VTE_TERMINAL(vte);
+	if (priv->settings->font != NULL)
+		vte_terminal_set_font(
+			priv->warm_terminal, priv->settings->font);
+	gtk_container_add(GTK_CONTAINER(priv->warm_window), vte);
+	gtk_widget_show_all(priv->warm_window);
+	/* Printable ASCII in the regular and bold faces. */
+	GString *text = g_string_new(NULL);
+	for (int face = 0; face < 2; ++face) {
+		g_string_append(text, face == 0 ? "\033[0m" : "\033[1m");
+		for (char c = ' '; c <= '~'; ++c)
+			g_string_append_c(text, c);
+		g_string_append(text, "\r\n");
+	}
+	g_signal_connect(
+		vte, "contents-changed", G_CALLBACK(warm_contents_cb), NULL);
+	vte_terminal_feed(priv->warm_terminal, text->str, text->len);
+	g_string_free(text, TRUE);
+}
+
+static void
+warm_contents_cb(VteTerminal *vte, gpointer user_data)
+{
+	(void)user_data;
+	g_signal_handlers_disconnect_by_func(vte, warm_contents_cb, NULL);
+	/* Drawing renders the glyphs into the caches. */
+	GtkWidget *widget = GTK_WIDGET(vte);
+	const int width = MAX(gtk_widget_get_allocated_width(widget), 1);
+	const int height = MAX(gtk_widget_get_allocated_height(widget), 1);
+	cairo_surface_t *surface =
+		cairo_image_surface_create(CAIRO_FORMAT_ARGB32, width, height);
+	cairo_t *cr = cairo_create(surface);
+	gtk_widget_draw(widget, cr);
+	cairo_destroy(cr);
+	cairo_surface_destroy(surface);
+	miniterm_trace("warm", 0);
+}
@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) 2018 Jason Waataja
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef MINITERM_APPLICATION_H
+#define MINITERM_APPLICATION_H
+
+#include <gtk/gtk.h>
+#include <stdbool.h>
+
+#include "settings.h"
+#include "terminal.h"
+#include "window.h"
+
+#define MINITERM_TYPE_APPLICATION (miniterm_application_get_type())
+G_DECLARE_FINAL_TYPE(MinitermApplication, miniterm_application, MINITERM,
+	APPLICATION, GtkApplication)
+
+/*
+ * Returns the primary instance if shard is negative, otherwise the worker
+ * process with that index of a sharded primary instance.
+ */
+MinitermApplication *miniterm_application_new(int shard);
+/* Returns the index of the shard, or -1 for the primary instance. */
+int miniterm_application_get_shard(MinitermApplication *app);
+/*
+ * Keeps the instance running without any window and loads the font, the icon
+ * and the rgba visual ahead of the first window, so every window takes the
+ * fast path. Only the first call has an effect.
+ */
+void miniterm_application_start_daemon(MinitermApplication *app);
+/* Returns whether the instance keeps running without windows. */
+bool miniterm_application_is_daemon(MinitermApplication *app);
+/*
+ * Returns the window icon, or NULL if the icon theme has none. It's loaded
+ * once, the application owns it.
+ */
+GdkPixbuf *miniterm_application_get_icon(MinitermApplication *app);
+/*
+ * Forwards command_line to a shard if windows are sharded, see
+ * miniterm_dispatcher_forward() for tab and usage, which are the parsed --tab
+ * and --scrollback-usage options. Returns false if the instance has to handle
+ * it itself.
+ */
+bool miniterm_application_dispatch(MinitermApplication *app,
+	GApplicationCommandLine *command_line, bool tab, bool usage);
+/*
+ * Returns the current settings snapshot. The application owns the result, ref
+ * it to keep it past the next reload.
+ */
+MinitermSettings *miniterm_application_get_settings(MinitermApplication *app);
+/*
+ * Rereads the config file and applies the new snapshot to every terminal. This
+ * happens automatically when the config file changes.
+ */
+void miniterm_application_reload_settings(MinitermApplication *app);
+/*
+ * Applies the current settings to terminal and keeps it up to date until it is
+ * destroyed.
+ */
+void miniterm_application_add_terminal(
+	MinitermApplication *app, MinitermTerminal *terminal);
+/*
+ * Returns a newly allocated report of the scrollback each window uses and the
+ * total against the scrollback budget.
+ */
+char *miniterm_application_get_scrollback_report(MinitermApplication *app);
+/*
+ * Returns a hidden window whose shell was already started in
+ * working_directory with environment, or NULL if there is none. The
+ * environment may be NULL for miniterm's own. The caller shows the window.
+ * Taking a window refills the pool in the background, with shells started
+ * with the environment last asked for.
+ */
+MinitermWindow *miniterm_application_take_prewarmed(MinitermApplication *app,
+	const char *working_directory, const char *const *environment);
+
+#endif /* MINITERM_APPLICATION_H */
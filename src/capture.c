@@ -0,0 +1,278 @@
+/*
+ * Copyright (c) 2018 Jason Waataja
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "capture.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <glib/gstdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "log.h"
+
+#define MAGIC "miniterm-capture 1\n"
+/* Longest LEB128 encoding of a 64 bit number. */
+#define VARINT_SIZE 10
+/* Most output in one record, so a record always fits the log's buffer. */
+#define RECORD_SIZE (LOG_BUFFER_SIZE / 4)
+
+struct _MinitermCapture {
+	MinitermLog *log;
+	/* The size to record next, columns in the upper 16 bits. */
+	gint size;
+	/* The following are only used by the thread writing output. */
+	guint recorded_size;
+	gint64 last_time;
+	GByteArray *header;
+};
+
+struct _MinitermCaptureReader {
+	GMappedFile *file;
+	const guint8 *position;
+	const guint8 *end;
+	gint64 time;
+};
+
+/* Packs a size into one number so it can be updated atomically. */
+static guint pack_size(long columns, long rows);
+static void append_varint(GByteArray *array, guint64 value);
+/* Starts a record of kind at now in capture->header. */
+static void append_record(MinitermCapture *capture, char kind, gint64 now);
+static void append_resize(MinitermCapture *capture, guint size, gint64 now);
+/* Writes capture->header followed by data as one record. */
+static void write_record(
+	MinitermCapture *capture, const char *data, size_t length);
+/* Returns false if the number runs past the end. */
+static bool read_varint(MinitermCaptureReader *reader, guint64 *value);
+
+MinitermCapture *
+miniterm_capture_new(
+	const char *path, long columns, long rows, GError **error)
+{
+	const int fd =
+		g_open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+	if (fd < 0 || write(fd, MAGIC, strlen(MAGIC)) < 0) {
+		const int saved_errno = errno;
+		g_set_error(error, G_FILE_ERROR,
+			g_file_error_from_errno(saved_errno),
+			"Failed to open capture %s: %s", path,
+			g_strerror(saved_errno));
+		if (fd >= 0)
+			close(fd);
+		return NULL;
+	}
+	close(fd);
+	MinitermLog *log = miniterm_log_new(path, false, 0, error);
+	if (log == NULL)
+		return NULL;
+	MinitermCapture *capture = g_new0(MinitermCapture, 1);
+	capture->log = log;
+	capture->header = g_byte_array_new();
+	capture->last_time = g_get_monotonic_time();
+	/* No thread writes output yet. */
+	capture->size = (gint)pack_size(columns, rows);
+	append_resize(capture, capture->size, capture->last_time);
+	write_record(capture, "", 0);
+	return capture;
+}
+
+void
+miniterm_capture_resize(MinitermCapture *capture, long columns, long rows)
+{
+	g_atomic_int_set(&capture->size, (gint)pack_size(columns, rows));
+}
+
+void
+miniterm_capture_write(
+	MinitermCapture *capture, const char *data, size_t length)
+{
+	const gint64 now = g_get_monotonic_time();
+	do {
+		const size_t count = MIN(length, RECORD_SIZE);
+		g_byte_array_set_size(capture->header, 0);
+		const guint size = (guint)g_atomic_int_get(&capture->size);
+		if (size != capture->recorded_size)
+			append_resize(capture, size, now);
+		append_record(capture, 'o', now);
+		append_varint(capture->header, count);
+		write_record(capture, data, count);
+		data += count;
+		length -= count;
+	} while (length > 0);
+}
+
+void
+miniterm_capture_close(MinitermCapture *capture)
+{
+	miniterm_log_close(capture->log);
+}
+
+void
+miniterm_capture_free(MinitermCapture *capture)
+{
+	/* No more output comes that a last size change could go with. */
+	const guint size = (guint)g_atomic_int_get(&capture->size);
+	if (size != capture->recorded_size) {
+		g_byte_array_set_size(capture->header, 0);
+		append_resize(capture, size, g_get_monotonic_time());
+		write_record(capture, "", 0);
+	}
+	miniterm_log_free(capture->log);
+	g_byte_array_unref(capture->header);
+	g_free(capture);
+}
+
+MinitermCaptureReader *
+miniterm_capture_reader_new(const char *path, GError **error)
+{
+	GMappedFile *file = g_mapped_file_new(path, FALSE, error);
+	if (file == NULL)
+		return NULL;
+	const guint8 *contents =
+		(const guint8 *)g_mapped_file_get_contents(file);
+	const size_t length = g_mapped_file_get_length(file);
+	if (length < strlen(MAGIC)
+		|| memcmp(contents, MAGIC, strlen(MAGIC)) != 0) {
+		g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+			"%s is not a miniterm capture", path);
+		g_mapped_file_unref(file);
+		return NULL;
+	}
+	MinitermCaptureReader *reader = g_new0(MinitermCaptureReader, 1);
+	reader->file = file;
+	reader->position = contents + strlen(MAGIC);
+	reader->end = contents + length;
+	return reader;
+}
+
+bool
+miniterm_capture_reader_next(MinitermCaptureReader *reader,
+	MinitermCaptureRecord *record, GError **error)
+{
+	if (reader->position == reader->end)
+		return false;
+	const guint8 kind = *reader->position++;
+	guint64 delta = 0;
+	guint64 a = 0;
+	guint64 b = 0;
+	bool valid = (kind == 'o' || kind == 'r')
+		&& read_varint(reader, &delta) && read_varint(reader, &a);
+	if (valid && kind == 'o') {
+		valid = a <= (guint64)(reader->end - reader->position);
+	} else if (valid) {
+		valid = read_varint(reader, &b);
+	}
+	if (!valid) {
+		g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+			"The capture ends in a broken record");
+		reader->position = reader->end;
+		return false;
+	}
+	reader->time += delta;
+	record->time = reader->time;
+	if (kind == 'o') {
+		record->kind = MINITERM_CAPTURE_OUTPUT;
+		record->data = (const char *)reader->position;
+		record->length = a;
+		record->columns = record->rows = 0;
+		reader->position += a;
+	} else {
+		record->kind = MINITERM_CAPTURE_RESIZE;
+		record->data = NULL;
+		record->length = 0;
+		record->columns = a;
+		record->rows = b;
+	}
+	return true;
+}
+
+void
+miniterm_capture_reader_free(MinitermCaptureReader *reader)
+{
+	g_mapped_file_unref(reader->file);
+	g_free(reader);
+}
+
+static guint
+pack_size(long columns, long rows)
+{
+	return (guint)CLAMP(columns, 0, 0xffff) << 16
+		| (guint)CLAMP(rows, 0, 0xffff);
+}
+
+static void
+append_varint(GByteArray *array, guint64 value)
+{
+	guint8 bytes[VARINT_SIZE];
+	guint length = 0;
+	do {
+		bytes[length] = value & 0x7f;
+		value >>= 7;
+		if (value != 0)
+			bytes[length] |= 0x80;
+		++length;
+	} while (value != 0);
+	g_byte_array_append(array, bytes, length);
+}
+
+static void
+append_record(MinitermCapture *capture, char kind, gint64 now)
+{
+	const guint8 byte = (guint8)kind;
+	g_byte_array_append(capture->header, &byte, 1);
+	append_varint(capture->header, now - capture->last_time);
+	capture->last_time = now;
+}
+
+static void
+append_resize(MinitermCapture *capture, guint size, gint64 now)
+{
+	append_record(capture, 'r', now);
+	append_varint(capture->header, size >> 16);
+	append_varint(capture->header, size & 0xffff);
+	capture->recorded_size = size;
+}
+
+static void
+write_record(MinitermCapture *capture, const char *data, size_t length)
+{
+	miniterm_log_write_record(capture->log,
+		(const char *)capture->header->data, capture->header->len,
+		data, length);
+}
+
+static bool
+read_varint(MinitermCaptureReader *reader, guint64 *value)
+{
+	*value = 0;
+	for (unsigned int shift = 0; shift < 7 * VARINT_SIZE; shift += 7) {
+		if (reader->position == reader->end)
+			return false;
+		const guint8 byte = *reader->position++;
+		*value |= (guint64)(byte & 0x7f) << shift;
+		if ((byte & 0x80) == 0)
+			return true;
+	}
+	return false;
+}
@@ -0,0 +1,99 @@
+/*
+ * Copyright (c) 2018 Jason Waataja
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef MINITERM_CAPTURE_H
+#define MINITERM_CAPTURE_H
+
+#include <glib.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * A capture records the raw output a child writes to its pty, with the time it
+ * arrived, and the size changes of the terminal, so the output can be fed to a
+ * terminal again without the child. The file starts with the line
+ * "miniterm-capture 1", followed by records of a kind byte, 'o' for output or
+ * 'r' for a resize, and the microseconds since the previous record. Output
+ * records continue with the length of the output and the output itself, resize
+ * records with the columns and rows. Numbers are unsigned LEB128. Records are
+ * written by a MinitermLog, so a slow disk never holds up the main loop.
+ */
+typedef struct _MinitermCapture MinitermCapture;
+typedef struct _MinitermCaptureReader MinitermCaptureReader;
+
+typedef enum {
+	MINITERM_CAPTURE_OUTPUT,
+	MINITERM_CAPTURE_RESIZE,
+} MinitermCaptureKind;
+
+typedef struct {
+	MinitermCaptureKind kind;
+	/* Microseconds since the capture started. */
+	gint64 time;
+	/* Output records only, points into the reader's copy of the file. */
+	const char *data;
+	size_t length;
+	/* Resize records only. */
+	long columns;
+	long rows;
+} MinitermCaptureRecord;
+
+/*
+ * Creates or truncates path, readable only by the user, and records the
+ * initial size. Returns NULL and sets error on failure.
+ */
+MinitermCapture *miniterm_capture_new(
+	const char *path, long columns, long rows, GError **error);
+/*
+ * Notes a new size, which is recorded along with the next output. Can be
+ * called from any thread.
+ */
+void miniterm_capture_resize(MinitermCapture *capture, long columns, long rows);
+/*
+ * Records output that arrived now, waiting while the buffer is full. Must only
+ * be called by one thread at a time.
+ */
+void miniterm_capture_write(
+	MinitermCapture *capture, const char *data, size_t length);
+/*
+ * Like miniterm_log_close(). Records that don't fit the buffer from then on
+ * are dropped whole.
+ */
+void miniterm_capture_close(MinitermCapture *capture);
+/*
+ * Like miniterm_log_free(), after recording a size change no output followed.
+ * The thread writing output must have stopped.
+ */
+void miniterm_capture_free(MinitermCapture *capture);
+
+/* Opens the capture at path. Returns NULL and sets error on failure. */
+MinitermCaptureReader *miniterm_capture_reader_new(
+	const char *path, GError **error);
+/*
+ * Reads the next record. Returns false at the end of the capture, setting
+ * error if it ends in a broken record.
+ */
+bool miniterm_capture_reader_next(MinitermCaptureReader *reader,
+	MinitermCaptureRecord *record, GError **error);
+void miniterm_capture_reader_free(MinitermCaptureReader *reader);
+
+#endif /* MINITERM_CAPTURE_H */
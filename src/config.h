@@ -40,3 +40,59 @@
 
 /* Selection behavior for double-clicks */
 #define WORD_CHARS "-A-Za-z0-9:./?%&#_=+@~"
+
+/* Estimated bytes a character cell takes in scrollback, for the budget */
+#define SCROLLBACK_CELL_SIZE 16
+
+/* Milliseconds between redraws of terminals in unfocused windows */
+#define UNFOCUSED_REDRAW_INTERVAL 100
+
+/* Milliseconds after which a keystroke that wasn't echoed stops being timed */
+#define LATENCY_TIMEOUT 1000
+
+/* Largest spawn request, with arguments and environment, the helper accepts */
+#define ZYGOTE_MESSAGE_SIZE (128 * 1024)
+
+/* Most arguments and environment variables in one spawn request */
+#define ZYGOTE_MAX_STRINGS 4096
+
+/* Milliseconds the dispatcher waits for a shard to report its load */
+#define SHARD_QUERY_TIMEOUT 100
+
+/* Most bytes of output read ahead of the terminal under flood control */
+#define PROXY_BUFFER_SIZE (1024 * 1024)
+
+/* Milliseconds spent feeding output before handling input and drawing */
+#define PROXY_TIME_SLICE 10
+
+/* Priority vte reads the pty at, output is sampled just ahead of it */
+#define VTE_READ_PRIORITY G_PRIORITY_DEFAULT_IDLE
+
+/* Bytes of output a session log buffers while the disk catches up */
+#define LOG_BUFFER_SIZE (4 * 1024 * 1024)
+
+/* Milliseconds spent searching the scrollback before handling other events */
+#define SEARCH_TIME_SLICE 5
+
+/* Milliseconds a resizing terminal keeps its grid after the last size change */
+#define RESIZE_DELAY 100
+
+/* Most bytes pasted at once while the pty takes input */
+#define PASTE_CHUNK_SIZE 4096
+
+/* Milliseconds a paste runs before its progress is shown */
+#define PASTE_PROGRESS_DELAY 250
+
+/* Milliseconds spent reading the scrollback for an export at a time */
+#define EXPORT_TIME_SLICE 5
+
+/* Bytes of exported text collected before they are written */
+#define EXPORT_CHUNK_SIZE (256 * 1024)
+
+/* Bytes of hibernated scrollback fed to a waking terminal at a time */
+#define HIBERNATE_CHUNK_SIZE (64 * 1024)
+
+/* Default link patterns, see the Links group of the config file */
+#define LINK_URL "\\b(?:https?|ftp|file)://[^\\s<>\"'`]*[^\\s<>\"'`.,:;!?)\\]}]"
+#define LINK_PATH "(?:~/|/)?(?:[\\w.+-]+/)*[\\w.+-]+\\.\\w+:\\d+(?::\\d+)?"
+#define LINK_HASH "\\b(?=[0-9]*[a-f])[0-9a-f]{7,40}\\b"
@@ -0,0 +1,710 @@
+/*
+ * Copyright (c) 2018 Jason Waataja
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "export.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "config.h"
+
+/* Rows read between checks of the time slice. */
+#define CHUNK_ROWS 64
+
+/* Colors and styles of exported text, all unset for the defaults. */
+typedef struct {
+	bool has_fore;
+	bool has_back;
+	guint8 fore[3];
+	guint8 back[3];
+	bool bold;
+	bool italic;
+	bool underline;
+	bool strikethrough;
+} Style;
+
+struct _MinitermExport {
+	int ref_count;
+	VteTerminal *vte;
+	bool colors;
+	MinitermExportCallback callback;
+	gpointer user_data;
+	GCancellable *cancellable;
+	/* The output, NULL while a file is opened and for the clipboard. */
+	GOutputStream *stream;
+	/* The connection to the command's input, NULL for other outputs. */
+	GIOStream *connection;
+	GSubprocess *subprocess;
+	bool clipboard;
+	/* Rows from next_row to end_row weren't read yet. */
+	glong next_row;
+	glong end_row;
+	/* Whether empty rows at the end are kept. */
+	bool keep_empty;
+	/* The gzip level the output is compressed at, -1 for none. */
+	int compression;
+	/* Text read but not written yet. */
+	GString *chunk;
+	/* Text being written, kept until the stream is done with it. */
+	GString *pending;
+	/* Held back until more text follows, to drop empty rows at the end. */
+	unsigned int newlines;
+	/* The style of the next text, and the one last written out. */
+	Style style;
+	Style written_style;
+	/* Reads more rows. 0 indicates none. */
+	unsigned int source;
+	/* Whether the stream is busy, or being opened. */
+	bool writing;
+	/* Whether all rows were read. */
+	bool complete;
+	bool finished;
+	/* Written while the export is busy, such as the command failing. */
+	GError *error;
+};
+
+static MinitermExport *export_new(VteTerminal *vte, bool colors,
+	MinitermExportCallback callback, gpointer user_data);
+static MinitermExport *export_ref(MinitermExport *export);
+static void export_unref(MinitermExport *export);
+/* Calls the callback, once. */
+static void finish(MinitermExport *export, const GError *error);
+static gboolean fail_cb(gpointer user_data);
+static void replace_cb(
+	GObject *source, GAsyncResult *result, gpointer user_data);
+/* Continues once the stream took the previous chunk, or was opened. */
+static void resume(MinitermExport *export);
+static gboolean read_cb(gpointer user_data);
+/* Reads the next few rows into the chunk. */
+static void read_rows(MinitermExport *export);
+/* Appends the last line break and writes out the rest. */
+static void complete(MinitermExport *export);
+static void write_chunk(MinitermExport *export);
+static void write_cb(GObject *source, GAsyncResult *result, gpointer user_data);
+static void close_cb(GObject *source, GAsyncResult *result, gpointer user_data);
+static void wait_cb(GObject *source, GAsyncResult *result, gpointer user_data);
+/* Appends text in the current style, holding back line breaks. */
+static void append(MinitermExport *export, const char *text, size_t length);
+static void append_style(GString *string, const Style *style);
+static bool style_equal(const Style *a, const Style *b);
+#if VTE_CHECK_VERSION(0, 72, 0)
+/* Appends text vte formatted as HTML, turning its tags into styles. */
+static void append_html(MinitermExport *export, const char *html);
+static void parse_tag(const char *tag, size_t length, Style *style);
+/* Parses the hex color following key in tag. */
+static bool parse_color(
+	const char *tag, size_t length, const char *key, guint8 rgb[3]);
+/* Appends the character the entity at text stands for, returns its end. */
+static const char *append_entity(MinitermExport *export, const char *text);
+#else
+/* Appends text with one attribute per byte, as vte returns it. */
+static void append_attributed(
+	MinitermExport *export, const char *text, GArray *attributes);
+#endif
+
+MinitermExport *
+miniterm_export_to_file(VteTerminal *vte, GFile *file, bool colors,
+	MinitermExportCallback callback, gpointer user_data)
+{
+	MinitermExport *export = export_new(vte, colors, callback, user_data);
+	/* Rows are read while the file opens. */
+	export->writing = true;
+	g_file_replace_async(file, NULL, FALSE, G_FILE_CREATE_NONE,
+		G_PRIORITY_DEFAULT, export->cancellable, replace_cb,
+		export_ref(export));
+	return export;
+}
+
+MinitermExport *
+miniterm_export_to_command(VteTerminal *vte, const char *command,
+	const char *working_directory, bool colors,
+	MinitermExportCallback callback, gpointer user_data)
+{
+	MinitermExport *export = export_new(vte, colors, callback, user_data);
+	/*
+	 * A socket rather than a pipe, so a command that exits early fails the
+	 * write instead of raising SIGPIPE.
+	 */
+	int fds[2];
+	if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) < 0) {
+		const int saved_errno = errno;
+		g_set_error(&export->error, G_IO_ERROR,
+			g_io_error_from_errno(saved_errno),
+			"Failed to create a socket: %s",
+			g_strerror(saved_errno));
+		g_source_remove(export->source);
+		export->source = g_idle_add(fail_cb, export);
+		return export;
+	}
+	const char *const argv[] = {"/bin/sh", "-c", command, NULL};
+	GSubprocessLauncher *launcher =
+		g_subprocess_launcher_new(G_SUBPROCESS_FLAGS_NONE);
+	g_subprocess_launcher_set_cwd(launcher, working_directory);
+	g_subprocess_launcher_take_stdin_fd(launcher, fds[0]);
+	export->subprocess = g_subprocess_launcher_spawnv(
+		launcher, argv, &export->error);
+	g_object_unref(launcher);
+	GSocket *socket = NULL;
+	if (export->subprocess != NULL)
+		socket = g_socket_new_from_fd(fds[1], &export->error);
+	if (socket == NULL) {
+		close(fds[1]);
+		g_source_remove(export->source);
+		export->source = g_idle_add(fail_cb, export);
+		return export;
+	}
+	export->connection = G_IO_STREAM(
+		g_socket_connection_factory_create_connection(socket));
+	g_object_unref(socket);
+	export->stream = g_object_ref(
+		g_io_stream_get_output_stream(export->connection));
+	return export;
+}
+
+MinitermExport *
+miniterm_export_rows_to_gzip(VteTerminal *vte, glong start_row,
+	glong end_row, GFile *file, int level, MinitermExportCallback callback,
+	gpointer user_data)
+{
+	MinitermExport *export = export_new(vte, true, callback, user_data);
+	export->next_row = start_row;
+	export->end_row = end_row;
+	export->keep_empty = true;
+	export->compression = level;
+	export->writing = true;
+	g_file_replace_async(file, NULL, FALSE, G_FILE_CREATE_PRIVATE,
+		G_PRIORITY_DEFAULT, export->cancellable, replace_cb,
+		export_ref(export));
+	return export;
+}
+
+MinitermExport *
+miniterm_export_to_clipboard(VteTerminal *vte,
+	MinitermExportCallback callback, gpointer user_data)
+{
+	MinitermExport *export = export_new(vte, false, callback, user_data);
+	export->clipboard = true;
+	return export;
+}
+
+char *
+miniterm_export_rows_sync(
+	VteTerminal *vte, glong start_row, glong end_row, size_t *length)
+{
+	MinitermExport *export = export_new(vte, true, NULL, NULL);
+	g_source_remove(export->source);
+	export->source = 0;
+	export->next_row = start_row;
+	export->end_row = end_row;
+	while (export->next_row < export->end_row)
+		read_rows(export);
+	GString *text = export->chunk;
+	if (!style_equal(&export->written_style, &(Style){0}))
+		g_string_append(text, "\033[0m");
+	for (; export->newlines > 0; --export->newlines)
+		g_string_append_c(text, '\n');
+	export->chunk = g_string_new(NULL);
+	export_unref(export);
+	*length = text->len;
+	return g_string_free(text, FALSE);
+}
+
+void
+miniterm_export_free(MinitermExport *export)
+{
+	export->callback = NULL;
+	if (export->source != 0) {
+		g_source_remove(export->source);
+		export->source = 0;
+	}
+	/* Callbacks still running hold references. */
+	g_cancellable_cancel(export->cancellable);
+	export_unref(export);
+}
+
+static MinitermExport *
+export_new(VteTerminal *vte, bool colors, MinitermExportCallback callback,
+	gpointer user_data)
+{
+	MinitermExport *export = g_new0(MinitermExport, 1);
+	export->ref_count = 1;
+	export->vte = vte;
+	export->colors = colors;
+	export->callback = callback;
+	export->user_data = user_data;
+	export->cancellable = g_cancellable_new();
+	export->chunk = g_string_new(NULL);
+	export->pending = g_string_new(NULL);
+	GtkAdjustment *adjustment =
+		gtk_scrollable_get_vadjustment(GTK_SCROLLABLE(vte));
+	export->next_row = (glong)gtk_adjustment_get_lower(adjustment);
+	export->end_row = (glong)gtk_adjustment_get_upper(adjustment);
+	export->compression = -1;
+	export->source = g_idle_add_full(
+		G_PRIORITY_LOW, read_cb, export, NULL);
+	return export;
+}
+
+static MinitermExport *
+export_ref(MinitermExport *export)
+{
+	++export->ref_count;
+	return export;
+}
+
+static void
+export_unref(MinitermExport *export)
+{
+	if (--export->ref_count > 0)
+		return;
+	g_clear_object(&export->stream);
+	g_clear_object(&export->connection);
+	g_clear_object(&export->subprocess);
+	g_object_unref(export->cancellable);
+	g_string_free(export->chunk, TRUE);
+	g_string_free(export->pending, TRUE);
+	g_clear_error(&export->error);
+	g_free(export);
+}
+
+static void
+finish(MinitermExport *export, const GError *error)
+{
+	if (export->finished)
+		return;
+	export->finished = true;
+	if (export->source != 0) {
+		g_source_remove(export->source);
+		export->source = 0;
+	}
+	if (export->callback != NULL)
+		export->callback(export, error, export->user_data);
+}
+
+static gboolean
+fail_cb(gpointer user_data)
+{
+	MinitermExport *export = user_data;
+	export->source = 0;
+	finish(export, export->error);
+	return G_SOURCE_REMOVE;
+}
+
+static void
+replace_cb(GObject *source, GAsyncResult *result, gpointer user_data)
+{
+	MinitermExport *export = user_data;
+	GError *error = NULL;
+	GFileOutputStream *stream =
+		g_file_replace_finish(G_FILE(source), result, &error);
+	if (stream == NULL) {
+		if (!g_cancellable_is_cancelled(export->cancellable))
+			finish(export, error);
+		g_error_free(error);
+	} else if (!g_cancellable_is_cancelled(export->cancellable)) {
+		export->stream = G_OUTPUT_STREAM(stream);
+		/* GIO compresses in its worker thread as it writes. */
+		if (export->compression >= 0) {
+			GZlibCompressor *compressor = g_zlib_compressor_new(
+				G_ZLIB_COMPRESSOR_FORMAT_GZIP,
+				export->compression);
+			export->stream = g_converter_output_stream_new(
+				G_OUTPUT_STREAM(stream),
+				G_CONVERTER(compressor));
+			g_object_unref(compressor);
+			g_object_unref(stream);
+		}
+		resume(export);
+	} else {
+		g_object_unref(stream);
+	}
+	export_unref(export);
+}
+
+static void
+resume(MinitermExport *export)
+{
+	export->writing = false;
+	if (export->next_row >= export->end_row)
+		complete(export);
+	else if (export->source == 0)
+		export->source = g_idle_add_full(
+			G_PRIORITY_LOW, read_cb, export, NULL);
+}
+
+static gboolean
+read_cb(gpointer user_data)
+{
+	MinitermExport *export = user_data;
+	const gint64 deadline =
+		g_get_monotonic_time() + EXPORT_TIME_SLICE * 1000;
+	while (export->next_row < export->end_row) {
+		if (!export->clipboard
+			&& export->chunk->len >= EXPORT_CHUNK_SIZE) {
+			/* Wait for the stream to take the previous chunk. */
+			if (export->writing) {
+				export->source = 0;
+				return G_SOURCE_REMOVE;
+			}
+			write_chunk(export);
+		}
+		read_rows(export);
+		if (g_get_monotonic_time() >= deadline)
+			return G_SOURCE_CONTINUE;
+	}
+	export->source = 0;
+	if (!export->writing)
+		complete(export);
+	return G_SOURCE_REMOVE;
+}
+
+static void
+read_rows(MinitermExport *export)
+{
+	GtkAdjustment *adjustment =
+		gtk_scrollable_get_vadjustment(GTK_SCROLLABLE(export->vte));
+	const glong first = (glong)gtk_adjustment_get_lower(adjustment);
+	export->next_row = MAX(export->next_row, first);
+	if (export->next_row >= export->end_row)
+		return;
+	const glong last = MIN(export->next_row + CHUNK_ROWS, export->end_row)
+		- 1;
+	const glong columns = vte_terminal_get_column_count(export->vte);
+#if VTE_CHECK_VERSION(0, 72, 0)
+	char *text = vte_terminal_get_text_range_format(export->vte,
+		export->colors ? VTE_FORMAT_HTML : VTE_FORMAT_TEXT,
+		export->next_row, 0, last, columns, NULL);
+	if (text != NULL && export->colors)
+		append_html(export, text);
+	else if (text != NULL)
+		append(export, text, strlen(text));
+#else
+	GArray *attributes = export->colors
+		? g_array_new(FALSE, FALSE, sizeof(VteCharAttributes))
+		: NULL;
+	char *text = vte_terminal_get_text_range(export->vte,
+		export->next_row, 0, last, columns - 1, NULL, NULL, attributes);
+	if (text != NULL && attributes != NULL)
+		append_attributed(export, text, attributes);
+	else if (text != NULL)
+		append(export, text, strlen(text));
+	if (attributes != NULL)
+		g_array_free(attributes, TRUE);
+#endif
+	g_free(text);
+	export->next_row = last + 1;
+}
+
+static void
+complete(MinitermExport *export)
+{
+	if (!export->complete) {
+		export->complete = true;
+		if (export->colors
+			&& !style_equal(&export->written_style, &(Style){0}))
+			g_string_append(export->chunk, "\033[0m");
+		if (export->newlines > 0 && !export->keep_empty)
+			export->newlines = 1;
+		for (; export->newlines > 0; --export->newlines)
+			g_string_append_c(export->chunk, '\n');
+	}
+	if (export->clipboard) {
+		GtkClipboard *clipboard = gtk_widget_get_clipboard(
+			GTK_WIDGET(export->vte), GDK_SELECTION_CLIPBOARD);
+		gtk_clipboard_set_text(
+			clipboard, export->chunk->str, export->chunk->len);
+		finish(export, NULL);
+	} else if (export->chunk->len > 0) {
+		write_chunk(export);
+	} else if (export->connection != NULL) {
+		/* Closing the connection is what ends the command's input. */
+		export->writing = true;
+		g_io_stream_close_async(export->connection, G_PRIORITY_DEFAULT,
+			export->cancellable, close_cb, export_ref(export));
+	} else {
+		export->writing = true;
+		g_output_stream_close_async(export->stream, G_PRIORITY_DEFAULT,
+			export->cancellable, close_cb, export_ref(export));
+	}
+}
+
+static void
+write_chunk(MinitermExport *export)
+{
+	GString *written = export->pending;
+	export->pending = export->chunk;
+	export->chunk = written;
+	g_string_truncate(export->chunk, 0);
+	export->writing = true;
+	g_output_stream_write_all_async(export->stream, export->pending->str,
+		export->pending->len, G_PRIORITY_DEFAULT, export->cancellable,
+		write_cb, export_ref(export));
+}
+
+static void
+write_cb(GObject *source, GAsyncResult *result, gpointer user_data)
+{
+	MinitermExport *export = user_data;
+	GError *error = NULL;
+	const bool written = g_output_stream_write_all_finish(
+		G_OUTPUT_STREAM(source), result, NULL, &error);
+	if (!g_cancellable_is_cancelled(export->cancellable)) {
+		if (written)
+			resume(export);
+		else
+			finish(export, error);
+	}
+	g_clear_error(&error);
+	export_unref(export);
+}
+
+static void
+close_cb(GObject *source, GAsyncResult *result, gpointer user_data)
+{
+	MinitermExport *export = user_data;
+	GError *error = NULL;
+	const bool closed = G_IS_IO_STREAM(source)
+		? g_io_stream_close_finish(G_IO_STREAM(source), result, &error)
+		: g_output_stream_close_finish(
+			G_OUTPUT_STREAM(source), result, &error);
+	if (g_cancellable_is_cancelled(export->cancellable)) {
+		/* Freed meanwhile. */
+	} else if (!closed) {
+		finish(export, error);
+	} else if (export->subprocess != NULL) {
+		g_subprocess_wait_check_async(export->subprocess,
+			export->cancellable, wait_cb, export_ref(export));
+	} else {
+		finish(export, NULL);
+	}
+	g_clear_error(&error);
+	export_unref(export);
+}
+
+static void
+wait_cb(GObject *source, GAsyncResult *result, gpointer user_data)
+{
+	MinitermExport *export = user_data;
+	GError *error = NULL;
+	const bool success = g_subprocess_wait_check_finish(
+		G_SUBPROCESS(source), result, &error);
+	if (!g_cancellable_is_cancelled(export->cancellable))
+		finish(export, success ? NULL : error);
+	g_clear_error(&error);
+	export_unref(export);
+}
+
+static void
+append(MinitermExport *export, const char *text, size_t length)
+{
+	GString *chunk = export->chunk;
+	for (size_t i = 0; i < length; ++i) {
+		if (text[i] == '\n') {
+			++export->newlines;
+			continue;
+		}
+		for (; export->newlines > 0; --export->newlines)
+			g_string_append_c(chunk, '\n');
+		const Style *style = &export->style;
+		if (export->colors
+			&& !style_equal(style, &export->written_style)) {
+			append_style(chunk, style);
+			export->written_style = *style;
+		}
+		g_string_append_c(chunk, text[i]);
+	}
+}
+
+static void
+append_style(GString *string, const Style *style)
+{
+	g_string_append(string, "\033[0");
+	if (style->bold)
+		g_string_append(string, ";1");
+	if (style->italic)
+		g_string_append(string, ";3");
+	if (style->underline)
+		g_string_append(string, ";4");
+	if (style->strikethrough)
+		g_string_append(string, ";9");
+	if (style->has_fore)
+		g_string_append_printf(string, ";38;2;%u;%u;%u",
+			style->fore[0], style->fore[1], style->fore[2]);
+	if (style->has_back)
+		g_string_append_printf(string, ";48;2;%u;%u;%u",
+			style->back[0], style->back[1], style->back[2]);
+	g_string_append_c(string, 'm');
+}
+
+static bool
+style_equal(const Style *a, const Style *b)
+{
+	return a->has_fore == b->has_fore && a->has_back == b->has_back
+		&& (!a->has_fore || memcmp(a->fore, b->fore, 3) == 0)
+		&& (!a->has_back || memcmp(a->back, b->back, 3) == 0)
+		&& a->bold == b->bold && a->italic == b->italic
+		&& a->underline == b->underline
+		&& a->strikethrough == b->strikethrough;
+}
+
+#if VTE_CHECK_VERSION(0, 72, 0)
+static void
+append_html(MinitermExport *export, const char *html)
+{
+	/* The styles of the open tags, the outermost first. */
+	GArray *styles = g_array_new(FALSE, TRUE, sizeof(Style));
+	g_array_set_size(styles, 1);
+	const char *p = html;
+	while (*p != '\0') {
+		if (*p == '&') {
+			p = append_entity(export, p);
+			continue;
+		}
+		if (*p != '<') {
+			append(export, p++, 1);
+			continue;
+		}
+		const char *end = strchr(p, '>');
+		if (end == NULL)
+			break;
+		if (p[1] == '/') {
+			if (styles->len > 1)
+				g_array_set_size(styles, styles->len - 1);
+		} else if (end[-1] != '/') {
+			Style style =
+				g_array_index(styles, Style, styles->len - 1);
+			parse_tag(p + 1, end - p - 1, &style);
+			g_array_append_val(styles, style);
+		}
+		export->style = g_array_index(styles, Style, styles->len - 1);
+		p = end + 1;
+	}
+	g_array_free(styles, TRUE);
+}
+
+static void
+parse_tag(const char *tag, size_t length, Style *style)
+{
+	size_t name_length = 0;
+	while (name_length < length && !g_ascii_isspace(tag[name_length]))
+		++name_length;
+	char *name = g_ascii_strdown(tag, name_length);
+	if (strcmp(name, "b") == 0)
+		style->bold = true;
+	else if (strcmp(name, "i") == 0)
+		style->italic = true;
+	else if (strcmp(name, "u") == 0)
+		style->underline = true;
+	else if (strcmp(name, "s") == 0 || strcmp(name, "strike") == 0)
+		style->strikethrough = true;
+	g_free(name);
+	/* Keys preceded by a quote or separator, so not background-color. */
+	if (parse_color(tag, length, "color=\"#", style->fore)
+		|| parse_color(tag, length, "\"color:#", style->fore)
+		|| parse_color(tag, length, ";color:#", style->fore)
+		|| parse_color(tag, length, " color:#", style->fore))
+		style->has_fore = true;
+	if (parse_color(tag, length, "background-color:#", style->back))
+		style->has_back = true;
+}
+
+static bool
+parse_color(const char *tag, size_t length, const char *key, guint8 rgb[3])
+{
+	const char *found = g_strstr_len(tag, length, key);
+	if (found == NULL)
+		return false;
+	const char *hex = found + strlen(key);
+	if (hex + 6 > tag + length)
+		return false;
+	for (int i = 0; i < 3; ++i) {
+		const int high = g_ascii_xdigit_value(hex[2 * i]);
+		const int low = g_ascii_xdigit_value(hex[2 * i + 1]);
+		if (high < 0 || low < 0)
+			return false;
+		rgb[i] = high << 4 | low;
+	}
+	return true;
+}
+
+static const char *
+append_entity(MinitermExport *export, const char *text)
+{
+	static const struct {
+		const char *name;
+		char c;
+	} entities[] = {
+		{"&lt;", '<'},
+		{"&gt;", '>'},
+		{"&amp;", '&'},
+		{"&quot;", '"'},
+		{"&apos;", '\''},
+	};
+	for (size_t i = 0; i < G_N_ELEMENTS(entities); ++i) {
+		const size_t length = strlen(entities[i].name);
+		if (strncmp(text, entities[i].name, length) == 0) {
+			append(export, &entities[i].c, 1);
+			return text + length;
+		}
+	}
+	if (text[1] == '#') {
+		char *end = NULL;
+		const bool hex = text[2] == 'x' || text[2] == 'X';
+		const guint64 c = g_ascii_strtoull(
+			text + (hex ? 3 : 2), &end, hex ? 16 : 10);
+		if (*end == ';' && g_unichar_validate(c)) {
+			char utf8[6];
+			append(export, utf8, g_unichar_to_utf8(c, utf8));
+			return end + 1;
+		}
+	}
+	append(export, text, 1);
+	return text + 1;
+}
+#else
+static void
+append_attributed(
+	MinitermExport *export, const char *text, GArray *attributes)
+{
+	for (size_t i = 0; text[i] != '\0'; ++i) {
+		/* Characters start a new style, their other bytes don't. */
+		if ((text[i] & 0xc0) != 0x80 && i < attributes->len) {
+			const VteCharAttributes *attribute = &g_array_index(
+				attributes, VteCharAttributes, i);
+			Style style = {0};
+			style.has_fore = style.has_back = true;
+			style.fore[0] = attribute->fore.red >> 8;
+			style.fore[1] = attribute->fore.green >> 8;
+			style.fore[2] = attribute->fore.blue >> 8;
+			style.back[0] = attribute->back.red >> 8;
+			style.back[1] = attribute->back.green >> 8;
+			style.back[2] = attribute->back.blue >> 8;
+			style.underline = attribute->underline;
+			style.strikethrough = attribute->strikethrough;
+			export->style = style;
+		}
+		append(export, text + i, 1);
+	}
+}
+#endif
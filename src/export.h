@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) 2018 Jason Waataja
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef MINITERM_EXPORT_H
+#define MINITERM_EXPORT_H
+
+#include <gio/gio.h>
+#include <stdbool.h>
+#include <vte/vte.h>
+
+/*
+ * Exports the scrollback and screen of a terminal, as they were when the
+ * export started, to a file, the input of a command or the clipboard. The text
+ * is read a few rows at a time while the main loop is idle and written by GIO
+ * while the next rows are read, so even a long scrollback never blocks the
+ * main loop. Rows that leave the scrollback before they are read are missing.
+ * With colors, the text keeps its colors and styles as SGR escape sequences.
+ */
+typedef struct _MinitermExport MinitermExport;
+
+/*
+ * Called once the export is done. The error is NULL on success. The export
+ * still has to be freed, which may be done here.
+ */
+typedef void (*MinitermExportCallback)(
+	MinitermExport *export, const GError *error, gpointer user_data);
+
+/* Starts writing to file, replacing its contents. */
+MinitermExport *miniterm_export_to_file(VteTerminal *vte, GFile *file,
+	bool colors, MinitermExportCallback callback, gpointer user_data);
+/*
+ * Starts writing to the input of command, run by /bin/sh in
+ * working_directory, which may be NULL. The export succeeds if the command
+ * exits successfully.
+ */
+MinitermExport *miniterm_export_to_command(VteTerminal *vte,
+	const char *command, const char *working_directory, bool colors,
+	MinitermExportCallback callback, gpointer user_data);
+/* Starts collecting the text, which is put on the clipboard at the end. */
+MinitermExport *miniterm_export_to_clipboard(VteTerminal *vte,
+	MinitermExportCallback callback, gpointer user_data);
+/*
+ * Starts writing rows start_row up to end_row, with their colors and styles,
+ * to file, compressed with gzip at level and readable only by the user. Like
+ * miniterm_export_rows_sync(), empty rows at the end are kept.
+ */
+MinitermExport *miniterm_export_rows_to_gzip(VteTerminal *vte,
+	glong start_row, glong end_row, GFile *file, int level,
+	MinitermExportCallback callback, gpointer user_data);
+/*
+ * Reads rows start_row up to end_row at once, with their colors and styles,
+ * for when the text must match the terminal as it is now. Unlike the exports
+ * above, empty rows at the end are kept. Returns the text, which is length
+ * bytes long, free it with g_free().
+ */
+char *miniterm_export_rows_sync(VteTerminal *vte, glong start_row,
+	glong end_row, size_t *length);
+/* Frees export, stopping it if it is still running. */
+void miniterm_export_free(MinitermExport *export);
+
+#endif /* MINITERM_EXPORT_H */
@@ -0,0 +1,420 @@
+/*
+ * Copyright (c) 2018 Jason Waataja
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "hibernate.h"
+
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+
+#include "config.h"
+#include "export.h"
+
+/* Favor speed, the file is read back once and then deleted. */
+#define COMPRESSION_LEVEL 1
+
+struct _MinitermHibernate {
+	int ref_count;
+	VteTerminal *vte;
+	char *path;
+	MinitermHibernateCallback callback;
+	gpointer user_data;
+	GCancellable *cancellable;
+	/* Writes the scrollback while saving, NULL when restoring. */
+	MinitermExport *export;
+	/* The decompressed file, NULL until it is opened. */
+	GInputStream *stream;
+	/* The screen as it was when the restore started. */
+	char *screen;
+	size_t screen_length;
+	bool finished;
+};
+
+static MinitermHibernate *hibernate_new(VteTerminal *vte, const char *path,
+	MinitermHibernateCallback callback, gpointer user_data);
+static MinitermHibernate *hibernate_ref(MinitermHibernate *hibernate);
+static void hibernate_unref(MinitermHibernate *hibernate);
+/* Calls the callback, once. */
+static void finish(MinitermHibernate *hibernate, const GError *error);
+static void saved_cb(
+	MinitermExport *export, const GError *error, gpointer user_data);
+static void open_cb(GObject *source, GAsyncResult *result, gpointer user_data);
+/* Reads the next chunk of the scrollback. */
+static void read_chunk(MinitermHibernate *hibernate);
+static void read_cb(GObject *source, GAsyncResult *result, gpointer user_data);
+/* Reprints the screen below the scrollback and restores the cursor. */
+static void end_restore(MinitermHibernate *hibernate);
+/*
+ * Returns a stream holding the decompressed contents saved at path, or NULL
+ * and sets error.
+ */
+static GMemoryOutputStream *read_contents(const char *path, GError **error);
+/* Appends text with its line breaks turned into CR LF. */
+static void append_lines(GString *feed, const char *text, size_t length);
+/*
+ * Returns the rows of the screen of vte with their colors. Sets length to the
+ * length of the text.
+ */
+static char *read_screen(VteTerminal *vte, size_t *length);
+/*
+ * Writes text followed by more to path, compressed. Returns false and sets
+ * error on failure.
+ */
+static bool write_contents(const char *path, const char *text, size_t length,
+	const char *more, size_t more_length, GError **error);
+
+MinitermHibernate *
+miniterm_hibernate_save(VteTerminal *vte, const char *path,
+	MinitermHibernateCallback callback, gpointer user_data)
+{
+	MinitermHibernate *hibernate =
+		hibernate_new(vte, path, callback, user_data);
+	/* The adjustment spans the history followed by the screen. */
+	GtkAdjustment *adjustment =
+		gtk_scrollable_get_vadjustment(GTK_SCROLLABLE(vte));
+	const glong upper = (glong)gtk_adjustment_get_upper(adjustment);
+	GFile *file = g_file_new_for_path(path);
+	hibernate->export = miniterm_export_rows_to_gzip(vte,
+		(glong)gtk_adjustment_get_lower(adjustment),
+		upper - vte_terminal_get_row_count(vte), file,
+		COMPRESSION_LEVEL, saved_cb, hibernate);
+	g_object_unref(file);
+	return hibernate;
+}
+
+MinitermHibernate *
+miniterm_hibernate_restore(VteTerminal *vte, const char *path,
+	MinitermHibernateCallback callback, gpointer user_data)
+{
+	MinitermHibernate *hibernate =
+		hibernate_new(vte, path, callback, user_data);
+	/* Only the screen is read at once, it is what gets cleared first. */
+	hibernate->screen = read_screen(vte, &hibernate->screen_length);
+	GFile *file = g_file_new_for_path(path);
+	g_file_read_async(file, G_PRIORITY_DEFAULT, hibernate->cancellable,
+		open_cb, hibernate_ref(hibernate));
+	g_object_unref(file);
+	return hibernate;
+}
+
+void
+miniterm_hibernate_free(MinitermHibernate *hibernate)
+{
+	hibernate->callback = NULL;
+	if (hibernate->export != NULL) {
+		miniterm_export_free(hibernate->export);
+		hibernate->export = NULL;
+		/* A partial save is no use. */
+		if (!hibernate->finished)
+			g_unlink(hibernate->path);
+	}
+	/* Callbacks still running hold references. */
+	g_cancellable_cancel(hibernate->cancellable);
+	hibernate_unref(hibernate);
+}
+
+bool
+miniterm_hibernate_save_restoring(
+	MinitermHibernate *restore, const char *path, GError **error)
+{
+	GMemoryOutputStream *contents = read_contents(restore->path, error);
+	if (contents == NULL)
+		return false;
+	const bool success = write_contents(path,
+		g_memory_output_stream_get_data(contents),
+		g_memory_output_stream_get_data_size(contents),
+		restore->screen, restore->screen_length, error);
+	g_object_unref(contents);
+	return success;
+}
+
+bool
+miniterm_hibernate_save_all(VteTerminal *vte, const char *hibernated,
+	const char *path, GError **error)
+{
+	size_t length;
+	if (hibernated == NULL) {
+		GtkAdjustment *adjustment =
+			gtk_scrollable_get_vadjustment(GTK_SCROLLABLE(vte));
+		char *text = miniterm_export_rows_sync(vte,
+			(glong)gtk_adjustment_get_lower(adjustment),
+			(glong)gtk_adjustment_get_upper(adjustment), &length);
+		const bool success =
+			write_contents(path, text, length, NULL, 0, error);
+		g_free(text);
+		return success;
+	}
+	GMemoryOutputStream *contents = read_contents(hibernated, error);
+	if (contents == NULL)
+		return false;
+	char *screen = read_screen(vte, &length);
+	const bool success = write_contents(path,
+		g_memory_output_stream_get_data(contents),
+		g_memory_output_stream_get_data_size(contents), screen, length,
+		error);
+	g_free(screen);
+	g_object_unref(contents);
+	return success;
+}
+
+bool
+miniterm_hibernate_replay(VteTerminal *vte, const char *path, GError **error)
+{
+	GMemoryOutputStream *contents = read_contents(path, error);
+	if (contents == NULL)
+		return false;
+	const char *text = g_memory_output_stream_get_data(contents);
+	gsize length = g_memory_output_stream_get_data_size(contents);
+	/* Drop the empty rows below the last line of the screen. */
+	while (length > 0 && text[length - 1] == '\n')
+		--length;
+
+	/* The saved lines end in bare line feeds. */
+	GString *feed = g_string_sized_new(length + length / 16 + 16);
+	g_string_append(feed, "\033[0m");
+	for (gsize i = 0; i < length; ++i) {
+		if (text[i] == '\n')
+			g_string_append_c(feed, '\r');
+		g_string_append_c(feed, text[i]);
+	}
+	if (length > 0)
+		g_string_append(feed, "\r\n");
+	vte_terminal_feed(vte, feed->str, feed->len);
+	g_string_free(feed, TRUE);
+	g_object_unref(contents);
+	return true;
+}
+
+static MinitermHibernate *
+hibernate_new(VteTerminal *vte, const char *path,
+	MinitermHibernateCallback callback, gpointer user_data)
+{
+	MinitermHibernate *hibernate = g_new0(MinitermHibernate, 1);
+	hibernate->ref_count = 1;
+	hibernate->vte = vte;
+	hibernate->path = g_strdup(path);
+	hibernate->callback = callback;
+	hibernate->user_data = user_data;
+	hibernate->cancellable = g_cancellable_new();
+	return hibernate;
+}
+
+static MinitermHibernate *
+hibernate_ref(MinitermHibernate *hibernate)
+{
+	++hibernate->ref_count;
+	return hibernate;
+}
+
+static void
+hibernate_unref(MinitermHibernate *hibernate)
+{
+	if (--hibernate->ref_count > 0)
+		return;
+	g_clear_object(&hibernate->stream);
+	g_object_unref(hibernate->cancellable);
+	g_free(hibernate->screen);
+	g_free(hibernate->path);
+	g_free(hibernate);
+}
+
+static void
+finish(MinitermHibernate *hibernate, const GError *error)
+{
+	if (hibernate->finished)
+		return;
+	hibernate->finished = true;
+	if (hibernate->callback != NULL)
+		hibernate->callback(hibernate, error, hibernate->user_data);
+}
+
+static void
+saved_cb(MinitermExport *export, const GError *error, gpointer user_data)
+{
+	(void)export;
+	MinitermHibernate *hibernate = user_data;
+	if (error != NULL)
+		g_unlink(hibernate->path);
+	finish(hibernate, error);
+}
+
+static void
+open_cb(GObject *source, GAsyncResult *result, gpointer user_data)
+{
+	MinitermHibernate *hibernate = user_data;
+	GError *error = NULL;
+	GFileInputStream *file_stream =
+		g_file_read_finish(G_FILE(source), result, &error);
+	if (g_cancellable_is_cancelled(hibernate->cancellable)) {
+		/* Freed meanwhile. */
+		g_clear_object(&file_stream);
+	} else if (file_stream == NULL) {
+		finish(hibernate, error);
+	} else {
+		GZlibDecompressor *decompressor = g_zlib_decompressor_new(
+			G_ZLIB_COMPRESSOR_FORMAT_GZIP);
+		hibernate->stream = g_converter_input_stream_new(
+			G_INPUT_STREAM(file_stream),
+			G_CONVERTER(decompressor));
+		g_object_unref(decompressor);
+		g_object_unref(file_stream);
+		/*
+		 * Save the cursor and its attributes, clear the screen and
+		 * print the scrollback and then the screen from the top. The
+		 * scrollback scrolls off into the history and the screen ends
+		 * up where it was, so the cursor is restored to the right
+		 * place.
+		 */
+		vte_terminal_feed(
+			hibernate->vte, "\0337\033[0m\033[H\033[J", -1);
+		read_chunk(hibernate);
+	}
+	g_clear_error(&error);
+	hibernate_unref(hibernate);
+}
+
+static void
+read_chunk(MinitermHibernate *hibernate)
+{
+	g_input_stream_read_bytes_async(hibernate->stream,
+		HIBERNATE_CHUNK_SIZE, G_PRIORITY_DEFAULT,
+		hibernate->cancellable, read_cb, hibernate_ref(hibernate));
+}
+
+static void
+read_cb(GObject *source, GAsyncResult *result, gpointer user_data)
+{
+	MinitermHibernate *hibernate = user_data;
+	GError *error = NULL;
+	GBytes *bytes = g_input_stream_read_bytes_finish(
+		G_INPUT_STREAM(source), result, &error);
+	if (g_cancellable_is_cancelled(hibernate->cancellable)) {
+		/* Freed meanwhile. */
+	} else if (bytes == NULL || g_bytes_get_size(bytes) == 0) {
+		/* Even a broken file leaves the screen as it was. */
+		end_restore(hibernate);
+		finish(hibernate, error);
+	} else {
+		/* Vte processes what it is fed in slices of its own. */
+		gsize length;
+		const char *text = g_bytes_get_data(bytes, &length);
+		GString *feed = g_string_sized_new(length + length / 16);
+		append_lines(feed, text, length);
+		vte_terminal_feed(hibernate->vte, feed->str, feed->len);
+		g_string_free(feed, TRUE);
+		read_chunk(hibernate);
+	}
+	if (bytes != NULL)
+		g_bytes_unref(bytes);
+	g_clear_error(&error);
+	hibernate_unref(hibernate);
+}
+
+static void
+end_restore(MinitermHibernate *hibernate)
+{
+	size_t length = hibernate->screen_length;
+	/* Another line break would scroll the screen by one row. */
+	if (length > 0 && hibernate->screen[length - 1] == '\n')
+		--length;
+	GString *feed = g_string_sized_new(length + length / 16 + 2);
+	append_lines(feed, hibernate->screen, length);
+	g_string_append(feed, "\0338");
+	vte_terminal_feed(hibernate->vte, feed->str, feed->len);
+	g_string_free(feed, TRUE);
+}
+
+static GMemoryOutputStream *
+read_contents(const char *path, GError **error)
+{
+	GFile *file = g_file_new_for_path(path);
+	GFileInputStream *file_stream = g_file_read(file, NULL, error);
+	g_object_unref(file);
+	if (file_stream == NULL)
+		return NULL;
+	GZlibDecompressor *decompressor =
+		g_zlib_decompressor_new(G_ZLIB_COMPRESSOR_FORMAT_GZIP);
+	GInputStream *stream = g_converter_input_stream_new(
+		G_INPUT_STREAM(file_stream), G_CONVERTER(decompressor));
+	g_object_unref(decompressor);
+	g_object_unref(file_stream);
+
+	GOutputStream *contents = g_memory_output_stream_new_resizable();
+	const gssize size = g_output_stream_splice(contents, stream,
+		G_OUTPUT_STREAM_SPLICE_CLOSE_SOURCE
+			| G_OUTPUT_STREAM_SPLICE_CLOSE_TARGET,
+		NULL, error);
+	g_object_unref(stream);
+	if (size < 0) {
+		g_object_unref(contents);
+		return NULL;
+	}
+	return G_MEMORY_OUTPUT_STREAM(contents);
+}
+
+static void
+append_lines(GString *feed, const char *text, size_t length)
+{
+	for (size_t i = 0; i < length; ++i) {
+		if (text[i] == '\n')
+			g_string_append_c(feed, '\r');
+		g_string_append_c(feed, text[i]);
+	}
+}
+
+static char *
+read_screen(VteTerminal *vte, size_t *length)
+{
+	GtkAdjustment *adjustment =
+		gtk_scrollable_get_vadjustment(GTK_SCROLLABLE(vte));
+	const glong upper = (glong)gtk_adjustment_get_upper(adjustment);
+	return miniterm_export_rows_sync(
+		vte, upper - vte_terminal_get_row_count(vte), upper, length);
+}
+
+static bool
+write_contents(const char *path, const char *text, size_t length,
+	const char *more, size_t more_length, GError **error)
+{
+	GFile *file = g_file_new_for_path(path);
+	GFileOutputStream *file_stream = g_file_replace(
+		file, NULL, FALSE, G_FILE_CREATE_PRIVATE, NULL, error);
+	g_object_unref(file);
+	if (file_stream == NULL)
+		return false;
+	GZlibCompressor *compressor = g_zlib_compressor_new(
+		G_ZLIB_COMPRESSOR_FORMAT_GZIP, COMPRESSION_LEVEL);
+	GOutputStream *stream = g_converter_output_stream_new(
+		G_OUTPUT_STREAM(file_stream), G_CONVERTER(compressor));
+	g_object_unref(compressor);
+	g_object_unref(file_stream);
+
+	bool success = g_output_stream_write_all(
+		stream, text, length, NULL, NULL, error);
+	success = success
+		&& g_output_stream_write_all(
+			stream, more, more_length, NULL, NULL, error);
+	success = success && g_output_stream_close(stream, NULL, error);
+	g_object_unref(stream);
+	if (!success)
+		g_unlink(path);
+	return success;
+}
@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) 2018 Jason Waataja
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef MINITERM_HIBERNATE_H
+#define MINITERM_HIBERNATE_H
+
+#include <glib.h>
+#include <stdbool.h>
+#include <vte/vte.h>
+
+/*
+ * Hibernation stores the scrollback of an idle terminal in a compressed file
+ * so it can be dropped from memory. The text keeps its colors and styles as
+ * SGR escape sequences. The screen stays with vte, so the child can go on
+ * using it and the terminal can be resized meanwhile. Saving and restoring run
+ * while the main loop is idle, a few rows or a chunk of text at a time, and
+ * GIO compresses, writes, reads and decompresses the file in its own thread.
+ */
+typedef struct _MinitermHibernate MinitermHibernate;
+
+/*
+ * Called once a save or restore is done. The error is NULL on success. The
+ * hibernate still has to be freed, which may be done here.
+ */
+typedef void (*MinitermHibernateCallback)(MinitermHibernate *hibernate,
+	const GError *error, gpointer user_data);
+
+/*
+ * Starts writing the scrollback of vte to path, which is created readable only
+ * by the user and removed again if the save fails or is stopped. Rows that
+ * leave the scrollback before they are saved are missing, so the save should
+ * be stopped once output arrives.
+ */
+MinitermHibernate *miniterm_hibernate_save(VteTerminal *vte, const char *path,
+	MinitermHibernateCallback callback, gpointer user_data);
+/*
+ * Starts feeding the scrollback saved at path back into vte, reprinting the
+ * screen as it is now below it. Once done, the screen and cursor are as they
+ * were. Until then nothing else may be fed to vte and its size must be kept.
+ */
+MinitermHibernate *miniterm_hibernate_restore(VteTerminal *vte,
+	const char *path, MinitermHibernateCallback callback,
+	gpointer user_data);
+/* Frees hibernate, stopping it without calling the callback. */
+void miniterm_hibernate_free(MinitermHibernate *hibernate);
+/*
+ * Writes the scrollback and screen of vte to path, for
+ * miniterm_hibernate_replay(). If vte is hibernated, hibernated is the file
+ * holding its scrollback, otherwise NULL. Returns false and sets error on
+ * failure.
+ */
+bool miniterm_hibernate_save_all(VteTerminal *vte, const char *hibernated,
+	const char *path, GError **error);
+/*
+ * Like miniterm_hibernate_save_all(), for a terminal restore is still feeding
+ * its scrollback back into.
+ */
+bool miniterm_hibernate_save_restoring(
+	MinitermHibernate *restore, const char *path, GError **error);
+/*
+ * Feeds the contents saved at path into vte at the cursor, as if they were
+ * printed there, for a terminal that has no child yet. Returns false and sets
+ * error on failure.
+ */
+bool miniterm_hibernate_replay(VteTerminal *vte, const char *path,
+	GError **error);
+
+#endif /* MINITERM_HIBERNATE_H */
@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) 2018 Jason Waataja
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "latency.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+#define BUCKETS_PER_OCTAVE 4
+
+static const char *stage_names[MINITERM_LATENCY_STAGES] = {
+	"input",
+	"commit",
+	"echo",
+	"render",
+	"total",
+};
+
+bool
+miniterm_latency_env_enabled(void)
+{
+	const char *value = getenv("MINITERM_LATENCY");
+	return value != NULL && *value != '\0';
+}
+
+const char *
+miniterm_latency_stage_name(MinitermLatencyStage stage)
+{
+	return stage_names[stage];
+}
+
+void
+miniterm_histogram_add(MinitermHistogram *histogram, gint64 usec)
+{
+	int bucket = 0;
+	if (usec > 0)
+		bucket = 1 + (int)(log2((double)usec) * BUCKETS_PER_OCTAVE);
+	bucket = MIN(bucket, MINITERM_HISTOGRAM_BUCKETS - 1);
+	++histogram->buckets[bucket];
+	++histogram->count;
+}
+
+gint64
+miniterm_histogram_percentile(
+	const MinitermHistogram *histogram, double percent)
+{
+	if (histogram->count == 0)
+		return 0;
+	guint64 rank = (guint64)ceil(percent / 100.0 * histogram->count);
+	rank = MAX(rank, 1);
+	guint64 seen = 0;
+	int bucket = 0;
+	for (; bucket < MINITERM_HISTOGRAM_BUCKETS - 1; ++bucket) {
+		seen += histogram->buckets[bucket];
+		if (seen >= rank)
+			break;
+	}
+	if (bucket == 0)
+		return 0;
+	return (gint64)ceil(exp2((double)bucket / BUCKETS_PER_OCTAVE));
+}
@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) 2018 Jason Waataja
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef MINITERM_LATENCY_H
+#define MINITERM_LATENCY_H
+
+#include <glib.h>
+#include <stdbool.h>
+
+/*
+ * Input latency histograms. A keystroke is followed from the key event to the
+ * frame that shows its echo, see MinitermLatencyStage. Measuring is enabled
+ * with the measure-latency setting or by setting the MINITERM_LATENCY
+ * environment variable.
+ */
+
+typedef enum {
+	/* From the key event's timestamp to the key press handler. */
+	MINITERM_LATENCY_INPUT,
+	/* From the key press handler to the input being sent to the child. */
+	MINITERM_LATENCY_COMMIT,
+	/* From sending the input to the echo arriving on the pty. */
+	MINITERM_LATENCY_ECHO,
+	/* From the echo arriving to the end of the frame that draws it. */
+	MINITERM_LATENCY_RENDER,
+	/* From the key event to the end of the frame. */
+	MINITERM_LATENCY_TOTAL,
+	MINITERM_LATENCY_STAGES,
+} MinitermLatencyStage;
+
+/* Buckets are a quarter of a power of two wide, up to about an hour. */
+#define MINITERM_HISTOGRAM_BUCKETS 128
+
+typedef struct {
+	guint64 count;
+	guint64 buckets[MINITERM_HISTOGRAM_BUCKETS];
+} MinitermHistogram;
+
+/* Returns whether the environment enables measuring. */
+bool miniterm_latency_env_enabled(void);
+const char *miniterm_latency_stage_name(MinitermLatencyStage stage);
+/* Records a value in microseconds. */
+void miniterm_histogram_add(MinitermHistogram *histogram, gint64 usec);
+/*
+ * Returns the nearest rank percentile in microseconds, rounded up to the end
+ * of its bucket, or 0 if the histogram is empty.
+ */
+gint64 miniterm_histogram_percentile(
+	const MinitermHistogram *histogram, double percent);
+
+#endif /* MINITERM_LATENCY_H */
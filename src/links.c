@@ -0,0 +1,166 @@
+/*
+ * Copyright (c) 2018 Jason Waataja
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "links.h"
+
+#include <stdbool.h>
+#include <string.h>
+#include <vte/vte.h>
+
+#define PCRE2_CODE_UNIT_WIDTH 0
+#include <pcre2.h>
+
+/* The last patterns compiled and their regexes, NULL before the first. */
+static char **cached_patterns = NULL;
+static GPtrArray *cached_regexes = NULL;
+
+/* Returns whether a and b hold the same strings in the same order. */
+static bool strv_equal(char **a, char **b);
+/*
+ * Returns the newly allocated path of the file link names, without a trailing
+ * line and column, or NULL if there is no such file.
+ */
+static char *find_file(const char *link, const char *cwd);
+static void launch_uri(GtkWidget *widget, const char *uri);
+static void run_command(const char *command, const char *link, const char *cwd);
+
+GPtrArray *
+miniterm_links_compile(char **patterns)
+{
+	if (cached_regexes != NULL && strv_equal(cached_patterns, patterns))
+		return g_ptr_array_ref(cached_regexes);
+
+	GPtrArray *regexes =
+		g_ptr_array_new_with_free_func((GDestroyNotify)vte_regex_unref);
+	for (size_t i = 0; patterns[i] != NULL; ++i) {
+		GError *error = NULL;
+		/* Vte requires multiline matching and adds UTF-8 itself. */
+		VteRegex *regex = vte_regex_new_for_match(
+			patterns[i], -1, PCRE2_MULTILINE, &error);
+		if (regex == NULL) {
+			g_printerr("Invalid link pattern \"%s\": %s\n",
+				patterns[i], error->message);
+			g_error_free(error);
+			continue;
+		}
+		/* Without JIT support the pattern is interpreted instead. */
+		vte_regex_jit(regex, PCRE2_JIT_COMPLETE, NULL);
+		g_ptr_array_add(regexes, regex);
+	}
+	g_strfreev(cached_patterns);
+	if (cached_regexes != NULL)
+		g_ptr_array_unref(cached_regexes);
+	cached_patterns = g_strdupv(patterns);
+	cached_regexes = regexes;
+	return g_ptr_array_ref(regexes);
+}
+
+void
+miniterm_links_open(GtkWidget *widget, const char *link, const char *cwd,
+	const char *command)
+{
+	if (command != NULL) {
+		run_command(command, link, cwd);
+		return;
+	}
+	if (strstr(link, "://") != NULL) {
+		launch_uri(widget, link);
+		return;
+	}
+	char *path = find_file(link, cwd);
+	if (path != NULL) {
+		char *uri = g_filename_to_uri(path, NULL, NULL);
+		if (uri != NULL)
+			launch_uri(widget, uri);
+		g_free(uri);
+		g_free(path);
+		return;
+	}
+	gtk_clipboard_set_text(
+		gtk_widget_get_clipboard(widget, GDK_SELECTION_CLIPBOARD), link,
+		-1);
+}
+
+static bool
+strv_equal(char **a, char **b)
+{
+	size_t i = 0;
+	for (; a[i] != NULL && b[i] != NULL; ++i) {
+		if (strcmp(a[i], b[i]) != 0)
+			return false;
+	}
+	return a[i] == NULL && b[i] == NULL;
+}
+
+static char *
+find_file(const char *link, const char *cwd)
+{
+	char *name = g_strdup(link);
+	/* Drop ":line" and ":line:column". */
+	for (int i = 0; i < 2; ++i) {
+		char *colon = strrchr(name, ':');
+		if (colon == NULL || colon[1] == '\0'
+			|| strspn(colon + 1, "0123456789") != strlen(colon + 1))
+			break;
+		*colon = '\0';
+	}
+	char *path = NULL;
+	if (g_str_has_prefix(name, "~/"))
+		path = g_build_filename(g_get_home_dir(), name + 2, NULL);
+	else if (g_path_is_absolute(name))
+		path = g_strdup(name);
+	else if (cwd != NULL)
+		path = g_build_filename(cwd, name, NULL);
+	g_free(name);
+	if (path != NULL && !g_file_test(path, G_FILE_TEST_EXISTS))
+		g_clear_pointer(&path, g_free);
+	return path;
+}
+
+static void
+launch_uri(GtkWidget *widget, const char *uri)
+{
+	GdkAppLaunchContext *context = gdk_display_get_app_launch_context(
+		gtk_widget_get_display(widget));
+	GError *error = NULL;
+	if (!g_app_info_launch_default_for_uri(
+		    uri, G_APP_LAUNCH_CONTEXT(context), &error)) {
+		g_printerr("Failed to open %s: %s\n", uri, error->message);
+		g_error_free(error);
+	}
+	g_object_unref(context);
+}
+
+static void
+run_command(const char *command, const char *link, const char *cwd)
+{
+	/* The link is $1, so it needn't be quoted in the command. */
+	char *argv[] = {"/bin/sh", "-c", (char *)command, "sh", (char *)link,
+		NULL};
+	GError *error = NULL;
+	if (!g_spawn_async(cwd, argv, NULL, G_SPAWN_DEFAULT, NULL, NULL, NULL,
+		    &error)) {
+		g_printerr("Failed to run the link command: %s\n",
+			error->message);
+		g_error_free(error);
+	}
+}
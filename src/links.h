@@ -0,0 +1,51 @@
+/*
+ * Copyright (c) 2018 Jason Waataja
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef MINITERM_LINKS_H
+#define MINITERM_LINKS_H
+
+#include <gtk/gtk.h>
+
+/*
+ * Links are the parts of the output matching the link patterns of the
+ * settings, such as URLs, file:line paths and commit hashes. Vte only matches
+ * them against the row under the pointer once it moves, so output that
+ * scrolls past is never matched.
+ */
+
+/*
+ * Returns the compiled patterns as VteRegex, in the same order except for the
+ * ones that don't compile, which are reported. Every caller passing the same
+ * patterns shares the array, so patterns are only compiled again when they
+ * change. Release it with g_ptr_array_unref().
+ */
+GPtrArray *miniterm_links_compile(char **patterns);
+/*
+ * Opens link as clicked in widget. The link is passed to command if it isn't
+ * NULL. Otherwise URLs and existing files, without a trailing line number, are
+ * opened with their default application, and anything else is copied to the
+ * clipboard. Relative paths are resolved against cwd, which may be NULL.
+ */
+void miniterm_links_open(GtkWidget *widget, const char *link, const char *cwd,
+	const char *command);
+
+#endif /* MINITERM_LINKS_H */
@@ -0,0 +1,316 @@
+/*
+ * Copyright (c) 2018 Jason Waataja
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+#include "log.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "config.h"
+
+struct _MinitermLog {
+	char *path;
+	bool timestamps;
+	gint64 rotate_size;
+	GThread *thread;
+
+	/* The following are only used by the thread writing output. */
+	/* Whether the next output starts a line. */
+	bool line_start;
+	/* Output with timestamps added. */
+	GString *stamped;
+
+	/* The following are only used by the writer thread. */
+	int fd;
+	gint64 size;
+
+	/* The following are guarded by mutex. */
+	GMutex mutex;
+	/* Signalled when output is added or the log is freed. */
+	GCond data_cond;
+	/* Signalled when space is freed or the log is closed. */
+	GCond space_cond;
+	/* Holds LOG_BUFFER_SIZE bytes, length of them buffered from start. */
+	char *ring;
+	size_t start;
+	size_t length;
+	/* Set once writing failed, output is dropped from then on. */
+	bool failed;
+	bool closed;
+	bool freed;
+};
+
+/* Number of freed logs the writer threads are still writing out. */
+static GMutex freed_mutex;
+static GCond freed_cond;
+static unsigned int freed_count = 0;
+
+static gpointer writer_thread(gpointer user_data);
+/* Copies data into free space of the buffer. Called with the mutex held. */
+static void copy_to_buffer(MinitermLog *log, const char *data, size_t length);
+/* Writes the buffer once. Called with the mutex held. */
+static void write_buffer(MinitermLog *log);
+/* Starts a new file, keeping the current one as the ".1" file. */
+static void rotate(MinitermLog *log);
+/* Sets stamped to data with the time added in front of each line. */
+static void stamp(MinitermLog *log, const char *data, size_t length);
+
+MinitermLog *
+miniterm_log_new(
+	const char *path, bool timestamps, gint64 rotate_size, GError **error)
+{
+	/* Transcripts can hold anything typed, keep them private. */
+	const int fd =
+		g_open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+	if (fd < 0) {
+		const int saved_errno = errno;
+		g_set_error(error, G_FILE_ERROR,
+			g_file_error_from_errno(saved_errno),
+			"Failed to open %s: %s", path,
+			g_strerror(saved_errno));
+		return NULL;
+	}
+	MinitermLog *log = g_new0(MinitermLog, 1);
+	log->path = g_strdup(path);
+	log->timestamps = timestamps;
+	log->rotate_size = rotate_size;
+	log->line_start = true;
+	log->stamped = g_string_new(NULL);
+	log->fd = fd;
+	log->size = lseek(fd, 0, SEEK_END);
+	g_mutex_init(&log->mutex);
+	g_cond_init(&log->data_cond);
+	g_cond_init(&log->space_cond);
+	log->ring = g_malloc(LOG_BUFFER_SIZE);
+	log->thread = g_thread_new("log-writer", writer_thread, log);
+	return log;
+}
+
+void
+miniterm_log_write(MinitermLog *log, const char *data, size_t length)
+{
+	if (log->timestamps) {
+		stamp(log, data, length);
+		data = log->stamped->str;
+		length = log->stamped->len;
+	}
+	g_mutex_lock(&log->mutex);
+	while (length > 0 && !log->failed) {
+		if (log->length == LOG_BUFFER_SIZE) {
+			if (log->closed)
+				break;
+			g_cond_wait(&log->space_cond, &log->mutex);
+			continue;
+		}
+		const size_t count =
+			MIN(length, LOG_BUFFER_SIZE - log->length);
+		copy_to_buffer(log, data, count);
+		data += count;
+		length -= count;
+		g_cond_signal(&log->data_cond);
+	}
+	g_mutex_unlock(&log->mutex);
+}
+
+void
+miniterm_log_write_record(MinitermLog *log, const char *header,
+	size_t header_length, const char *data, size_t length)
+{
+	const size_t total = header_length + length;
+	g_return_if_fail(total <= LOG_BUFFER_SIZE);
+	g_mutex_lock(&log->mutex);
+	while (!log->failed && !log->closed
+		&& LOG_BUFFER_SIZE - log->length < total)
+		g_cond_wait(&log->space_cond, &log->mutex);
+	if (!log->failed && LOG_BUFFER_SIZE - log->length >= total) {
+		copy_to_buffer(log, header, header_length);
+		copy_to_buffer(log, data, length);
+		g_cond_signal(&log->data_cond);
+	}
+	g_mutex_unlock(&log->mutex);
+}
+
+void
+miniterm_log_close(MinitermLog *log)
+{
+	g_mutex_lock(&log->mutex);
+	log->closed = true;
+	g_cond_broadcast(&log->space_cond);
+	g_mutex_unlock(&log->mutex);
+}
+
+void
+miniterm_log_free(MinitermLog *log)
+{
+	g_mutex_lock(&freed_mutex);
+	++freed_count;
+	g_mutex_unlock(&freed_mutex);
+	/* The thread may free the log as soon as the mutex is released. */
+	GThread *thread = log->thread;
+	g_mutex_lock(&log->mutex);
+	log->closed = true;
+	log->freed = true;
+	g_cond_signal(&log->data_cond);
+	g_mutex_unlock(&log->mutex);
+	g_thread_unref(thread);
+}
+
+void
+miniterm_log_wait_freed(void)
+{
+	g_mutex_lock(&freed_mutex);
+	while (freed_count > 0)
+		g_cond_wait(&freed_cond, &freed_mutex);
+	g_mutex_unlock(&freed_mutex);
+}
+
+static gpointer
+writer_thread(gpointer user_data)
+{
+	MinitermLog *log = user_data;
+	g_mutex_lock(&log->mutex);
+	for (;;) {
+		while (log->length == 0 && !log->freed)
+			g_cond_wait(&log->data_cond, &log->mutex);
+		if (log->length == 0)
+			break;
+		write_buffer(log);
+	}
+	g_mutex_unlock(&log->mutex);
+
+	close(log->fd);
+	g_mutex_clear(&log->mutex);
+	g_cond_clear(&log->data_cond);
+	g_cond_clear(&log->space_cond);
+	g_free(log->ring);
+	g_string_free(log->stamped, TRUE);
+	g_free(log->path);
+	g_free(log);
+	g_mutex_lock(&freed_mutex);
+	--freed_count;
+	g_cond_broadcast(&freed_cond);
+	g_mutex_unlock(&freed_mutex);
+	return NULL;
+}
+
+static void
+copy_to_buffer(MinitermLog *log, const char *data, size_t length)
+{
+	const size_t end = (log->start + log->length) % LOG_BUFFER_SIZE;
+	/* Fill up to where the buffer wraps around, then from its start. */
+	const size_t count = MIN(length, LOG_BUFFER_SIZE - end);
+	memcpy(log->ring + end, data, count);
+	memcpy(log->ring, data + count, length - count);
+	log->length += length;
+}
+
+static void
+write_buffer(MinitermLog *log)
+{
+	if (log->failed) {
+		log->length = 0;
+		return;
+	}
+	/* Everything buffered goes out in one call, in up to two pieces. */
+	const size_t first = MIN(log->length, LOG_BUFFER_SIZE - log->start);
+	struct iovec pieces[2] = {
+		{log->ring + log->start, first},
+		{log->ring, log->length - first},
+	};
+	/* The buffered bytes stay put while the mutex is released. */
+	g_mutex_unlock(&log->mutex);
+	const ssize_t written =
+		writev(log->fd, pieces, pieces[1].iov_len > 0 ? 2 : 1);
+	const int saved_errno = errno;
+	if (written > 0) {
+		log->size += written;
+		if (log->rotate_size > 0 && log->size >= log->rotate_size)
+			rotate(log);
+	}
+	g_mutex_lock(&log->mutex);
+	if (written < 0 && saved_errno != EINTR) {
+		g_printerr("Failed to write %s: %s\n", log->path,
+			g_strerror(saved_errno));
+		log->failed = true;
+		log->length = 0;
+	} else if (written > 0) {
+		log->start = (log->start + written) % LOG_BUFFER_SIZE;
+		log->length -= written;
+	}
+	g_cond_broadcast(&log->space_cond);
+}
+
+static void
+rotate(MinitermLog *log)
+{
+	char *old_path = g_strconcat(log->path, ".1", NULL);
+	if (g_rename(log->path, old_path) != 0) {
+		g_printerr("Failed to rotate %s: %s\n", log->path,
+			g_strerror(errno));
+		g_free(old_path);
+		return;
+	}
+	g_free(old_path);
+	const int fd = g_open(
+		log->path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+	if (fd < 0) {
+		/* Keep writing to the renamed file rather than lose output. */
+		g_printerr("Failed to open %s: %s\n", log->path,
+			g_strerror(errno));
+		log->size = 0;
+		return;
+	}
+	close(log->fd);
+	log->fd = fd;
+	log->size = 0;
+}
+
+static void
+stamp(MinitermLog *log, const char *data, size_t length)
+{
+	/* One time per read is precise enough and stays cheap under floods. */
+	GDateTime *now = g_date_time_new_now_local();
+	char *time = g_date_time_format(now, "%Y-%m-%d %H:%M:%S");
+	char prefix[64];
+	snprintf(prefix, sizeof(prefix), "[%s.%03d] ", time,
+		g_date_time_get_microsecond(now) / 1000);
+	g_free(time);
+	g_date_time_unref(now);
+
+	g_string_truncate(log->stamped, 0);
+	const char *end = data + length;
+	while (data < end) {
+		if (log->line_start)
+			g_string_append(log->stamped, prefix);
+		const char *newline = memchr(data, '\n', end - data);
+		const char *next = newline != NULL ? newline + 1 : end;
+		g_string_append_len(log->stamped, data, next - data);
+		log->line_start = newline != NULL;
+		data = next;
+	}
+}
@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) 2018 Jason Waataja
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+#ifndef MINITERM_LOG_H
+#define MINITERM_LOG_H
+
+#include <glib.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * A session log copies terminal output into a ring buffer that a writer thread
+ * drains to a file, so a slow disk only ever holds up the thread producing the
+ * output and never the main loop.
+ */
+typedef struct _MinitermLog MinitermLog;
+
+/*
+ * Opens path for appending. Lines are prefixed with the time they were
+ * received if timestamps is set. Once the file grows past rotate_size bytes it
+ * is renamed to path with ".1" appended, replacing an older one, and a new file
+ * is started. A rotate_size of 0 disables that.
+ */
+MinitermLog *miniterm_log_new(const char *path, bool timestamps,
+	gint64 rotate_size, GError **error);
+/*
+ * Copies data into the buffer, waiting while it is full. Must only be called
+ * by one thread at a time.
+ */
+void miniterm_log_write(MinitermLog *log, const char *data, size_t length);
+/*
+ * Like miniterm_log_write(), but header and data are buffered together or,
+ * once the log is closed and they don't fit, dropped together, so the file
+ * never ends in half a record. Together they must fit in LOG_BUFFER_SIZE.
+ * Timestamps aren't added.
+ */
+void miniterm_log_write_record(MinitermLog *log, const char *header,
+	size_t header_length, const char *data, size_t length);
+/*
+ * Stops waiting for buffer space, output that doesn't fit is dropped from now
+ * on. This lets the thread writing output be stopped without waiting for the
+ * disk.
+ */
+void miniterm_log_close(MinitermLog *log);
+/*
+ * Lets the writer thread write out what is buffered and free the log without
+ * waiting for it. Nothing may be written after this.
+ */
+void miniterm_log_free(MinitermLog *log);
+/* Waits until all freed logs are written out. */
+void miniterm_log_wait_freed(void);
+
+#endif /* MINITERM_LOG_H */
@@ -31,106 +31,42 @@
 #include <stdlib.h>
 #include <vte/vte.h>
 
-#ifdef GDK_WINDOWING_X11
-#include <gdk/gdkx.h>
-#endif
-
+#include "application.h"
 #include "config.h"
+#include "session.h"
 #include "terminal.h"
+#include "trace.h"
+#include "window.h"
 
-static gboolean vte_spawn(VteTerminal *vte,
-	GApplicationCommandLine *command_line, const char *working_directory,
-	char *command, char **environment);
-/* Callback to exit miniterm with exit status of child process. */
-static void window_close(GtkWindow *window, gint status, gpointer user_data);
 static gboolean parse_arguments(GApplicationCommandLine *command_line, int argc,
 	char *argv[], char **command, char **directory, gboolean *keep,
-	char **title);
+	char **title, gboolean *tab, gboolean *usage, char **log,
+	gboolean *restore, gboolean *daemon, char **capture);
 static void signal_handler(int signal);
+/*
+ * Returns the newly allocated absolute path of the file argument, relative to
+ * the invoking shell's directory rather than the child's. Returns NULL if arg
+ * is NULL.
+ */
+static char *get_path(GApplicationCommandLine *command_line, const char *arg);
+/* Returns the most recently focused visible window, or NULL. */
+static MinitermWindow *find_window(GtkApplication *app);
 static void new_window(GtkApplication *app,
 	GApplicationCommandLine *command_line, gchar **argv, gint argc);
+/* Reports a failed spawn to the invoking command and closes its tab. */
+static void spawn_cb(MinitermTerminal *terminal, GPid pid, GError *error,
+	gpointer user_data);
 static void command_line(GApplication *app,
 	GApplicationCommandLine *command_line, gpointer user_data);
-static void set_geometry_hints(VteTerminal *vte, GdkGeometry *hints);
 
 /* The application is global for use with signal handlers. */
 static GApplication *_application = NULL;
 
-static gboolean
-vte_spawn(VteTerminal *vte, GApplicationCommandLine *command_line,
-	const char *working_directory, char *command, char **environment)
-{
-	GError *error = NULL;
-	char **command_argv = NULL;
-	/* Parse command into array */
-	if (!command)
-		command = vte_get_user_shell();
-	g_shell_parse_argv(command, NULL, &command_argv, &error);
-	if (error != NULL) {
-		g_application_command_line_printerr(command_line,
-			"Failed to parse command: %s\n", error->message);
-		g_error_free(error);
-		g_application_command_line_set_exit_status(
-			command_line, EXIT_FAILURE);
-		return FALSE;
-	}
-	/* Create pty object */
-	VtePty *pty =
-		vte_terminal_pty_new_sync(vte, VTE_PTY_NO_HELPER, NULL, &error);
-	if (error) {
-		g_application_command_line_printerr(command_line,
-			"Failed to create pty: %s\n", error->message);
-		g_error_free(error);
-		g_application_command_line_set_exit_status(
-			command_line, EXIT_FAILURE);
-		return FALSE;
-	}
-	vte_terminal_set_pty(vte, pty);
-	int child_pid;
-	/* Spawn default shell (or specified command). */
-	g_spawn_async(working_directory, command_argv, environment,
-		(G_SPAWN_DO_NOT_REAP_CHILD | G_SPAWN_SEARCH_PATH
-			| G_SPAWN_LEAVE_DESCRIPTORS_OPEN), // flags from
-							   // GSpawnFlags
-		(GSpawnChildSetupFunc)
-			vte_pty_child_setup, // an extra child setup function to
-					     // run in the child just before
-					     // exec()
-		pty,	    // user data for child_setup
-		&child_pid, // a location to store the child PID
-		&error);    // return location for a GError
-	if (error) {
-		g_application_command_line_printerr(
-			command_line, "%s\n", error->message);
-		g_error_free(error);
-		g_application_command_line_set_exit_status(
-			command_line, EXIT_FAILURE);
-		return FALSE;
-	}
-	vte_terminal_watch_child(vte, child_pid);
-	g_strfreev(command_argv);
-	return TRUE;
-}
-
-static void
-window_close(GtkWindow *window, gint status, gpointer user_data)
-{
-	(void)window;
-	(void)status;
-	GtkApplication *app = (GtkApplication *)user_data;
-	int count = 0;
-	GList *windows = gtk_application_get_windows(app);
-	while (windows != NULL) {
-		windows = windows->next;
-		++count;
-	}
-	if (count == 1)
-		g_application_quit(G_APPLICATION(app));
-}
-
 static gboolean
 parse_arguments(GApplicationCommandLine *command_line, int argc, char *argv[],
-	char **command, char **directory, gboolean *keep, char **title)
+	char **command, char **directory, gboolean *keep, char **title,
+	gboolean *tab, gboolean *usage, char **log, gboolean *restore,
+	gboolean *daemon, char **capture)
 {
 	gboolean version = FALSE; /* Show version? */
 	gboolean help = FALSE;
@@ -148,6 +84,21 @@ parse_arguments(GApplicationCommandLine *command_line, int argc, char *argv[],
 		{"title", 't', 0, G_OPTION_ARG_STRING, title,
 			"Set value of WM_NAME property; disables window_title_cb (default: 'MiniTerm')",
 			"TITLE"},
+		{"tab", 0, 0, G_OPTION_ARG_NONE, tab,
+			"Open a new tab in an existing window.", 0},
+		{"scrollback-usage", 0, 0, G_OPTION_ARG_NONE, usage,
+			"Print the scrollback memory used by each window.", 0},
+		{"log", 'l', 0, G_OPTION_ARG_FILENAME, log,
+			"Append the output of the shell (or the command specified via -e) to FILE.",
+			"FILE"},
+		{"restore", 0, 0, G_OPTION_ARG_NONE, restore,
+			"Reopen the windows saved when miniterm last quit.", 0},
+		{"daemon", 0, 0, G_OPTION_ARG_NONE, daemon,
+			"Keep running without windows, ready to open them quickly.",
+			0},
+		{"capture", 0, 0, G_OPTION_ARG_FILENAME, capture,
+			"Record the output of the shell (or the command specified via -e) to FILE.",
+			"FILE"},
 		{"help", 'h', 0, G_OPTION_ARG_NONE, &help,
 			"Display this message", 0},
 		{NULL}};
@@ -188,28 +139,88 @@ signal_handler(int signal)
 	g_application_quit(_application);
 }
 
-static void
-set_geometry_hints(VteTerminal *vte, GdkGeometry *hints)
+static MinitermWindow *
+find_window(GtkApplication *app)
 {
-	hints->base_width = vte_terminal_get_char_width(vte);
-	hints->base_height = vte_terminal_get_char_height(vte);
-	hints->min_width = vte_terminal_get_char_width(vte);
-	hints->min_height = vte_terminal_get_char_height(vte);
-	hints->width_inc = vte_terminal_get_char_width(vte);
-	hints->height_inc = vte_terminal_get_char_height(vte);
+	/* The list is sorted by when the windows were last focused. */
+	GList *windows = gtk_application_get_windows(app);
+	for (GList *l = windows; l != NULL; l = l->next) {
+		if (MINITERM_IS_WINDOW(l->data)
+			&& gtk_widget_get_visible(GTK_WIDGET(l->data)))
+			return MINITERM_WINDOW(l->data);
+	}
+	return NULL;
 }
 
 static void
 new_window(GtkApplication *app, GApplicationCommandLine *command_line,
 	gchar **argv, gint argc)
 {
+	miniterm_trace("new-window", 0);
 	/* Variables for parsed command-line arguments */
 	char *command = NULL;
 	char *directory = NULL;
 	gboolean keep = FALSE;
 	char *title = NULL;
+	gboolean tab = FALSE;
+	gboolean usage = FALSE;
+	char *log = NULL;
+	gboolean restore = FALSE;
+	gboolean daemon = FALSE;
+	char *capture = NULL;
 	if (!parse_arguments(command_line, argc, argv, &command, &directory,
-		    &keep, &title)) {
+		    &keep, &title, &tab, &usage, &log, &restore, &daemon,
+		    &capture)) {
+		return;
+	}
+	/* With sharding the dispatcher is the daemon, not the shards. */
+	if (miniterm_application_get_shard(MINITERM_APPLICATION(app)) >= 0)
+		daemon = FALSE;
+	/* A daemon opens no window unless it restores the last session. */
+	if (daemon)
+		miniterm_application_start_daemon(MINITERM_APPLICATION(app));
+	/* The dispatcher leaves everything else to the shards. */
+	if ((daemon && !restore)
+		|| miniterm_application_dispatch(MINITERM_APPLICATION(app),
+			command_line, tab, usage)) {
+		g_free(command);
+		g_free(directory);
+		g_free(title);
+		g_free(log);
+		g_free(capture);
+		return;
+	}
+	if (usage) {
+		char *report = miniterm_application_get_scrollback_report(
+			MINITERM_APPLICATION(app));
+		g_application_command_line_print(command_line, "%s", report);
+		g_free(report);
+		g_free(command);
+		g_free(directory);
+		g_free(title);
+		g_free(log);
+		g_free(capture);
+		return;
+	}
+	if (restore) {
+		char *session = miniterm_session_get_default_directory();
+		GError *error = NULL;
+		if (miniterm_session_restore(
+			    app, session, command_line, &error)
+			< 0) {
+			g_application_command_line_printerr(command_line,
+				"Failed to restore session: %s\n",
+				error->message);
+			g_application_command_line_set_exit_status(
+				command_line, EXIT_FAILURE);
+			g_error_free(error);
+		}
+		g_free(session);
+		g_free(command);
+		g_free(directory);
+		g_free(title);
+		g_free(log);
+		g_free(capture);
 		return;
 	}
 	const char *cwd =
@@ -217,63 +228,83 @@ new_window(GtkApplication *app, GApplicationCommandLine *command_line,
 			? g_application_command_line_get_cwd(command_line)
 			: directory;
 
-	/* Create window. */
-	GtkWidget *window = gtk_application_window_new(GTK_APPLICATION(app));
-
-	/* Try to set the rgba colormap so vte can use real transparency. */
-	GdkScreen *screen = gtk_window_get_screen(GTK_WINDOW(window));
-	GdkVisual *visual = gdk_screen_get_rgba_visual(screen);
-	if (visual != NULL)
-		gtk_widget_set_visual(GTK_WIDGET(window), visual);
-
-	g_signal_connect(window, "delete-event", G_CALLBACK(window_close), app);
-	gtk_window_set_title(GTK_WINDOW(window), title ? title : "miniterm");
-	/* Set window icon supplied by an icon theme. */
-	GtkIconTheme *icon_theme = gtk_icon_theme_get_default();
-	GdkPixbuf *icon =
-		gtk_icon_theme_load_icon(icon_theme, "terminal", 48, 0, NULL);
-	if (icon) {
-		gtk_window_set_icon(GTK_WINDOW(window), icon);
-		g_object_unref(icon);
-	}
-
-	/* Create terminal widget */
-	MinitermTerminal *term =
-		miniterm_terminal_new(keep, title, GTK_WINDOW(window));
-	VteTerminal *vte = VTE_TERMINAL(term);
-	GdkGeometry geo_hints;
-	/* Apply geometry hints to handle terminal resizing */
-	set_geometry_hints(vte, &geo_hints);
-	gtk_window_set_geometry_hints(GTK_WINDOW(window), GTK_WIDGET(term),
-		&geo_hints,
-		GDK_HINT_RESIZE_INC | GDK_HINT_MIN_SIZE | GDK_HINT_BASE_SIZE);
-
-	miniterm_terminal_load_settings(term);
+	char *log_path = get_path(command_line, log);
+	char *capture_path = get_path(command_line, capture);
 
-	/* Show widgets and run main loop. */
-	gtk_widget_show_all(window);
-
-	/* Set the OS window id environment variable */
-#ifdef GDK_WINDOWING_X11
-	if (GDK_IS_X11_DISPLAY(gtk_widget_get_display(window))) {
-		XID wid = GDK_WINDOW_XID(gtk_widget_get_window(window));
-		char wid_str[64];
-		snprintf(wid_str, 64, "%lu", wid);
-		setenv("WINDOWID", wid_str, TRUE);
+	/* Hand out a prewarmed window if its shell is what was asked for. */
+	MinitermWindow *window = tab ? find_window(app) : NULL;
+	MinitermWindow *prewarmed = NULL;
+	if (window == NULL && command == NULL && log_path == NULL
+		&& capture_path == NULL)
+		prewarmed = miniterm_application_take_prewarmed(
+			MINITERM_APPLICATION(app), cwd,
+			g_application_command_line_get_environ(command_line));
+	if (prewarmed != NULL) {
+		MinitermTerminal *term =
+			miniterm_window_get_terminal(prewarmed);
+		miniterm_trace("window", miniterm_terminal_get_id(term));
+		miniterm_terminal_set_keep(term, keep);
+		miniterm_terminal_set_title(term, title);
+		gtk_widget_show(GTK_WIDGET(prewarmed));
+	} else {
+		MinitermTerminal *term = NULL;
+		if (window != NULL) {
+			term = miniterm_window_add_terminal(
+				window, keep, title);
+			gtk_window_present(GTK_WINDOW(window));
+		} else {
+			window = miniterm_window_new(app, keep, title);
+			term = miniterm_window_get_terminal(window);
+			gtk_widget_show(GTK_WIDGET(window));
+		}
+		miniterm_trace("window", miniterm_terminal_get_id(term));
+		miniterm_terminal_set_log(term, log_path);
+		miniterm_terminal_set_capture(term, capture_path);
+		miniterm_window_spawn(window, term, cwd, command,
+			g_application_command_line_get_environ(command_line),
+			spawn_cb, g_object_ref(command_line));
 	}
-#endif
 
-	if (!vte_spawn(vte, command_line, cwd, command, NULL)) {
-		gtk_window_close(GTK_WINDOW(window));
-		g_free(command);
-		g_free(directory);
-		g_free(title);
-		return;
-	}
 	/* Cleanup. */
 	g_free(command);
 	g_free(directory);
 	g_free(title);
+	g_free(log);
+	g_free(log_path);
+	g_free(capture);
+	g_free(capture_path);
+}
+
+static char *
+get_path(GApplicationCommandLine *command_line, const char *arg)
+{
+	if (arg == NULL)
+		return NULL;
+	GFile *file = g_application_command_line_create_file_for_arg(
+		command_line, arg);
+	char *path = g_file_get_path(file);
+	g_object_unref(file);
+	return path;
+}
+
+static void
+spawn_cb(MinitermTerminal *terminal, GPid pid, GError *error,
+	gpointer user_data)
+{
+	(void)pid;
+	GApplicationCommandLine *command_line = user_data;
+	if (error != NULL) {
+		g_application_command_line_printerr(
+			command_line, "%s\n", error->message);
+		g_application_command_line_set_exit_status(
+			command_line, EXIT_FAILURE);
+		GtkWidget *window =
+			gtk_widget_get_toplevel(GTK_WIDGET(terminal));
+		if (MINITERM_IS_WINDOW(window))
+			miniterm_window_remove_terminal(
+				MINITERM_WINDOW(window), terminal);
+	}
+	g_object_unref(command_line);
 }
 
 static void
@@ -281,10 +312,17 @@ command_line(GApplication *app, GApplicationCommandLine *command_line,
 	gpointer user_data)
 {
 	(void)user_data;
+	miniterm_trace("command-line", 0);
 	int argv;
 	char **argc =
 		g_application_command_line_get_arguments(command_line, &argv);
 	g_application_command_line_set_exit_status(command_line, EXIT_SUCCESS);
+	/* A shard only opens the windows the dispatcher forwards to it. */
+	if (miniterm_application_get_shard(MINITERM_APPLICATION(app)) >= 0
+		&& !g_application_command_line_get_is_remote(command_line)) {
+		g_strfreev(argc);
+		return;
+	}
 	new_window(GTK_APPLICATION(app), command_line, argc, argv);
 }
 
@@ -295,13 +333,22 @@ command_line(GApplication *app, GApplicationCommandLine *command_line,
 int
 main(int argc, char *argv[])
 {
-	gtk_init(&argc, &argv);
+	/*
+	 * GTK isn't initialized here. GtkApplication does that in startup,
+	 * which only runs in the primary instance, so launching a window in a
+	 * running instance forwards the command line over D-Bus and exits
+	 * without ever connecting to the display.
+	 */
 	/* Register signal handler. */
 	signal(SIGHUP, signal_handler);
 	signal(SIGINT, signal_handler);
 	signal(SIGTERM, signal_handler);
-	GtkApplication *app = gtk_application_new(
-		"us.laelath.miniterm", G_APPLICATION_HANDLES_COMMAND_LINE);
+	/* Set by the dispatcher for shards, their children mustn't see it. */
+	const char *shard = g_getenv("MINITERM_SHARD");
+	const int shard_index = shard != NULL ? atoi(shard) : -1;
+	g_unsetenv("MINITERM_SHARD");
+	MinitermApplication *app = miniterm_application_new(shard_index);
+	_application = G_APPLICATION(app);
 	g_signal_connect(app, "command-line", G_CALLBACK(command_line), NULL);
 	int status = g_application_run(G_APPLICATION(app), argc, argv);
 	g_object_unref(app);
@@ -0,0 +1,174 @@
+/*
+ * Copyright (c) 2018 Jason Waataja
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "modes.h"
+
+#include <glib.h>
+#include <string.h>
+
+/* More parameters than any sequence that matters here has. */
+#define MAX_PARAMETERS 16
+
+typedef enum {
+	STATE_GROUND,
+	/* After ESC. */
+	STATE_ESCAPE,
+	/* After ESC [. */
+	STATE_CSI,
+	/* In the parameters of ESC [ ?. */
+	STATE_PRIVATE,
+} State;
+
+struct _MinitermModes {
+	State state;
+	unsigned int parameters[MAX_PARAMETERS];
+	int parameter_count;
+	bool alternate_screen;
+	bool bracketed_paste;
+};
+
+/* Scans one byte of output. */
+static void scan_byte(MinitermModes *modes, unsigned char c);
+/* Applies DECSET or DECRST with the collected parameters. */
+static void set_modes(MinitermModes *modes, bool set);
+
+MinitermModes *
+miniterm_modes_new(void)
+{
+	return g_new0(MinitermModes, 1);
+}
+
+void
+miniterm_modes_free(MinitermModes *modes)
+{
+	g_free(modes);
+}
+
+void
+miniterm_modes_scan(MinitermModes *modes, const char *data, size_t length)
+{
+	for (size_t i = 0; i < length; ++i) {
+		/* Most output is text, skip to the next escape. */
+		if (modes->state == STATE_GROUND) {
+			const char *escape =
+				memchr(data + i, '\033', length - i);
+			if (escape == NULL)
+				return;
+			i = escape - data;
+		}
+		scan_byte(modes, data[i]);
+	}
+}
+
+void
+miniterm_modes_reset(MinitermModes *modes)
+{
+	modes->alternate_screen = false;
+	modes->bracketed_paste = false;
+}
+
+bool
+miniterm_modes_get_alternate_screen(MinitermModes *modes)
+{
+	return modes->alternate_screen;
+}
+
+bool
+miniterm_modes_get_bracketed_paste(MinitermModes *modes)
+{
+	return modes->bracketed_paste;
+}
+
+static void
+scan_byte(MinitermModes *modes, unsigned char c)
+{
+	/* An escape starts over, CAN and SUB cancel a sequence. */
+	if (c == '\033') {
+		modes->state = STATE_ESCAPE;
+		return;
+	}
+	if (c == 0x18 || c == 0x1a) {
+		modes->state = STATE_GROUND;
+		return;
+	}
+	/* Other control characters take effect inside sequences. */
+	if (c < 0x20)
+		return;
+	switch (modes->state) {
+	case STATE_GROUND:
+		break;
+	case STATE_ESCAPE:
+		if (c == '[') {
+			modes->state = STATE_CSI;
+			return;
+		}
+		/* RIS resets the terminal. */
+		if (c == 'c')
+			miniterm_modes_reset(modes);
+		/* The rest of other sequences is skipped like text. */
+		modes->state = STATE_GROUND;
+		break;
+	case STATE_CSI:
+		if (c == '?') {
+			modes->state = STATE_PRIVATE;
+			modes->parameter_count = 1;
+			modes->parameters[0] = 0;
+			return;
+		}
+		modes->state = STATE_GROUND;
+		break;
+	case STATE_PRIVATE:
+		if (c >= '0' && c <= '9') {
+			unsigned int *parameter =
+				&modes->parameters[modes->parameter_count - 1];
+			/* Values this large don't name a mode anyway. */
+			if (*parameter < 100000)
+				*parameter = *parameter * 10 + (c - '0');
+		} else if (c == ';') {
+			if (modes->parameter_count < MAX_PARAMETERS)
+				modes->parameters[modes->parameter_count++] = 0;
+		} else if (c == 'h' || c == 'l') {
+			set_modes(modes, c == 'h');
+			modes->state = STATE_GROUND;
+		} else {
+			modes->state = STATE_GROUND;
+		}
+		break;
+	}
+}
+
+static void
+set_modes(MinitermModes *modes, bool set)
+{
+	for (int i = 0; i < modes->parameter_count; ++i) {
+		switch (modes->parameters[i]) {
+		case 47:
+		case 1047:
+		case 1049:
+			modes->alternate_screen = set;
+			break;
+		case 2004:
+			modes->bracketed_paste = set;
+			break;
+		}
+	}
+}
@@ -0,0 +1,48 @@
+/*
+ * Copyright (c) 2018 Jason Waataja
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef MINITERM_MODES_H
+#define MINITERM_MODES_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * Follows the private modes a child sets in its output that vte doesn't tell
+ * about: the alternate screen and bracketed paste. The output is scanned before
+ * it is fed, escape sequences may be split across calls.
+ */
+typedef struct _MinitermModes MinitermModes;
+
+/* Starts with both modes off, as after a reset. */
+MinitermModes *miniterm_modes_new(void);
+void miniterm_modes_free(MinitermModes *modes);
+/* Scans the next output of the child. */
+void miniterm_modes_scan(MinitermModes *modes, const char *data, size_t length);
+/* Turns both modes off, for when vte was reset. */
+void miniterm_modes_reset(MinitermModes *modes);
+/* Returns whether the alternate screen is shown. */
+bool miniterm_modes_get_alternate_screen(MinitermModes *modes);
+/* Returns whether the child asked for pastes to be bracketed. */
+bool miniterm_modes_get_bracketed_paste(MinitermModes *modes);
+
+#endif /* MINITERM_MODES_H */
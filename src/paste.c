@@ -0,0 +1,287 @@
+/*
+ * Copyright (c) 2018 Jason Waataja
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "paste.h"
+
+#include "config.h"
+
+typedef struct _Request Request;
+
+struct _MinitermPaste {
+	VteTerminal *vte;
+	MinitermModes *modes;
+	GtkWidget *bar;
+	GtkWidget *label;
+	GtkWidget *progress;
+	/* Writes the pasted input. NULL if not pasting. */
+	MinitermProxy *proxy;
+	/* The text from offset on isn't pasted yet. */
+	GString *text;
+	size_t offset;
+	/* Whether the start of a bracketed paste was sent but not its end. */
+	bool bracketed;
+	/* Shows the progress bar. 0 indicates none. */
+	unsigned int progress_source;
+	/* Clipboard requests that haven't returned yet. */
+	GSList *requests;
+};
+
+struct _Request {
+	/* NULL once the paste is freed. */
+	MinitermPaste *paste;
+	MinitermProxy *proxy;
+};
+
+static void text_received_cb(
+	GtkClipboard *clipboard, const char *text, gpointer user_data);
+/* Queues text to be pasted through proxy. */
+static void append_text(
+	MinitermPaste *paste, const char *text, MinitermProxy *proxy);
+/* Pastes the next piece once the proxy wrote the previous one. */
+static void written_cb(bool written, gpointer user_data);
+static gboolean show_progress_cb(gpointer user_data);
+static void update_progress(MinitermPaste *paste);
+/* Pastes the next piece of the text, starting the bracket before the first. */
+static void paste_piece(MinitermPaste *paste);
+/*
+ * Appends text to input the way vte pastes it, dropping control characters
+ * if bracketed.
+ */
+static void append_pastified(
+	GString *input, const char *text, size_t length, bool bracketed);
+/*
+ * Returns the length of the piece text, which is longer than PASTE_CHUNK_SIZE,
+ * starts with.
+ */
+static size_t get_piece_length(const char *text);
+
+MinitermPaste *
+miniterm_paste_new(
+	VteTerminal *vte, GtkOverlay *overlay, MinitermModes *modes)
+{
+	MinitermPaste *paste = g_new0(MinitermPaste, 1);
+	paste->vte = vte;
+	paste->modes = modes;
+	paste->text = g_string_new(NULL);
+
+	paste->bar = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 6);
+	g_object_ref(paste->bar);
+	gtk_style_context_add_class(gtk_widget_get_style_context(paste->bar),
+		GTK_STYLE_CLASS_BACKGROUND);
+	gtk_container_set_border_width(GTK_CONTAINER(paste->bar), 4);
+	gtk_widget_set_halign(paste->bar, GTK_ALIGN_END);
+	gtk_widget_set_valign(paste->bar, GTK_ALIGN_END);
+
+	paste->label = gtk_label_new(NULL);
+	gtk_container_add(GTK_CONTAINER(paste->bar), paste->label);
+	paste->progress = gtk_progress_bar_new();
+	gtk_widget_set_size_request(paste->progress, 120, -1);
+	gtk_widget_set_valign(paste->progress, GTK_ALIGN_CENTER);
+	gtk_container_add(GTK_CONTAINER(paste->bar), paste->progress);
+
+	/* Keep showing the window from showing the bar. */
+	gtk_widget_show_all(paste->bar);
+	gtk_widget_hide(paste->bar);
+	gtk_widget_set_no_show_all(paste->bar, TRUE);
+	gtk_overlay_add_overlay(overlay, paste->bar);
+	return paste;
+}
+
+void
+miniterm_paste_free(MinitermPaste *paste)
+{
+	/* The terminal is going away, don't send it the end. */
+	paste->bracketed = false;
+	miniterm_paste_cancel(paste);
+	for (GSList *l = paste->requests; l != NULL; l = l->next)
+		((Request *)l->data)->paste = NULL;
+	g_slist_free(paste->requests);
+	g_object_unref(paste->bar);
+	g_string_free(paste->text, TRUE);
+	g_free(paste);
+}
+
+void
+miniterm_paste_clipboard(MinitermPaste *paste, MinitermProxy *proxy)
+{
+	Request *request = g_new(Request, 1);
+	request->paste = paste;
+	request->proxy = proxy;
+	paste->requests = g_slist_append(paste->requests, request);
+	GtkClipboard *clipboard = gtk_widget_get_clipboard(
+		GTK_WIDGET(paste->vte), GDK_SELECTION_CLIPBOARD);
+	gtk_clipboard_request_text(clipboard, text_received_cb, request);
+}
+
+void
+miniterm_paste_cancel(MinitermPaste *paste)
+{
+	if (paste->proxy != NULL)
+		miniterm_proxy_wait_written(paste->proxy, NULL, NULL);
+	if (paste->progress_source != 0) {
+		g_source_remove(paste->progress_source);
+		paste->progress_source = 0;
+	}
+	if (paste->bracketed) {
+		vte_terminal_feed_child(paste->vte, "\033[201~", -1);
+		paste->bracketed = false;
+	}
+	paste->proxy = NULL;
+	g_string_truncate(paste->text, 0);
+	paste->offset = 0;
+	gtk_widget_hide(paste->bar);
+}
+
+bool
+miniterm_paste_is_active(MinitermPaste *paste)
+{
+	return paste->proxy != NULL;
+}
+
+static void
+text_received_cb(GtkClipboard *clipboard, const char *text, gpointer user_data)
+{
+	(void)clipboard;
+	Request *request = user_data;
+	MinitermPaste *paste = request->paste;
+	if (paste != NULL) {
+		paste->requests = g_slist_remove(paste->requests, request);
+		if (text != NULL && *text != '\0')
+			append_text(paste, text, request->proxy);
+	}
+	g_free(request);
+}
+
+static void
+append_text(MinitermPaste *paste, const char *text, MinitermProxy *proxy)
+{
+	g_string_append(paste->text, text);
+	if (paste->proxy != NULL) {
+		update_progress(paste);
+		return;
+	}
+	paste->proxy = proxy;
+	/*
+	 * The proxy's thread writes whatever the pty doesn't take at once, so
+	 * a piece only follows once the pty took everything before it, typed
+	 * input included. Otherwise the pieces would pile up in the proxy.
+	 */
+	miniterm_proxy_wait_written(proxy, written_cb, paste);
+	paste->progress_source =
+		g_timeout_add(PASTE_PROGRESS_DELAY, show_progress_cb, paste);
+}
+
+static void
+written_cb(bool written, gpointer user_data)
+{
+	MinitermPaste *paste = user_data;
+	/* The child is gone. */
+	if (!written) {
+		paste->bracketed = false;
+		miniterm_paste_cancel(paste);
+		return;
+	}
+	paste_piece(paste);
+	if (paste->offset == paste->text->len) {
+		miniterm_paste_cancel(paste);
+		return;
+	}
+	if (gtk_widget_get_visible(paste->bar))
+		update_progress(paste);
+	miniterm_proxy_wait_written(paste->proxy, written_cb, paste);
+}
+
+static gboolean
+show_progress_cb(gpointer user_data)
+{
+	MinitermPaste *paste = user_data;
+	paste->progress_source = 0;
+	update_progress(paste);
+	gtk_widget_show(paste->bar);
+	return G_SOURCE_REMOVE;
+}
+
+static void
+update_progress(MinitermPaste *paste)
+{
+	char *done = g_format_size(paste->offset);
+	char *total = g_format_size(paste->text->len);
+	char *text = g_strdup_printf(
+		"Pasting %s of %s, Escape cancels", done, total);
+	gtk_label_set_text(GTK_LABEL(paste->label), text);
+	gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(paste->progress),
+		(double)paste->offset / paste->text->len);
+	g_free(text);
+	g_free(total);
+	g_free(done);
+}
+
+static void
+paste_piece(MinitermPaste *paste)
+{
+	const char *start = paste->text->str + paste->offset;
+	size_t length = paste->text->len - paste->offset;
+	if (length > PASTE_CHUNK_SIZE)
+		length = get_piece_length(start);
+	GString *input = g_string_sized_new(length + 6);
+	if (paste->offset == 0
+		&& miniterm_modes_get_bracketed_paste(paste->modes)) {
+		g_string_append(input, "\033[200~");
+		paste->bracketed = true;
+	}
+	append_pastified(input, start, length, paste->bracketed);
+	vte_terminal_feed_child(paste->vte, input->str, input->len);
+	g_string_free(input, TRUE);
+	paste->offset += length;
+}
+
+static size_t
+get_piece_length(const char *text)
+{
+	/* Prefer whole lines. */
+	const char *newline = g_strrstr_len(text, PASTE_CHUNK_SIZE, "\n");
+	if (newline != NULL)
+		return newline + 1 - text;
+	/* Don't split a character, or a line break pasted as one. */
+	size_t length = PASTE_CHUNK_SIZE;
+	while ((text[length] & 0xc0) == 0x80)
+		--length;
+	if (text[length - 1] == '\r' && text[length] == '\n')
+		++length;
+	return length;
+}
+
+static void
+append_pastified(
+	GString *input, const char *text, size_t length, bool bracketed)
+{
+	for (size_t i = 0; i < length; ++i) {
+		const unsigned char c = text[i];
+		if (c == '\n') {
+			/* CR LF is one line break. */
+			if (i == 0 || text[i - 1] != '\r')
+				g_string_append_c(input, '\r');
+		} else if (!bracketed || c >= 0x20 || c == '\t' || c == '\r') {
+			g_string_append_c(input, c);
+		}
+	}
+}
@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) 2018 Jason Waataja
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef MINITERM_PASTE_H
+#define MINITERM_PASTE_H
+
+#include <gtk/gtk.h>
+#include <stdbool.h>
+#include <vte/vte.h>
+
+#include "modes.h"
+#include "proxy.h"
+
+/*
+ * Pastes the clipboard into a terminal a piece at a time, each time the pty
+ * took the previous piece from the proxy, so a paste of megabytes neither
+ * blocks the main loop nor piles up in front of a child that reads slowly.
+ * Line breaks are sent as carriage returns, like vte pastes them. If the child
+ * asked for bracketed paste when the paste starts, the whole paste is
+ * bracketed once and control characters that could end the bracket early are
+ * dropped. A progress bar is shown while a paste takes longer than
+ * PASTE_PROGRESS_DELAY.
+ */
+typedef struct _MinitermPaste MinitermPaste;
+
+/*
+ * Creates the hidden progress bar for vte at the bottom of overlay. The modes
+ * the child set tell whether to bracket pastes, and must outlive paste.
+ */
+MinitermPaste *miniterm_paste_new(
+	VteTerminal *vte, GtkOverlay *overlay, MinitermModes *modes);
+/* Frees paste, stopping a paste in progress. */
+void miniterm_paste_free(MinitermPaste *paste);
+/*
+ * Fetches the clipboard without waiting and pastes it through proxy, which
+ * writes the input of the terminal and must outlive paste. A paste in
+ * progress is finished first.
+ */
+void miniterm_paste_clipboard(MinitermPaste *paste, MinitermProxy *proxy);
+/* Drops what wasn't pasted yet, ending the bracket if one was started. */
+void miniterm_paste_cancel(MinitermPaste *paste);
+/* Returns whether a paste is in progress. */
+bool miniterm_paste_is_active(MinitermPaste *paste);
+
+#endif /* MINITERM_PASTE_H */
@@ -0,0 +1,529 @@
+/*
+ * Copyright (c) 2018 Jason Waataja
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+#include "proxy.h"
+
+#include <errno.h>
+#include <glib-unix.h>
+#include <math.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include "config.h"
+
+/* Most bytes taken from the pty at once. */
+#define READ_SIZE (64 * 1024)
+/* Most bytes passed to the output callback at once. */
+#define CHUNK_SIZE (16 * 1024)
+/* Milliseconds between checks whether a flood is over. */
+#define FLOOD_CHECK_INTERVAL 250
+
+struct _MinitermProxy {
+	int pty;
+	/* Written to wake the thread up. */
+	int wake_pipe[2];
+	GThread *thread;
+	MinitermProxyTeeFunc tee;
+	MinitermProxyOutputFunc output;
+	MinitermProxyFloodFunc flood;
+	MinitermProxyDrainFunc drained;
+	gpointer user_data;
+	/* Waits for the input to be written. NULL indicates none. */
+	MinitermProxyWrittenFunc written;
+	gpointer written_data;
+
+	/* The following are only used by the main thread. */
+	double flood_threshold;
+	bool flooding;
+	/* Set while no output is handed on. */
+	bool paused;
+	/* Timeout that checks whether the flood is over. 0 indicates none. */
+	unsigned int flood_source;
+	/* Output taken from the thread, handled up to pending_offset. */
+	GByteArray *pending;
+	size_t pending_offset;
+
+	/* The following are guarded by mutex. */
+	GMutex mutex;
+	/* Output read by the thread and not taken yet. */
+	GByteArray *read_buffer;
+	/* Bytes of pending not handled yet. */
+	size_t pending_length;
+	/* Input the pty didn't accept yet. */
+	GByteArray *write_buffer;
+	/* Set once input was dropped because the child is gone. */
+	bool input_lost;
+	/* Idle that calls written. 0 indicates none. */
+	unsigned int written_source;
+	/* Set while written waits for write_buffer to empty. */
+	bool waiting_written;
+	/* Read bytes averaged over about a second. */
+	double rate;
+	gint64 rate_time;
+	/* Idle that hands output to the main thread. 0 indicates none. */
+	unsigned int deliver_source;
+	/* Set while the thread waits for output to be handled. */
+	bool full;
+	/* Set by miniterm_proxy_drain() until drained is called. */
+	bool draining;
+	/* Set once nothing was left to read while draining. */
+	bool drained_pty;
+	/* Set while draining waits for the end of the pty. */
+	bool to_end;
+	/* Set when the pty reached its end, the thread exits then. */
+	bool eof;
+	bool stopping;
+};
+
+static gpointer proxy_thread(gpointer user_data);
+/* Reads once from the pty. Returns false at its end. */
+static bool read_output(MinitermProxy *proxy, char *buffer);
+static void write_input(MinitermProxy *proxy);
+static void wake_thread(MinitermProxy *proxy);
+/* Must be called with the mutex held. */
+static void schedule_deliver(MinitermProxy *proxy);
+static gboolean deliver_cb(gpointer user_data);
+/*
+ * Calls written if it waits and the input is written. Must be called with the
+ * mutex held.
+ */
+static void schedule_written(MinitermProxy *proxy);
+static gboolean written_cb(gpointer user_data);
+/* Moves the read output to pending once it is used up. */
+static void take_output(MinitermProxy *proxy);
+/* Compares the rate to the threshold and reports a change. */
+static void update_flooding(MinitermProxy *proxy);
+static gboolean flood_check_cb(gpointer user_data);
+/* Returns the rate decayed to now. Must be called with the mutex held. */
+static double get_rate(MinitermProxy *proxy, gint64 now);
+
+MinitermProxy *
+miniterm_proxy_new(int pty, double flood_threshold, MinitermProxyTeeFunc tee,
+	MinitermProxyOutputFunc output, MinitermProxyFloodFunc flood,
+	gpointer user_data)
+{
+	MinitermProxy *proxy = g_new0(MinitermProxy, 1);
+	proxy->wake_pipe[0] = proxy->wake_pipe[1] = -1;
+	GError *error = NULL;
+	if (!g_unix_open_pipe(proxy->wake_pipe, FD_CLOEXEC, &error)
+		|| !g_unix_set_fd_nonblocking(proxy->wake_pipe[0], TRUE, &error)
+		|| !g_unix_set_fd_nonblocking(proxy->wake_pipe[1], TRUE, &error)
+		|| !g_unix_set_fd_nonblocking(pty, TRUE, &error)) {
+		g_printerr("Failed to set up pty proxy: %s\n", error->message);
+		g_error_free(error);
+		if (proxy->wake_pipe[0] >= 0) {
+			close(proxy->wake_pipe[0]);
+			close(proxy->wake_pipe[1]);
+		}
+		g_free(proxy);
+		return NULL;
+	}
+	proxy->pty = pty;
+	proxy->tee = tee;
+	proxy->output = output;
+	proxy->flood = flood;
+	proxy->user_data = user_data;
+	proxy->flood_threshold = flood_threshold;
+	proxy->pending = g_byte_array_new();
+	g_mutex_init(&proxy->mutex);
+	proxy->read_buffer = g_byte_array_new();
+	proxy->write_buffer = g_byte_array_new();
+	proxy->rate_time = g_get_monotonic_time();
+	proxy->thread = g_thread_new("pty-proxy", proxy_thread, proxy);
+	return proxy;
+}
+
+void
+miniterm_proxy_free(MinitermProxy *proxy)
+{
+	g_mutex_lock(&proxy->mutex);
+	proxy->stopping = true;
+	g_mutex_unlock(&proxy->mutex);
+	wake_thread(proxy);
+	g_thread_join(proxy->thread);
+	if (proxy->deliver_source != 0)
+		g_source_remove(proxy->deliver_source);
+	if (proxy->flood_source != 0)
+		g_source_remove(proxy->flood_source);
+	if (proxy->written_source != 0)
+		g_source_remove(proxy->written_source);
+	close(proxy->wake_pipe[0]);
+	close(proxy->wake_pipe[1]);
+	g_mutex_clear(&proxy->mutex);
+	g_byte_array_unref(proxy->pending);
+	g_byte_array_unref(proxy->read_buffer);
+	g_byte_array_unref(proxy->write_buffer);
+	g_free(proxy);
+}
+
+void
+miniterm_proxy_write(MinitermProxy *proxy, const char *data, size_t length)
+{
+	g_mutex_lock(&proxy->mutex);
+	/* Don't overtake input that is already queued. */
+	if (proxy->write_buffer->len == 0) {
+		const ssize_t written = write(proxy->pty, data, length);
+		if (written > 0) {
+			data += written;
+			length -= written;
+		} else if (written < 0 && errno != EAGAIN && errno != EINTR) {
+			/* The child is gone. */
+			length = 0;
+			proxy->input_lost = true;
+		}
+	}
+	if (length > 0)
+		g_byte_array_append(
+			proxy->write_buffer, (const guint8 *)data, length);
+	schedule_written(proxy);
+	g_mutex_unlock(&proxy->mutex);
+	if (length > 0)
+		wake_thread(proxy);
+}
+
+void
+miniterm_proxy_wait_written(MinitermProxy *proxy,
+	MinitermProxyWrittenFunc written, gpointer user_data)
+{
+	proxy->written = written;
+	proxy->written_data = user_data;
+	g_mutex_lock(&proxy->mutex);
+	proxy->waiting_written = written != NULL;
+	schedule_written(proxy);
+	g_mutex_unlock(&proxy->mutex);
+}
+
+void
+miniterm_proxy_set_paused(MinitermProxy *proxy, bool paused)
+{
+	proxy->paused = paused;
+	if (paused)
+		return;
+	g_mutex_lock(&proxy->mutex);
+	schedule_deliver(proxy);
+	g_mutex_unlock(&proxy->mutex);
+}
+
+void
+miniterm_proxy_set_flood_threshold(MinitermProxy *proxy, double flood_threshold)
+{
+	proxy->flood_threshold = flood_threshold;
+	update_flooding(proxy);
+}
+
+bool
+miniterm_proxy_get_flooding(MinitermProxy *proxy)
+{
+	return proxy->flooding;
+}
+
+void
+miniterm_proxy_drain(MinitermProxy *proxy, MinitermProxyDrainFunc drained)
+{
+	proxy->drained = drained;
+	g_mutex_lock(&proxy->mutex);
+	proxy->draining = true;
+	proxy->drained_pty = false;
+	proxy->to_end = false;
+	/* Reports right away if the thread already reached the end. */
+	schedule_deliver(proxy);
+	g_mutex_unlock(&proxy->mutex);
+	wake_thread(proxy);
+}
+
+void
+miniterm_proxy_drain_to_end(
+	MinitermProxy *proxy, MinitermProxyDrainFunc drained)
+{
+	proxy->drained = drained;
+	g_mutex_lock(&proxy->mutex);
+	proxy->draining = true;
+	proxy->drained_pty = false;
+	proxy->to_end = true;
+	schedule_deliver(proxy);
+	g_mutex_unlock(&proxy->mutex);
+}
+
+static gpointer
+proxy_thread(gpointer user_data)
+{
+	MinitermProxy *proxy = user_data;
+	char *buffer = g_malloc(READ_SIZE);
+	bool open = true;
+	while (open) {
+		g_mutex_lock(&proxy->mutex);
+		if (proxy->stopping) {
+			g_mutex_unlock(&proxy->mutex);
+			break;
+		}
+		const bool full = proxy->read_buffer->len
+				+ proxy->pending_length
+			>= PROXY_BUFFER_SIZE;
+		proxy->full = full;
+		const bool writing = proxy->write_buffer->len > 0;
+		const bool draining = proxy->draining && !proxy->drained_pty
+			&& !proxy->to_end;
+		g_mutex_unlock(&proxy->mutex);
+
+		/*
+		 * Stop reading while the buffer is full, the child then blocks
+		 * on the full pty until the main thread catches up.
+		 */
+		const short events =
+			(full ? 0 : POLLIN) | (writing ? POLLOUT : 0);
+		struct pollfd fds[2] = {
+			{events != 0 ? proxy->pty : -1, events, 0},
+			{proxy->wake_pipe[0], POLLIN, 0},
+		};
+		/* While draining, a timeout means nothing is left to read. */
+		const int ready = poll(fds, 2, draining && !full ? 0 : -1);
+		if (ready < 0 && errno != EINTR) {
+			g_mutex_lock(&proxy->mutex);
+			proxy->eof = true;
+			schedule_deliver(proxy);
+			g_mutex_unlock(&proxy->mutex);
+			break;
+		}
+		if (fds[1].revents & POLLIN) {
+			char discard[64];
+			while (read(proxy->wake_pipe[0], discard,
+				       sizeof(discard))
+				> 0)
+				;
+		}
+		if (fds[0].revents & POLLOUT)
+			write_input(proxy);
+		if (fds[0].revents & (POLLIN | POLLHUP | POLLERR) && !full) {
+			open = read_output(proxy, buffer);
+		} else if (draining && ready == 0) {
+			g_mutex_lock(&proxy->mutex);
+			proxy->drained_pty = true;
+			schedule_deliver(proxy);
+			g_mutex_unlock(&proxy->mutex);
+		}
+	}
+	g_free(buffer);
+	return NULL;
+}
+
+static bool
+read_output(MinitermProxy *proxy, char *buffer)
+{
+	const ssize_t length = read(proxy->pty, buffer, READ_SIZE);
+	if (length < 0 && (errno == EAGAIN || errno == EINTR))
+		return true;
+	if (length > 0 && proxy->tee != NULL)
+		proxy->tee(buffer, length, proxy->user_data);
+	const gint64 now = g_get_monotonic_time();
+	g_mutex_lock(&proxy->mutex);
+	if (length > 0) {
+		g_byte_array_append(
+			proxy->read_buffer, (const guint8 *)buffer, length);
+		/* An exponential moving average needs no timer to age. */
+		proxy->rate = get_rate(proxy, now) + length;
+		proxy->rate_time = now;
+	} else {
+		/* The slave was closed, Linux reports that as EIO. */
+		proxy->eof = true;
+	}
+	schedule_deliver(proxy);
+	g_mutex_unlock(&proxy->mutex);
+	return length > 0;
+}
+
+static void
+write_input(MinitermProxy *proxy)
+{
+	g_mutex_lock(&proxy->mutex);
+	GByteArray *input = proxy->write_buffer;
+	const ssize_t written = write(proxy->pty, input->data, input->len);
+	if (written > 0) {
+		g_byte_array_remove_range(input, 0, written);
+	} else if (written < 0 && errno != EAGAIN && errno != EINTR) {
+		g_byte_array_set_size(input, 0);
+		proxy->input_lost = true;
+	}
+	schedule_written(proxy);
+	g_mutex_unlock(&proxy->mutex);
+}
+
+static void
+wake_thread(MinitermProxy *proxy)
+{
+	/* A full pipe already wakes the thread. */
+	const char byte = 0;
+	if (write(proxy->wake_pipe[1], &byte, 1) < 0)
+		return;
+}
+
+static void
+schedule_deliver(MinitermProxy *proxy)
+{
+	if (proxy->deliver_source != 0)
+		return;
+	/* Below input and drawing, at the priority vte reads its pty at. */
+	GSource *source = g_idle_source_new();
+	g_source_set_priority(source, G_PRIORITY_DEFAULT_IDLE);
+	g_source_set_callback(source, deliver_cb, proxy, NULL);
+	proxy->deliver_source = g_source_attach(source, NULL);
+	g_source_unref(source);
+}
+
+static void
+schedule_written(MinitermProxy *proxy)
+{
+	if (!proxy->waiting_written || proxy->write_buffer->len > 0
+		|| proxy->written_source != 0)
+		return;
+	proxy->written_source = g_idle_add(written_cb, proxy);
+}
+
+static gboolean
+written_cb(gpointer user_data)
+{
+	MinitermProxy *proxy = user_data;
+	g_mutex_lock(&proxy->mutex);
+	proxy->written_source = 0;
+	/* More input may have been queued since. */
+	const bool done =
+		proxy->waiting_written && proxy->write_buffer->len == 0;
+	if (done)
+		proxy->waiting_written = false;
+	const bool lost = proxy->input_lost;
+	g_mutex_unlock(&proxy->mutex);
+	if (done) {
+		/* This may wait again. */
+		MinitermProxyWrittenFunc written = proxy->written;
+		proxy->written = NULL;
+		written(!lost, proxy->written_data);
+	}
+	return G_SOURCE_REMOVE;
+}
+
+static gboolean
+deliver_cb(gpointer user_data)
+{
+	MinitermProxy *proxy = user_data;
+	/* Leave the main loop to events and drawing between slices. */
+	const gint64 deadline =
+		g_get_monotonic_time() + PROXY_TIME_SLICE * 1000;
+	do {
+		take_output(proxy);
+		/* The output callback may have paused. */
+		if (proxy->paused
+			|| proxy->pending_offset == proxy->pending->len)
+			break;
+		const size_t length =
+			MIN(proxy->pending->len - proxy->pending_offset,
+				CHUNK_SIZE);
+		proxy->output((const char *)proxy->pending->data
+				+ proxy->pending_offset,
+			length, proxy->user_data);
+		proxy->pending_offset += length;
+		g_mutex_lock(&proxy->mutex);
+		proxy->pending_length -= length;
+		const bool resume = proxy->full;
+		proxy->full = false;
+		g_mutex_unlock(&proxy->mutex);
+		if (resume)
+			wake_thread(proxy);
+	} while (g_get_monotonic_time() < deadline);
+	update_flooding(proxy);
+
+	take_output(proxy);
+	g_mutex_lock(&proxy->mutex);
+	const bool done = proxy->pending_offset == proxy->pending->len
+		&& proxy->read_buffer->len == 0;
+	bool drained = false;
+	/* Resuming schedules delivery again, and finishes a drain. */
+	if (proxy->paused) {
+		proxy->deliver_source = 0;
+		g_mutex_unlock(&proxy->mutex);
+		return G_SOURCE_REMOVE;
+	}
+	if (done) {
+		proxy->deliver_source = 0;
+		drained = proxy->draining
+			&& (proxy->drained_pty || proxy->eof);
+		if (drained)
+			proxy->draining = false;
+	}
+	g_mutex_unlock(&proxy->mutex);
+	/* This may free the proxy. */
+	if (drained && proxy->drained != NULL)
+		proxy->drained(proxy->user_data);
+	return done ? G_SOURCE_REMOVE : G_SOURCE_CONTINUE;
+}
+
+static void
+take_output(MinitermProxy *proxy)
+{
+	if (proxy->pending_offset < proxy->pending->len)
+		return;
+	/* Swap the buffers so the thread can read on while this is handled. */
+	g_byte_array_set_size(proxy->pending, 0);
+	proxy->pending_offset = 0;
+	g_mutex_lock(&proxy->mutex);
+	GByteArray *read_buffer = proxy->read_buffer;
+	proxy->read_buffer = proxy->pending;
+	proxy->pending = read_buffer;
+	proxy->pending_length = read_buffer->len;
+	g_mutex_unlock(&proxy->mutex);
+}
+
+static void
+update_flooding(MinitermProxy *proxy)
+{
+	g_mutex_lock(&proxy->mutex);
+	const double rate = get_rate(proxy, g_get_monotonic_time());
+	g_mutex_unlock(&proxy->mutex);
+	/* End the flood well below the threshold, so it doesn't flicker. */
+	const double threshold = proxy->flooding ? proxy->flood_threshold / 2
+						 : proxy->flood_threshold;
+	const bool flooding = proxy->flood_threshold > 0 && rate > threshold;
+	/* The rate has to be checked again even if no more output comes. */
+	if (flooding && proxy->flood_source == 0)
+		proxy->flood_source = g_timeout_add(
+			FLOOD_CHECK_INTERVAL, flood_check_cb, proxy);
+	if (flooding == proxy->flooding)
+		return;
+	proxy->flooding = flooding;
+	if (proxy->flood != NULL)
+		proxy->flood(flooding, proxy->user_data);
+}
+
+static gboolean
+flood_check_cb(gpointer user_data)
+{
+	MinitermProxy *proxy = user_data;
+	proxy->flood_source = 0;
+	update_flooding(proxy);
+	return G_SOURCE_REMOVE;
+}
+
+static double
+get_rate(MinitermProxy *proxy, gint64 now)
+{
+	const double elapsed = (now - proxy->rate_time) / 1e6;
+	return proxy->rate * exp(-elapsed);
+}
@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) 2018 Jason Waataja
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+#ifndef MINITERM_PROXY_H
+#define MINITERM_PROXY_H
+
+#include <glib.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * The proxy reads a pty on a worker thread instead of letting vte read it, and
+ * hands the output to the main thread in time-limited slices. At most
+ * PROXY_BUFFER_SIZE bytes are buffered, so a child flooding the terminal is
+ * stopped by the full pty rather than running far ahead of what was shown, and
+ * input such as Ctrl+C reaches it right away.
+ */
+typedef struct _MinitermProxy MinitermProxy;
+
+/*
+ * Called on the proxy's thread with output as soon as it is read. It may block,
+ * which only holds up reading.
+ */
+typedef void (*MinitermProxyTeeFunc)(
+	const char *data, size_t length, gpointer user_data);
+/* Called on the main thread with output read from the pty. */
+typedef void (*MinitermProxyOutputFunc)(
+	const char *data, size_t length, gpointer user_data);
+/* Called on the main thread when the pty starts or stops flooding. */
+typedef void (*MinitermProxyFloodFunc)(bool flooding, gpointer user_data);
+/* Called on the main thread once the output of an exited child is handled. */
+typedef void (*MinitermProxyDrainFunc)(gpointer user_data);
+/*
+ * Called on the main thread once queued input is written. written is false if
+ * the child is gone and the input was dropped.
+ */
+typedef void (*MinitermProxyWrittenFunc)(bool written, gpointer user_data);
+
+/*
+ * Starts reading the pty master, which must stay open until the proxy is freed.
+ * The pty is considered flooding while more than flood_threshold bytes per
+ * second are read, a threshold of 0 disables that. The tee and flood callbacks
+ * may be NULL.
+ */
+MinitermProxy *miniterm_proxy_new(int pty, double flood_threshold,
+	MinitermProxyTeeFunc tee, MinitermProxyOutputFunc output,
+	MinitermProxyFloodFunc flood, gpointer user_data);
+/* Stops the thread. Output not handled yet is dropped. */
+void miniterm_proxy_free(MinitermProxy *proxy);
+/*
+ * Writes input to the pty. It is written right away if the pty accepts it,
+ * otherwise it is queued ahead of reading more output.
+ */
+void miniterm_proxy_write(
+	MinitermProxy *proxy, const char *data, size_t length);
+/*
+ * Calls written once the pty took all input written so far, replacing a
+ * callback that wasn't called yet. A NULL callback only removes that one.
+ */
+void miniterm_proxy_wait_written(MinitermProxy *proxy,
+	MinitermProxyWrittenFunc written, gpointer user_data);
+/*
+ * Holds back output while paused. The pty is read on until the buffer is full,
+ * and a drain only finishes once the proxy is resumed.
+ */
+void miniterm_proxy_set_paused(MinitermProxy *proxy, bool paused);
+void miniterm_proxy_set_flood_threshold(
+	MinitermProxy *proxy, double flood_threshold);
+bool miniterm_proxy_get_flooding(MinitermProxy *proxy);
+/*
+ * Calls drained once everything the child wrote before exiting has been passed
+ * to the output callback. The proxy may be freed from drained.
+ */
+void miniterm_proxy_drain(MinitermProxy *proxy, MinitermProxyDrainFunc drained);
+/*
+ * Like miniterm_proxy_drain(), but waits for the pty to reach its end, once
+ * nothing holds its slave open any more. For a child whose exit can't be
+ * reported.
+ */
+void miniterm_proxy_drain_to_end(
+	MinitermProxy *proxy, MinitermProxyDrainFunc drained);
+
+#endif /* MINITERM_PROXY_H */
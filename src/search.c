@@ -0,0 +1,614 @@
+/*
+ * Copyright (c) 2018 Jason Waataja
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "search.h"
+
+#include <string.h>
+
+#include "config.h"
+
+/* Rows searched between checks of the time slice. */
+#define CHUNK_ROWS 64
+
+typedef struct {
+	glong row;
+	/* The end column is exclusive. */
+	glong start_column;
+	glong end_column;
+} Match;
+
+struct _MinitermSearch {
+	VteTerminal *vte;
+	GtkWidget *bar;
+	GtkWidget *entry;
+	GtkWidget *regex_button;
+	GtkWidget *count_label;
+	/* NULL if there is nothing to search for. */
+	GRegex *regex;
+	/* Matches in the order of their positions. */
+	GArray *matches;
+	/* Rows before this one were searched. */
+	glong indexed_end;
+	/* Column count the rows were searched at. */
+	glong columns;
+	/* Idle that searches the remaining rows. 0 indicates none. */
+	unsigned int index_source;
+	/*
+	 * The position of the selected match, which stays put while the rows
+	 * around it are searched again.
+	 */
+	bool selected;
+	Match current;
+};
+
+static void search_changed_cb(GtkSearchEntry *entry, gpointer user_data);
+static void regex_toggled_cb(GtkToggleButton *button, gpointer user_data);
+static void stop_search_cb(GtkSearchEntry *entry, gpointer user_data);
+static void next_match_cb(GtkSearchEntry *entry, gpointer user_data);
+static void previous_match_cb(GtkSearchEntry *entry, gpointer user_data);
+static gboolean entry_key_press_cb(
+	GtkWidget *widget, GdkEventKey *event, gpointer user_data);
+static void contents_changed_cb(VteTerminal *vte, gpointer user_data);
+static void size_allocate_cb(
+	GtkWidget *widget, GdkRectangle *allocation, gpointer user_data);
+static void char_size_changed_cb(
+	VteTerminal *vte, guint width, guint height, gpointer user_data);
+static gboolean draw_cb(GtkWidget *widget, cairo_t *cr, gpointer user_data);
+/* Compiles the query and searches the scrollback again. */
+static void update_regex(MinitermSearch *search);
+static void clear_matches(MinitermSearch *search);
+/* Throws the matches away and searches all rows again. */
+static void reindex(MinitermSearch *search);
+/*
+ * Reindexes if the column count changed, since rewrapping moves every row.
+ * Returns whether it did.
+ */
+static bool check_columns(MinitermSearch *search);
+static void schedule_index(MinitermSearch *search);
+static gboolean index_cb(gpointer user_data);
+static void search_row(MinitermSearch *search, glong row, glong columns);
+/* Returns the text of row without its line break. */
+static char *get_row_text(VteTerminal *vte, glong row, glong columns);
+/* Returns the number of columns the characters from start to end take. */
+static glong count_columns(const char *start, const char *end);
+/*
+ * Gets the first row still in the scrollback, the first row on the screen and
+ * the row past the end of the screen.
+ */
+static void get_rows(
+	MinitermSearch *search, glong *first, glong *screen, glong *end);
+/* Returns the index of the first match at or after row and column. */
+static guint find_match(MinitermSearch *search, glong row, glong column);
+/* Selects the match offset matches away from the selected one, wrapping. */
+static void step(MinitermSearch *search, int offset);
+static void update_count(MinitermSearch *search);
+/* Returns whether text would match differently without ignoring case. */
+static bool has_upper(const char *text);
+
+MinitermSearch *
+miniterm_search_new(VteTerminal *vte, GtkOverlay *overlay)
+{
+	MinitermSearch *search = g_new0(MinitermSearch, 1);
+	search->vte = vte;
+	search->matches = g_array_new(FALSE, FALSE, sizeof(Match));
+	search->columns = vte_terminal_get_column_count(vte);
+
+	search->bar = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 6);
+	g_object_ref(search->bar);
+	gtk_style_context_add_class(gtk_widget_get_style_context(search->bar),
+		GTK_STYLE_CLASS_BACKGROUND);
+	gtk_container_set_border_width(GTK_CONTAINER(search->bar), 4);
+	gtk_widget_set_halign(search->bar, GTK_ALIGN_END);
+	gtk_widget_set_valign(search->bar, GTK_ALIGN_START);
+
+	search->entry = gtk_search_entry_new();
+	gtk_entry_set_width_chars(GTK_ENTRY(search->entry), 24);
+	gtk_container_add(GTK_CONTAINER(search->bar), search->entry);
+	search->count_label = gtk_label_new(NULL);
+	gtk_label_set_width_chars(GTK_LABEL(search->count_label), 10);
+	gtk_container_add(GTK_CONTAINER(search->bar), search->count_label);
+	search->regex_button = gtk_toggle_button_new_with_label(".*");
+	gtk_widget_set_tooltip_text(
+		search->regex_button, "Regular expression");
+	gtk_widget_set_focus_on_click(search->regex_button, FALSE);
+	gtk_container_add(GTK_CONTAINER(search->bar), search->regex_button);
+
+	g_signal_connect(search->entry, "search-changed",
+		G_CALLBACK(search_changed_cb), search);
+	g_signal_connect(search->entry, "stop-search",
+		G_CALLBACK(stop_search_cb), search);
+	g_signal_connect(search->entry, "next-match",
+		G_CALLBACK(next_match_cb), search);
+	g_signal_connect(search->entry, "previous-match",
+		G_CALLBACK(previous_match_cb), search);
+	g_signal_connect(search->entry, "key-press-event",
+		G_CALLBACK(entry_key_press_cb), search);
+	g_signal_connect(search->regex_button, "toggled",
+		G_CALLBACK(regex_toggled_cb), search);
+	g_signal_connect(vte, "contents-changed",
+		G_CALLBACK(contents_changed_cb), search);
+	g_signal_connect_after(vte, "size-allocate",
+		G_CALLBACK(size_allocate_cb), search);
+	g_signal_connect(vte, "char-size-changed",
+		G_CALLBACK(char_size_changed_cb), search);
+	g_signal_connect_after(vte, "draw", G_CALLBACK(draw_cb), search);
+
+	/* Keep showing the window from showing the bar. */
+	gtk_widget_show_all(search->bar);
+	gtk_widget_hide(search->bar);
+	gtk_widget_set_no_show_all(search->bar, TRUE);
+	gtk_overlay_add_overlay(overlay, search->bar);
+	return search;
+}
+
+void
+miniterm_search_free(MinitermSearch *search)
+{
+	if (search->index_source != 0)
+		g_source_remove(search->index_source);
+	g_signal_handlers_disconnect_by_data(search->vte, search);
+	g_signal_handlers_disconnect_by_data(search->entry, search);
+	g_signal_handlers_disconnect_by_data(search->regex_button, search);
+	g_object_unref(search->bar);
+	if (search->regex != NULL)
+		g_regex_unref(search->regex);
+	g_array_free(search->matches, TRUE);
+	g_free(search);
+}
+
+void
+miniterm_search_show(MinitermSearch *search)
+{
+	if (!gtk_widget_get_visible(search->bar)) {
+		gtk_widget_show(search->bar);
+		update_regex(search);
+	}
+	gtk_widget_grab_focus(search->entry);
+}
+
+void
+miniterm_search_hide(MinitermSearch *search)
+{
+	if (!gtk_widget_get_visible(search->bar))
+		return;
+	gtk_widget_hide(search->bar);
+	clear_matches(search);
+	if (search->regex != NULL) {
+		g_regex_unref(search->regex);
+		search->regex = NULL;
+	}
+	gtk_widget_grab_focus(GTK_WIDGET(search->vte));
+	gtk_widget_queue_draw(GTK_WIDGET(search->vte));
+}
+
+bool
+miniterm_search_is_active(MinitermSearch *search)
+{
+	return gtk_widget_get_visible(search->bar);
+}
+
+static void
+search_changed_cb(GtkSearchEntry *entry, gpointer user_data)
+{
+	(void)entry;
+	update_regex(user_data);
+}
+
+static void
+regex_toggled_cb(GtkToggleButton *button, gpointer user_data)
+{
+	(void)button;
+	update_regex(user_data);
+}
+
+static void
+stop_search_cb(GtkSearchEntry *entry, gpointer user_data)
+{
+	(void)entry;
+	miniterm_search_hide(user_data);
+}
+
+static void
+next_match_cb(GtkSearchEntry *entry, gpointer user_data)
+{
+	(void)entry;
+	step(user_data, 1);
+}
+
+static void
+previous_match_cb(GtkSearchEntry *entry, gpointer user_data)
+{
+	(void)entry;
+	step(user_data, -1);
+}
+
+static gboolean
+entry_key_press_cb(GtkWidget *widget, GdkEventKey *event, gpointer user_data)
+{
+	(void)widget;
+	if (event->keyval != GDK_KEY_Return
+		&& event->keyval != GDK_KEY_KP_Enter)
+		return FALSE;
+	/* Searching starts at the newest output, so go up by default. */
+	const guint modifiers =
+		event->state & gtk_accelerator_get_default_mod_mask();
+	step(user_data, modifiers == GDK_SHIFT_MASK ? 1 : -1);
+	return TRUE;
+}
+
+static void
+contents_changed_cb(VteTerminal *vte, gpointer user_data)
+{
+	(void)vte;
+	MinitermSearch *search = user_data;
+	if (search->regex == NULL || check_columns(search))
+		return;
+	glong first, screen, end;
+	get_rows(search, &first, &screen, &end);
+	/* Rows dropped from the top of the scrollback take their matches. */
+	const guint dropped = find_match(search, first, 0);
+	if (dropped > 0)
+		g_array_remove_range(search->matches, 0, dropped);
+	/*
+	 * Rows in the scrollback only change when they are rewrapped, which
+	 * check_columns() handles, so only the screen has to be searched again.
+	 */
+	screen = MIN(screen, end);
+	if (search->indexed_end > screen) {
+		g_array_set_size(
+			search->matches, find_match(search, screen, 0));
+		search->indexed_end = screen;
+	}
+	schedule_index(search);
+}
+
+static void
+size_allocate_cb(
+	GtkWidget *widget, GdkRectangle *allocation, gpointer user_data)
+{
+	(void)widget;
+	(void)allocation;
+	MinitermSearch *search = user_data;
+	if (search->regex != NULL)
+		check_columns(search);
+}
+
+static void
+char_size_changed_cb(
+	VteTerminal *vte, guint width, guint height, gpointer user_data)
+{
+	(void)vte;
+	(void)width;
+	(void)height;
+	MinitermSearch *search = user_data;
+	if (search->regex != NULL)
+		reindex(search);
+}
+
+static gboolean
+draw_cb(GtkWidget *widget, cairo_t *cr, gpointer user_data)
+{
+	MinitermSearch *search = user_data;
+	if (search->matches->len == 0)
+		return FALSE;
+	VteTerminal *vte = search->vte;
+	const glong top = (glong)gtk_adjustment_get_value(
+		gtk_scrollable_get_vadjustment(GTK_SCROLLABLE(vte)));
+	const glong rows = vte_terminal_get_row_count(vte);
+	const glong width = vte_terminal_get_char_width(vte);
+	const glong height = vte_terminal_get_char_height(vte);
+	GtkStyleContext *context = gtk_widget_get_style_context(widget);
+	GtkBorder padding;
+	gtk_style_context_get_padding(
+		context, gtk_style_context_get_state(context), &padding);
+	for (guint i = find_match(search, top, 0); i < search->matches->len;
+		i++) {
+		const Match *match = &g_array_index(search->matches, Match, i);
+		if (match->row >= top + rows)
+			break;
+		const bool current = search->selected
+			&& match->row == search->current.row
+			&& match->start_column == search->current.start_column;
+		cairo_set_source_rgba(cr, 1.0, 0.75, 0.0, current ? 0.7 : 0.3);
+		cairo_rectangle(cr, padding.left + match->start_column * width,
+			padding.top + (match->row - top) * height,
+			(match->end_column - match->start_column) * width,
+			height);
+		cairo_fill(cr);
+	}
+	return FALSE;
+}
+
+static void
+update_regex(MinitermSearch *search)
+{
+	clear_matches(search);
+	search->columns = vte_terminal_get_column_count(search->vte);
+	if (search->regex != NULL) {
+		g_regex_unref(search->regex);
+		search->regex = NULL;
+	}
+	GtkStyleContext *context = gtk_widget_get_style_context(search->entry);
+	gtk_style_context_remove_class(context, GTK_STYLE_CLASS_ERROR);
+	gtk_widget_set_tooltip_text(search->entry, NULL);
+	gtk_widget_queue_draw(GTK_WIDGET(search->vte));
+
+	const char *text = gtk_entry_get_text(GTK_ENTRY(search->entry));
+	if (*text == '\0') {
+		update_count(search);
+		return;
+	}
+	const bool is_regex = gtk_toggle_button_get_active(
+		GTK_TOGGLE_BUTTON(search->regex_button));
+	char *pattern =
+		is_regex ? g_strdup(text) : g_regex_escape_string(text, -1);
+	/* Like less, only care about case once the query has capitals. */
+	GRegexCompileFlags flags = G_REGEX_OPTIMIZE;
+	if (!has_upper(text))
+		flags |= G_REGEX_CASELESS;
+	GError *error = NULL;
+	search->regex =
+		g_regex_new(pattern, flags, G_REGEX_MATCH_NOTEMPTY, &error);
+	g_free(pattern);
+	if (search->regex == NULL) {
+		gtk_style_context_add_class(context, GTK_STYLE_CLASS_ERROR);
+		gtk_widget_set_tooltip_text(search->entry, error->message);
+		g_error_free(error);
+		update_count(search);
+		return;
+	}
+	schedule_index(search);
+	update_count(search);
+}
+
+static void
+clear_matches(MinitermSearch *search)
+{
+	if (search->index_source != 0) {
+		g_source_remove(search->index_source);
+		search->index_source = 0;
+	}
+	g_array_set_size(search->matches, 0);
+	search->indexed_end = 0;
+	search->selected = false;
+}
+
+static void
+reindex(MinitermSearch *search)
+{
+	search->columns = vte_terminal_get_column_count(search->vte);
+	clear_matches(search);
+	schedule_index(search);
+	update_count(search);
+	gtk_widget_queue_draw(GTK_WIDGET(search->vte));
+}
+
+static bool
+check_columns(MinitermSearch *search)
+{
+	if (vte_terminal_get_column_count(search->vte) == search->columns)
+		return false;
+	reindex(search);
+	return true;
+}
+
+static void
+schedule_index(MinitermSearch *search)
+{
+	if (search->index_source != 0)
+		return;
+	/* Yield to output and drawing, other windows included. */
+	search->index_source =
+		g_idle_add_full(G_PRIORITY_LOW, index_cb, search, NULL);
+}
+
+static gboolean
+index_cb(gpointer user_data)
+{
+	MinitermSearch *search = user_data;
+	const gint64 deadline =
+		g_get_monotonic_time() + SEARCH_TIME_SLICE * 1000;
+	const guint count = search->matches->len;
+	glong first, screen, end;
+	get_rows(search, &first, &screen, &end);
+	search->indexed_end = MAX(search->indexed_end, first);
+	const glong columns = vte_terminal_get_column_count(search->vte);
+	while (search->indexed_end < end
+		&& g_get_monotonic_time() < deadline) {
+		const glong chunk_end =
+			MIN(search->indexed_end + CHUNK_ROWS, end);
+		for (; search->indexed_end < chunk_end; search->indexed_end++)
+			search_row(search, search->indexed_end, columns);
+	}
+	if (search->indexed_end < end) {
+		update_count(search);
+		if (search->matches->len != count)
+			gtk_widget_queue_draw(GTK_WIDGET(search->vte));
+		return G_SOURCE_CONTINUE;
+	}
+	search->index_source = 0;
+	update_count(search);
+	if (search->matches->len != count)
+		gtk_widget_queue_draw(GTK_WIDGET(search->vte));
+	return G_SOURCE_REMOVE;
+}
+
+static void
+search_row(MinitermSearch *search, glong row, glong columns)
+{
+	char *text = get_row_text(search->vte, row, columns);
+	if (text == NULL)
+		return;
+	GMatchInfo *info = NULL;
+	g_regex_match(search->regex, text, 0, &info);
+	const char *position = text;
+	glong column = 0;
+	while (g_match_info_matches(info)) {
+		int start, end;
+		g_match_info_fetch_pos(info, 0, &start, &end);
+		Match match = {.row = row};
+		column += count_columns(position, text + start);
+		match.start_column = column;
+		column += count_columns(text + start, text + end);
+		match.end_column = column;
+		position = text + end;
+		g_array_append_val(search->matches, match);
+		g_match_info_next(info, NULL);
+	}
+	g_match_info_free(info);
+	g_free(text);
+}
+
+static char *
+get_row_text(VteTerminal *vte, glong row, glong columns)
+{
+#if VTE_CHECK_VERSION(0, 72, 0)
+	char *text = vte_terminal_get_text_range_format(
+		vte, VTE_FORMAT_TEXT, row, 0, row, columns, NULL);
+#else
+	char *text = vte_terminal_get_text_range(
+		vte, row, 0, row, columns - 1, NULL, NULL, NULL);
+#endif
+	if (text == NULL)
+		return NULL;
+	const size_t length = strlen(text);
+	if (length > 0 && text[length - 1] == '\n')
+		text[length - 1] = '\0';
+	return text;
+}
+
+static glong
+count_columns(const char *start, const char *end)
+{
+	glong columns = 0;
+	for (const char *p = start; p < end; p = g_utf8_next_char(p)) {
+		const gunichar c = g_utf8_get_char(p);
+		if (g_unichar_iswide(c))
+			columns += 2;
+		else if (!g_unichar_iszerowidth(c))
+			columns++;
+	}
+	return columns;
+}
+
+static void
+get_rows(MinitermSearch *search, glong *first, glong *screen, glong *end)
+{
+	GtkAdjustment *adjustment =
+		gtk_scrollable_get_vadjustment(GTK_SCROLLABLE(search->vte));
+	*first = (glong)gtk_adjustment_get_lower(adjustment);
+	*end = (glong)gtk_adjustment_get_upper(adjustment);
+	*screen = MAX(*end - vte_terminal_get_row_count(search->vte), *first);
+}
+
+static guint
+find_match(MinitermSearch *search, glong row, glong column)
+{
+	guint low = 0;
+	guint high = search->matches->len;
+	while (low < high) {
+		const guint middle = low + (high - low) / 2;
+		const Match *match =
+			&g_array_index(search->matches, Match, middle);
+		if (match->row < row
+			|| (match->row == row && match->start_column < column))
+			low = middle + 1;
+		else
+			high = middle;
+	}
+	return low;
+}
+
+static void
+step(MinitermSearch *search, int offset)
+{
+	const guint count = search->matches->len;
+	if (count == 0)
+		return;
+	VteTerminal *vte = search->vte;
+	GtkAdjustment *adjustment =
+		gtk_scrollable_get_vadjustment(GTK_SCROLLABLE(vte));
+	const glong top = (glong)gtk_adjustment_get_value(adjustment);
+	const glong rows = vte_terminal_get_row_count(vte);
+	/* Without a selection, start from the edge of the view. */
+	guint index;
+	if (offset < 0) {
+		index = search->selected
+			? find_match(search, search->current.row,
+				search->current.start_column)
+			: find_match(search, top + rows, 0);
+		index = index == 0 ? count - 1 : index - 1;
+	} else {
+		index = search->selected
+			? find_match(search, search->current.row,
+				search->current.start_column + 1)
+			: find_match(search, top, 0);
+		if (index == count)
+			index = 0;
+	}
+	search->current = g_array_index(search->matches, Match, index);
+	search->selected = true;
+	if (search->current.row < top || search->current.row >= top + rows)
+		gtk_adjustment_set_value(
+			adjustment, search->current.row - rows / 2);
+	update_count(search);
+	gtk_widget_queue_draw(GTK_WIDGET(vte));
+}
+
+static void
+update_count(MinitermSearch *search)
+{
+	GtkLabel *label = GTK_LABEL(search->count_label);
+	if (search->regex == NULL) {
+		const char *text = gtk_entry_get_text(GTK_ENTRY(search->entry));
+		gtk_label_set_text(label, *text == '\0' ? "" : "Invalid");
+		return;
+	}
+	/* The count is a lower bound until the whole scrollback is searched. */
+	const char *more = search->index_source != 0 ? "+" : "";
+	const guint count = search->matches->len;
+	char *text;
+	const guint index = search->selected
+		? find_match(search, search->current.row,
+			search->current.start_column)
+		: count;
+	const Match *match = index < count
+		? &g_array_index(search->matches, Match, index)
+		: NULL;
+	if (match != NULL && match->row == search->current.row
+		&& match->start_column == search->current.start_column)
+		text = g_strdup_printf("%u/%u%s", index + 1, count, more);
+	else
+		text = g_strdup_printf("%u%s", count, more);
+	gtk_label_set_text(label, text);
+	g_free(text);
+}
+
+static bool
+has_upper(const char *text)
+{
+	for (const char *p = text; *p != '\0'; p = g_utf8_next_char(p)) {
+		if (g_unichar_isupper(g_utf8_get_char(p)))
+			return true;
+	}
+	return false;
+}
@@ -0,0 +1,49 @@
+/*
+ * Copyright (c) 2018 Jason Waataja
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef MINITERM_SEARCH_H
+#define MINITERM_SEARCH_H
+
+#include <gtk/gtk.h>
+#include <stdbool.h>
+#include <vte/vte.h>
+
+/*
+ * A search bar over the scrollback of a terminal. Matches are indexed a few
+ * rows at a time while the main loop is idle, so a long scrollback never
+ * blocks it, and the index is kept up to date as output arrives. All matches
+ * on screen are highlighted.
+ */
+typedef struct _MinitermSearch MinitermSearch;
+
+/* Creates a hidden search bar for vte at the top of overlay. */
+MinitermSearch *miniterm_search_new(VteTerminal *vte, GtkOverlay *overlay);
+/* Frees search. The bar itself is destroyed along with overlay. */
+void miniterm_search_free(MinitermSearch *search);
+/* Shows the bar and moves the focus to it. */
+void miniterm_search_show(MinitermSearch *search);
+/* Hides the bar and forgets the matches. */
+void miniterm_search_hide(MinitermSearch *search);
+/* Returns whether the bar is shown. */
+bool miniterm_search_is_active(MinitermSearch *search);
+
+#endif /* MINITERM_SEARCH_H */
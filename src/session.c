@@ -0,0 +1,338 @@
+/*
+ * Copyright (c) 2018 Jason Waataja
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "session.h"
+
+#include <errno.h>
+#include <glib/gstdio.h>
+#include <stdlib.h>
+
+#include "hibernate.h"
+#include "terminal.h"
+#include "trace.h"
+#include "window.h"
+
+#define SESSION_FILE "session.ini"
+/* Bumped when the format changes incompatibly. */
+#define SESSION_VERSION 1
+
+/* Removes the scrollback files of the previous session. */
+static void remove_contents(const char *directory);
+static void save_window(GKeyFile *file, int index, MinitermWindow *window,
+	const char *directory, bool scrollback);
+static void save_tab(GKeyFile *file, const char *group,
+	MinitermTerminal *terminal, const char *directory, bool scrollback);
+/* Returns the number of tabs opened. */
+static int restore_window(GtkApplication *app, GKeyFile *file,
+	const char *group, const char *directory,
+	GApplicationCommandLine *command_line);
+/* Feeds the saved scrollback of a tab into terminal, if there is any. */
+static void restore_contents(GKeyFile *file, const char *group,
+	MinitermTerminal *terminal, const char *directory);
+static void spawn_tab(GKeyFile *file, const char *group,
+	MinitermWindow *window, MinitermTerminal *terminal,
+	GApplicationCommandLine *command_line);
+/* Reports a failed spawn to the invoking command and closes its tab. */
+static void spawn_cb(MinitermTerminal *terminal, GPid pid, GError *error,
+	gpointer user_data);
+
+char *
+miniterm_session_get_default_directory(void)
+{
+	return g_build_filename(
+		g_get_user_data_dir(), "miniterm", "session", NULL);
+}
+
+bool
+miniterm_session_save(GtkApplication *app, const char *directory,
+	bool scrollback, GError **error)
+{
+	if (g_mkdir_with_parents(directory, 0700) != 0) {
+		const int saved_errno = errno;
+		g_set_error(error, G_FILE_ERROR,
+			g_file_error_from_errno(saved_errno),
+			"Failed to create %s: %s", directory,
+			g_strerror(saved_errno));
+		return false;
+	}
+	remove_contents(directory);
+	GKeyFile *file = g_key_file_new();
+	g_key_file_set_integer(file, "Session", "version", SESSION_VERSION);
+	int count = 0;
+	/* The list starts with the most recently focused window. */
+	for (GList *l = gtk_application_get_windows(app); l != NULL;
+		l = l->next) {
+		/* Prewarmed windows are never shown. */
+		if (MINITERM_IS_WINDOW(l->data)
+			&& gtk_widget_get_visible(GTK_WIDGET(l->data)))
+			save_window(file, count++, MINITERM_WINDOW(l->data),
+				directory, scrollback);
+	}
+	g_key_file_set_integer(file, "Session", "windows", count);
+	char *path = g_build_filename(directory, SESSION_FILE, NULL);
+	const bool success = g_key_file_save_to_file(file, path, error);
+	g_free(path);
+	g_key_file_free(file);
+	return success;
+}
+
+int
+miniterm_session_restore(GtkApplication *app, const char *directory,
+	GApplicationCommandLine *command_line, GError **error)
+{
+	char *path = g_build_filename(directory, SESSION_FILE, NULL);
+	GKeyFile *file = g_key_file_new();
+	const bool loaded =
+		g_key_file_load_from_file(file, path, G_KEY_FILE_NONE, error);
+	g_free(path);
+	if (!loaded) {
+		g_key_file_free(file);
+		return -1;
+	}
+	if (g_key_file_get_integer(file, "Session", "version", NULL)
+		!= SESSION_VERSION) {
+		g_set_error(error, G_KEY_FILE_ERROR,
+			G_KEY_FILE_ERROR_INVALID_VALUE,
+			"Unsupported session version");
+		g_key_file_free(file);
+		return -1;
+	}
+	miniterm_trace("restore", 0);
+	const int windows =
+		g_key_file_get_integer(file, "Session", "windows", NULL);
+	int count = 0;
+	/* Open the most recently focused window last so it ends up on top. */
+	for (int i = windows - 1; i >= 0; --i) {
+		char *group = g_strdup_printf("Window %d", i);
+		count += restore_window(
+			app, file, group, directory, command_line);
+		g_free(group);
+	}
+	miniterm_trace("restored", 0);
+	g_key_file_free(file);
+	return count;
+}
+
+static void
+remove_contents(const char *directory)
+{
+	GDir *dir = g_dir_open(directory, 0, NULL);
+	if (dir == NULL)
+		return;
+	const char *name;
+	while ((name = g_dir_read_name(dir)) != NULL) {
+		if (!g_str_has_suffix(name, ".gz"))
+			continue;
+		char *path = g_build_filename(directory, name, NULL);
+		g_unlink(path);
+		g_free(path);
+	}
+	g_dir_close(dir);
+}
+
+static void
+save_window(GKeyFile *file, int index, MinitermWindow *window,
+	const char *directory, bool scrollback)
+{
+	char *group = g_strdup_printf("Window %d", index);
+	MinitermTerminal *current = miniterm_window_get_terminal(window);
+	VteTerminal *vte = VTE_TERMINAL(current);
+	g_key_file_set_integer(file, group, "columns",
+		(int)vte_terminal_get_column_count(vte));
+	g_key_file_set_integer(
+		file, group, "rows", (int)vte_terminal_get_row_count(vte));
+	const PangoFontDescription *font = vte_terminal_get_font(vte);
+	if (font != NULL)
+		g_key_file_set_integer(file, group, "font-size",
+			pango_font_description_get_size(font));
+	int tab = 0;
+	for (GList *l = miniterm_window_get_terminals(window); l != NULL;
+		l = l->next, ++tab) {
+		MinitermTerminal *terminal = MINITERM_TERMINAL(l->data);
+		if (terminal == current)
+			g_key_file_set_integer(
+				file, group, "current-tab", tab);
+		char *tab_group = g_strdup_printf("%s Tab %d", group, tab);
+		save_tab(file, tab_group, terminal, directory, scrollback);
+		g_free(tab_group);
+	}
+	g_key_file_set_integer(file, group, "tabs", tab);
+	g_free(group);
+}
+
+static void
+save_tab(GKeyFile *file, const char *group, MinitermTerminal *terminal,
+	const char *directory, bool scrollback)
+{
+	char *cwd = miniterm_terminal_get_cwd(terminal);
+	if (cwd != NULL)
+		g_key_file_set_string(file, group, "directory", cwd);
+	g_free(cwd);
+	const char *command = miniterm_terminal_get_command(terminal);
+	if (command != NULL)
+		g_key_file_set_string(file, group, "command", command);
+	const char *title = miniterm_terminal_get_command_title(terminal);
+	if (title != NULL)
+		g_key_file_set_string(file, group, "title", title);
+	g_key_file_set_boolean(
+		file, group, "keep", miniterm_terminal_get_keep(terminal));
+	if (!scrollback)
+		return;
+	char *name = g_strdup_printf(
+		"%u.gz", miniterm_terminal_get_id(terminal));
+	char *path = g_build_filename(directory, name, NULL);
+	GError *error = NULL;
+	if (miniterm_terminal_save_contents(terminal, path, &error)) {
+		g_key_file_set_string(file, group, "scrollback", name);
+	} else {
+		g_printerr("Failed to save scrollback: %s\n", error->message);
+		g_error_free(error);
+	}
+	g_free(name);
+	g_free(path);
+}
+
+static int
+restore_window(GtkApplication *app, GKeyFile *file, const char *group,
+	const char *directory, GApplicationCommandLine *command_line)
+{
+	const int tabs = g_key_file_get_integer(file, group, "tabs", NULL);
+	if (tabs <= 0)
+		return 0;
+	MinitermWindow *window = NULL;
+	GPtrArray *terminals = g_ptr_array_sized_new(tabs);
+	char **tab_groups = g_new0(char *, tabs + 1);
+	for (int tab = 0; tab < tabs; ++tab) {
+		char *tab_group = g_strdup_printf("%s Tab %d", group, tab);
+		char *title =
+			g_key_file_get_string(file, tab_group, "title", NULL);
+		const bool keep = g_key_file_get_boolean(
+			file, tab_group, "keep", NULL);
+		MinitermTerminal *terminal = NULL;
+		if (window == NULL) {
+			window = miniterm_window_new(app, keep, title);
+			terminal = miniterm_window_get_terminal(window);
+		} else {
+			terminal = miniterm_window_add_terminal(
+				window, keep, title);
+		}
+		g_free(title);
+		restore_contents(file, tab_group, terminal, directory);
+		g_ptr_array_add(terminals, terminal);
+		tab_groups[tab] = tab_group;
+	}
+
+	/* Size the window before showing it, tabs share the font. */
+	const int columns =
+		g_key_file_get_integer(file, group, "columns", NULL);
+	const int rows = g_key_file_get_integer(file, group, "rows", NULL);
+	if (columns > 0 && rows > 0) {
+		for (guint i = 0; i < terminals->len; ++i)
+			vte_terminal_set_size(
+				VTE_TERMINAL(terminals->pdata[i]), columns,
+				rows);
+	}
+	const int font_size =
+		g_key_file_get_integer(file, group, "font-size", NULL);
+	const PangoFontDescription *current_font =
+		vte_terminal_get_font(VTE_TERMINAL(terminals->pdata[0]));
+	if (font_size > 0 && current_font != NULL) {
+		PangoFontDescription *font =
+			pango_font_description_copy(current_font);
+		pango_font_description_set_size(font, font_size);
+		miniterm_window_set_font(window, font);
+		pango_font_description_free(font);
+	}
+	const int current_tab =
+		g_key_file_get_integer(file, group, "current-tab", NULL);
+	if (current_tab >= 0 && current_tab < tabs)
+		miniterm_window_switch_tab(window, current_tab - (tabs - 1));
+	gtk_widget_show(GTK_WIDGET(window));
+
+	/* The spawns run in parallel, none waits for another. */
+	for (int tab = 0; tab < tabs; ++tab)
+		spawn_tab(file, tab_groups[tab], window,
+			MINITERM_TERMINAL(terminals->pdata[tab]),
+			command_line);
+	g_strfreev(tab_groups);
+	g_ptr_array_free(terminals, TRUE);
+	return tabs;
+}
+
+static void
+restore_contents(GKeyFile *file, const char *group,
+	MinitermTerminal *terminal, const char *directory)
+{
+	char *value = g_key_file_get_string(file, group, "scrollback", NULL);
+	if (value == NULL)
+		return;
+	/* Only ever read files from the session directory. */
+	char *name = g_path_get_basename(value);
+	char *path = g_build_filename(directory, name, NULL);
+	GError *error = NULL;
+	if (!miniterm_hibernate_replay(VTE_TERMINAL(terminal), path, &error)) {
+		g_printerr("Failed to restore scrollback: %s\n",
+			error->message);
+		g_error_free(error);
+	}
+	g_free(value);
+	g_free(name);
+	g_free(path);
+}
+
+static void
+spawn_tab(GKeyFile *file, const char *group, MinitermWindow *window,
+	MinitermTerminal *terminal, GApplicationCommandLine *command_line)
+{
+	char *directory =
+		g_key_file_get_string(file, group, "directory", NULL);
+	const char *cwd = g_get_home_dir();
+	/* The directory may have been removed since. */
+	if (directory != NULL && g_file_test(directory, G_FILE_TEST_IS_DIR))
+		cwd = directory;
+	char *command = g_key_file_get_string(file, group, "command", NULL);
+	miniterm_window_spawn(window, terminal, cwd, command,
+		g_application_command_line_get_environ(command_line),
+		spawn_cb, g_object_ref(command_line));
+	g_free(directory);
+	g_free(command);
+}
+
+static void
+spawn_cb(MinitermTerminal *terminal, GPid pid, GError *error,
+	gpointer user_data)
+{
+	(void)pid;
+	GApplicationCommandLine *command_line = user_data;
+	if (error != NULL) {
+		g_application_command_line_printerr(
+			command_line, "%s\n", error->message);
+		g_application_command_line_set_exit_status(
+			command_line, EXIT_FAILURE);
+		GtkWidget *window =
+			gtk_widget_get_toplevel(GTK_WIDGET(terminal));
+		if (MINITERM_IS_WINDOW(window))
+			miniterm_window_remove_terminal(
+				MINITERM_WINDOW(window), terminal);
+	}
+	g_object_unref(command_line);
+}
@@ -0,0 +1,53 @@
+/*
+ * Copyright (c) 2018 Jason Waataja
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef MINITERM_SESSION_H
+#define MINITERM_SESSION_H
+
+#include <gtk/gtk.h>
+#include <stdbool.h>
+
+/*
+ * A session is a snapshot of the windows of an instance, their tabs and what
+ * runs in them, kept in a directory so miniterm --restore can open them again
+ * after a restart. Children are started anew, only their working directory,
+ * command and optionally their scrollback carry over.
+ */
+
+/* Returns the newly allocated path of the user's session directory. */
+char *miniterm_session_get_default_directory(void);
+/*
+ * Saves the shown windows of app to directory, replacing the session saved
+ * there. The scrollback of each tab is saved too if scrollback is set. Returns
+ * false and sets error on failure.
+ */
+bool miniterm_session_save(GtkApplication *app, const char *directory,
+	bool scrollback, GError **error);
+/*
+ * Opens the windows saved in directory all at once and starts spawning their
+ * children with the environment of command_line, reporting spawn errors to
+ * it. Returns the number of tabs opened, or -1 and sets error on failure.
+ */
+int miniterm_session_restore(GtkApplication *app, const char *directory,
+	GApplicationCommandLine *command_line, GError **error);
+
+#endif /* MINITERM_SESSION_H */
@@ -37,20 +37,75 @@ static void config_file_get_int(
 /* May print an error message on invalid format. */
 static void config_file_get_scrollbar(
 	GtkPolicyType *dest, GKeyFile *config_file);
+/* May print an error message on invalid format. */
+static void config_file_get_rewrap(
+	MinitermRewrap *dest, GKeyFile *config_file);
+/* Adds or replaces the patterns named in the Links group. */
+static void config_file_get_links(
+	MinitermSettings *settings, GKeyFile *config_file);
 
-void
-miniterm_settings_init(MinitermSettings *settings)
+static const char *const default_link_names[] = {"url", "path", "hash", NULL};
+static const char *const default_link_patterns[] = {
+	LINK_URL, LINK_PATH, LINK_HASH, NULL};
+
+MinitermSettings *
+miniterm_settings_new(void)
 {
+	MinitermSettings *settings = g_new(MinitermSettings, 1);
+	settings->ref_count = 1;
 	settings->dynamic_window_title = true;
 	settings->urgent_on_bell = true;
 	settings->scrollbar_type = GTK_POLICY_NEVER;
+	settings->rewrap = MINITERM_REWRAP_LAZY;
 	settings->audible_bell = false;
 	settings->autohide_mouse = false;
+	settings->measure_latency = false;
+	settings->sharded = false;
+	settings->log_timestamps = false;
+	settings->save_session = false;
+	settings->session_scrollback = false;
+	settings->export_colors = false;
 	settings->scrollback_lines = MINITERM_DEFAULT_SCROLLBACK_LINES;
+	settings->scrollback_budget_mb = 0;
 	settings->font_name = NULL;
+	settings->font = NULL;
 	settings->columns = 0;
 	settings->rows = 0;
+	settings->prewarm = 0;
+	settings->hibernate_after = 0;
+	settings->shards = 0;
+	settings->flood_threshold = 0;
+	settings->log_directory = NULL;
+	settings->log_rotate_mb = 0;
+	settings->export_command = NULL;
+	settings->link_command = NULL;
+	settings->link_names = g_strdupv((char **)default_link_names);
+	settings->link_patterns = g_strdupv((char **)default_link_patterns);
 	settings->has_colors = false;
+	return settings;
+}
+
+MinitermSettings *
+miniterm_settings_ref(MinitermSettings *settings)
+{
+	g_atomic_int_inc(&settings->ref_count);
+	return settings;
+}
+
+void
+miniterm_settings_unref(MinitermSettings *settings)
+{
+	if (!g_atomic_int_dec_and_test(&settings->ref_count))
+		return;
+	g_free(settings->font_name);
+	if (settings->font != NULL)
+		pango_font_description_free(settings->font);
+	g_free(settings->log_directory);
+	g_free(settings->export_command);
+	g_free(settings->link_command);
+	g_strfreev(settings->link_names);
+	g_strfreev(settings->link_patterns);
+	g_free(settings);
 }
 
 bool
@@ -63,26 +118,126 @@ miniterm_settings_set_from_key_file(
 		"urgent-on-bell");
 	config_file_get_bool(&settings->autohide_mouse, config_file, "Misc",
 		"autohide-mouse");
+	config_file_get_bool(&settings->measure_latency, config_file, "Misc",
+		"measure-latency");
+	config_file_get_bool(
+		&settings->sharded, config_file, "Misc", "sharded");
+	config_file_get_bool(&settings->log_timestamps, config_file, "Misc",
+		"log-timestamps");
+	config_file_get_bool(&settings->save_session, config_file, "Misc",
+		"save-session");
+	config_file_get_bool(&settings->session_scrollback, config_file,
+		"Misc", "session-scrollback");
+	config_file_get_bool(&settings->export_colors, config_file, "Misc",
+		"export-colors");
 	config_file_get_scrollbar(&settings->scrollbar_type, config_file);
+	config_file_get_rewrap(&settings->rewrap, config_file);
 	config_file_get_int(&settings->scrollback_lines, config_file, "Misc",
 		"scrollback-lines");
+	config_file_get_int(&settings->scrollback_budget_mb, config_file,
+		"Misc", "scrollback-budget-mb");
 	config_file_get_int(&settings->columns, config_file, "Misc", "columns");
 	config_file_get_int(&settings->rows, config_file, "Misc", "rows");
+	config_file_get_int(
+		&settings->prewarm, config_file, "Misc", "prewarm");
+	config_file_get_int(&settings->hibernate_after, config_file, "Misc",
+		"hibernate-after");
+	config_file_get_int(&settings->shards, config_file, "Misc", "shards");
+	config_file_get_int(&settings->flood_threshold, config_file, "Misc",
+		"flood-threshold");
+	config_file_get_int(&settings->log_rotate_mb, config_file, "Misc",
+		"log-rotate-mb");
 	if (settings->scrollback_lines < 0) {
 		fprintf(stderr, "Invalid scrollback lines: %i\n",
 			settings->scrollback_lines);
 		settings->scrollback_lines = 0;
 	}
-	settings->font_name =
+	if (settings->scrollback_budget_mb < 0) {
+		fprintf(stderr, "Invalid scrollback budget: %i\n",
+			settings->scrollback_budget_mb);
+		settings->scrollback_budget_mb = 0;
+	}
+	if (settings->prewarm < 0) {
+		fprintf(stderr, "Invalid prewarm: %i\n", settings->prewarm);
+		settings->prewarm = 0;
+	}
+	if (settings->hibernate_after < 0) {
+		fprintf(stderr, "Invalid hibernate after: %i\n",
+			settings->hibernate_after);
+		settings->hibernate_after = 0;
+	}
+	if (settings->shards < 0) {
+		fprintf(stderr, "Invalid shards: %i\n", settings->shards);
+		settings->shards = 0;
+	}
+	if (settings->flood_threshold < 0) {
+		fprintf(stderr, "Invalid flood threshold: %i\n",
+			settings->flood_threshold);
+		settings->flood_threshold = 0;
+	}
+	if (settings->log_rotate_mb < 0) {
+		fprintf(stderr, "Invalid log rotate size: %i\n",
+			settings->log_rotate_mb);
+		settings->log_rotate_mb = 0;
+	}
+	char *log_directory = g_key_file_get_string(
+		config_file, "Misc", "log-directory", NULL);
+	if (log_directory != NULL) {
+		g_free(settings->log_directory);
+		/* An empty value turns logging off again. */
+		settings->log_directory =
+			log_directory[0] != '\0' ? log_directory : NULL;
+		if (settings->log_directory == NULL)
+			g_free(log_directory);
+	}
+	char *export_command = g_key_file_get_string(
+		config_file, "Misc", "export-command", NULL);
+	if (export_command != NULL) {
+		g_free(settings->export_command);
+		settings->export_command =
+			export_command[0] != '\0' ? export_command : NULL;
+		if (settings->export_command == NULL)
+			g_free(export_command);
+	}
+	char *link_command = g_key_file_get_string(
+		config_file, "Misc", "link-command", NULL);
+	if (link_command != NULL) {
+		g_free(settings->link_command);
+		settings->link_command =
+			link_command[0] != '\0' ? link_command : NULL;
+		if (settings->link_command == NULL)
+			g_free(link_command);
+	}
+	config_file_get_links(settings, config_file);
+	char *font_name =
 		g_key_file_get_string(config_file, "Font", "font", NULL);
+	if (font_name != NULL) {
+		g_free(settings->font_name);
+		if (settings->font != NULL)
+			pango_font_description_free(settings->font);
+		settings->font_name = font_name;
+		settings->font = pango_font_description_from_string(font_name);
+	}
 	miniterm_settings_set_colors(settings, config_file);
 	return true;
 }
 
-void
-miniterm_settings_destroy(MinitermSettings *settings)
+MinitermSettings *
+miniterm_settings_load(const char *config_path)
 {
-	g_free(settings->font_name);
+	MinitermSettings *settings = miniterm_settings_new();
+	GKeyFile *config_file = g_key_file_new();
+	if (g_key_file_load_from_file(config_file, config_path, 0, NULL))
+		miniterm_settings_set_from_key_file(settings, config_file);
+	g_key_file_free(config_file);
+	return settings;
+}
+
+char *
+miniterm_settings_get_default_path(void)
+{
+	return g_build_filename(
+		g_get_user_config_dir(), "miniterm", "miniterm.conf", NULL);
 }
 
 static void
@@ -195,6 +350,65 @@ config_file_get_scrollbar(GtkPolicyType *dest, GKeyFile *config_file)
 	}
 }
 
+static void
+config_file_get_rewrap(MinitermRewrap *dest, GKeyFile *config_file)
+{
+	char *value =
+		g_key_file_get_string(config_file, "Misc", "rewrap", NULL);
+	if (value != NULL) {
+		if (strcmp(value, "full") == 0)
+			*dest = MINITERM_REWRAP_FULL;
+		else if (strcmp(value, "lazy") == 0)
+			*dest = MINITERM_REWRAP_LAZY;
+		else if (strcmp(value, "off") == 0)
+			*dest = MINITERM_REWRAP_OFF;
+		else
+			g_printerr("Unknown \"rewrap\": %s\n", value);
+		g_free(value);
+	}
+}
+
+static void
+config_file_get_links(MinitermSettings *settings, GKeyFile *config_file)
+{
+	char **keys = g_key_file_get_keys(config_file, "Links", NULL, NULL);
+	if (keys == NULL)
+		return;
+	GPtrArray *names = g_ptr_array_new();
+	GPtrArray *patterns = g_ptr_array_new();
+	/* Keep the patterns the group doesn't name, in their order. */
+	for (size_t i = 0; settings->link_names[i] != NULL; ++i) {
+		const char *name = settings->link_names[i];
+		if (g_strv_contains((const char *const *)keys, name)) {
+			g_free(settings->link_names[i]);
+			g_free(settings->link_patterns[i]);
+			continue;
+		}
+		g_ptr_array_add(names, settings->link_names[i]);
+		g_ptr_array_add(patterns, settings->link_patterns[i]);
+	}
+	g_free(settings->link_names);
+	g_free(settings->link_patterns);
+	for (size_t i = 0; keys[i] != NULL; ++i) {
+		/* The raw value, so backslashes needn't be doubled. */
+		char *pattern = g_key_file_get_value(
+			config_file, "Links", keys[i], NULL);
+		/* An empty value turns a default pattern off. */
+		if (pattern == NULL || pattern[0] == '\0') {
+			g_free(keys[i]);
+			g_free(pattern);
+			continue;
+		}
+		g_ptr_array_add(names, keys[i]);
+		g_ptr_array_add(patterns, pattern);
+	}
+	g_free(keys);
+	g_ptr_array_add(names, NULL);
+	g_ptr_array_add(patterns, NULL);
+	settings->link_names = (char **)g_ptr_array_free(names, FALSE);
+	settings->link_patterns = (char **)g_ptr_array_free(patterns, FALSE);
+}
+
 void
 miniterm_write_default_settings(const char *config_path)
 {
@@ -216,9 +430,29 @@ miniterm_write_default_settings(const char *config_path)
 		      "# urgent-on-bell=\n"
 		      "# audible-bell=\n"
 		      "# autohide-mouse=\n"
+		      "# measure-latency=false\n"
 		      "# scrollback-lines=\n"
+		      "# scrollback-budget-mb=0\n"
 		      "# scrollbar-type=\n"
+		      "# rewrap=lazy\n"
 		      "# columns=80\n"
-		      "# rows=24\n");
+		      "# rows=24\n"
+		      "# prewarm=0\n"
+		      "# hibernate-after=0\n"
+		      "# sharded=false\n"
+		      "# shards=0\n"
+		      "# flood-threshold=0\n"
+		      "# log-directory=\n"
+		      "# log-timestamps=false\n"
+		      "# log-rotate-mb=0\n"
+		      "# save-session=false\n"
+		      "# session-scrollback=false\n"
+		      "# export-command=\n"
+		      "# export-colors=false\n"
+		      "# link-command=\n\n"
+		      "[Links]\n"
+		      "# url=" LINK_URL "\n"
+		      "# path=" LINK_PATH "\n"
+		      "# hash=" LINK_HASH "\n");
 	fclose(file);
 }
@@ -33,19 +33,87 @@
 
 typedef struct _MinitermSettings MinitermSettings;
 
+/* How the scrollback is rewrapped when a terminal changes width. */
+typedef enum {
+	/* Rewrap at every intermediate size, as vte does on its own. */
+	MINITERM_REWRAP_FULL,
+	/* Keep the old grid until the size settles, then rewrap once. */
+	MINITERM_REWRAP_LAZY,
+	/*
+	 * Never rewrap, lines keep the width they were written at. Like lazy with
+	 * vte 0.58 and newer, which always rewrap.
+	 */
+	MINITERM_REWRAP_OFF,
+} MinitermRewrap;
+
+/*
+ * A parsed configuration. Snapshots are shared by reference and must not be
+ * modified once another owner holds a reference.
+ */
 struct _MinitermSettings {
+	int ref_count;
+
 	bool dynamic_window_title;
 	bool urgent_on_bell;
 	bool audible_bell;
 	bool autohide_mouse;
+	/* Whether to record input latency histograms. */
+	bool measure_latency;
+	/* Whether windows are hosted by worker processes. */
+	bool sharded;
+	/* Whether log lines start with the time they were received. */
+	bool log_timestamps;
+	/* Whether the windows are saved on quit for miniterm --restore. */
+	bool save_session;
+	/* Whether saving the session includes the scrollback. */
+	bool session_scrollback;
+	/* Whether exports keep colors as escape sequences by default. */
+	bool export_colors;
 	GtkPolicyType scrollbar_type;
+	MinitermRewrap rewrap;
 	int scrollback_lines;
+	/*
+	 * Megabytes of scrollback all terminals may use together. Non-positive
+	 * indicates no budget.
+	 */
+	int scrollback_budget_mb;
 	/* NULL indicates no user defined font. */
 	char *font_name;
+	/* Parsed from font_name, NULL when font_name is NULL. */
+	PangoFontDescription *font;
 	/* Non-positive indicates no default. */
 	int columns;
 	/* Non-positive indicates no default. */
 	int rows;
+	/* Number of hidden windows kept ready with a shell running. */
+	int prewarm;
+	/*
+	 * Seconds a terminal stays unfocused before it is hibernated.
+	 * Non-positive indicates never.
+	 */
+	int hibernate_after;
+	/* Number of worker processes when sharded. 0 indicates one per core. */
+	int shards;
+	/*
+	 * Megabytes per second of output above which a terminal jump-scrolls.
+	 * Non-positive indicates no flood control.
+	 */
+	int flood_threshold;
+	/* Directory every terminal logs its output to. NULL indicates none. */
+	char *log_directory;
+	/* Megabytes after which a log is rotated. 0 indicates never. */
+	int log_rotate_mb;
+	/* Command the scrollback is piped to. NULL indicates none. */
+	char *export_command;
+	/*
+	 * Command a clicked link is passed to. NULL indicates the default
+	 * application for URLs and files.
+	 */
+	char *link_command;
+	/* Names of the link patterns, from the Links group. */
+	char **link_names;
+	/* Patterns of the text Ctrl+click opens, indexed like link_names. */
+	char **link_patterns;
 
 	/* Whether or not colors are valid. */
 	bool has_colors;
@@ -54,11 +122,20 @@ struct _MinitermSettings {
 	GdkRGBA color_palette[MINITERM_COLOR_COUNT];
 };
 
-void miniterm_settings_init(MinitermSettings *settings);
+/* Returns new default settings with a reference count of 1. */
+MinitermSettings *miniterm_settings_new(void);
+MinitermSettings *miniterm_settings_ref(MinitermSettings *settings);
+void miniterm_settings_unref(MinitermSettings *settings);
 bool miniterm_settings_set_from_key_file(
 	MinitermSettings *settings, GKeyFile *config_file);
-void miniterm_settings_destroy(MinitermSettings *settings);
+/*
+ * Returns a new snapshot read from the file at config_path. Falls back to the
+ * defaults if the file can't be read. Never returns NULL.
+ */
+MinitermSettings *miniterm_settings_load(const char *config_path);
 
+/* Returns the newly allocated path of the user's config file. */
+char *miniterm_settings_get_default_path(void);
 /* Assumes the directory path resides in exists. */
 void miniterm_write_default_settings(const char *config_path);
 
@@ -0,0 +1,732 @@
+/*
+ * Copyright (c) 2018 Jason Waataja
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "shard.h"
+
+#include <signal.h>
+#include <stdlib.h>
+
+#include "config.h"
+
+#define SHARD_INTERFACE "us.laelath.miniterm.Shard"
+#define STATS_INTERFACE "us.laelath.miniterm.Stats"
+
+/* Introspection data of the interface command lines are forwarded through. */
+static const char shard_xml[] =
+	"<node>"
+	"  <interface name='" SHARD_INTERFACE "'>"
+	"    <method name='CommandLine'>"
+	"      <arg type='aay' name='arguments' direction='in'/>"
+	"      <arg type='a{sv}' name='platform_data' direction='in'/>"
+	"      <arg type='i' name='exit_status' direction='out'/>"
+	"      <arg type='s' name='stdout' direction='out'/>"
+	"      <arg type='s' name='stderr' direction='out'/>"
+	"    </method>"
+	"  </interface>"
+	"</node>";
+
+/*
+ * A command line forwarded by the dispatcher. Output is collected and sent
+ * back with the exit status once the last reference is dropped, the way
+ * GApplication answers remote command lines.
+ */
+#define MINITERM_TYPE_SHARD_COMMAND_LINE \
+	(miniterm_shard_command_line_get_type())
+G_DECLARE_FINAL_TYPE(MinitermShardCommandLine, miniterm_shard_command_line,
+	MINITERM, SHARD_COMMAND_LINE, GApplicationCommandLine)
+
+struct _MinitermShardCommandLine {
+	GApplicationCommandLine parent;
+};
+
+typedef struct _MinitermShardCommandLinePrivate
+	MinitermShardCommandLinePrivate;
+
+struct _MinitermShardCommandLinePrivate {
+	GDBusMethodInvocation *invocation;
+	GString *out;
+	GString *err;
+};
+
+G_DEFINE_TYPE_WITH_PRIVATE(MinitermShardCommandLine,
+	miniterm_shard_command_line, G_TYPE_APPLICATION_COMMAND_LINE)
+
+typedef struct {
+	int index;
+	char *name;
+	char *path;
+	MinitermDispatcher *dispatcher;
+	/* 0 unless the dispatcher started the shard and it still runs. */
+	GPid pid;
+	/* Child watch on pid. 0 indicates none. */
+	unsigned int exit_source;
+	unsigned int watch;
+	/* Whether the shard owns its name. */
+	bool running;
+	/* Whether the shard was started but didn't take its name yet. */
+	bool starting;
+	/* Whether a window was forwarded to it. */
+	bool used;
+	/* Command lines waiting for the shard to start. */
+	GQueue waiting;
+} Shard;
+
+struct _MinitermDispatcher {
+	GApplication *app;
+	GDBusConnection *connection;
+	char *executable;
+	Shard *shards;
+	int count;
+	/* The shard that got the last window. -1 indicates none. */
+	int last;
+	/* Whether the application is held for running shards. */
+	bool holding;
+	/* Whether a spare is kept even without windows, as a daemon does. */
+	bool keep_spare;
+	/* Cancels the load queries once the dispatcher is freed. */
+	GCancellable *cancellable;
+};
+
+/* A command line waiting for the running shards to report their load. */
+typedef struct {
+	MinitermDispatcher *dispatcher;
+	/* The dispatcher's, cancelled once it is freed. */
+	GCancellable *cancellable;
+	GApplicationCommandLine *command_line;
+	/* Queries that didn't return yet. */
+	int pending;
+	/* The least loaded shard that answered so far, NULL if none did. */
+	Shard *best;
+	double best_load;
+} Pick;
+
+/* A load query of one shard. */
+typedef struct {
+	Pick *pick;
+	Shard *shard;
+} Query;
+
+/* A command line being forwarded. */
+typedef struct {
+	GApplicationCommandLine *command_line;
+	int index;
+	/* Whether the output is prefixed with the shard it came from. */
+	bool header;
+} Forward;
+
+static void miniterm_shard_command_line_finalize(GObject *command_line);
+static void miniterm_shard_command_line_print_literal(
+	GApplicationCommandLine *command_line, const char *message);
+static void miniterm_shard_command_line_printerr_literal(
+	GApplicationCommandLine *command_line, const char *message);
+
+/* Handles forwarded command lines. */
+static void shard_method_cb(GDBusConnection *connection, const char *sender,
+	const char *object_path, const char *interface_name,
+	const char *method_name, GVariant *parameters,
+	GDBusMethodInvocation *invocation, gpointer user_data);
+
+static const GDBusInterfaceVTable shard_vtable = {shard_method_cb, NULL, NULL};
+
+/*
+ * Asks the running shards for their load and forwards command_line to the
+ * least loaded one once all answered or timed out.
+ */
+static void pick_shard(
+	MinitermDispatcher *dispatcher, GApplicationCommandLine *command_line);
+static void load_cb(GObject *source, GAsyncResult *result, gpointer user_data);
+/* Forwards the command line once the last query returned. */
+static void finish_pick(Pick *pick);
+/* Returns a shard for when none answered, starting one if needed. */
+static Shard *get_fallback(MinitermDispatcher *dispatcher);
+/*
+ * Returns the number of terminals in the statistics reply plus their output in
+ * MiB/s.
+ */
+static double get_load(GVariant *reply);
+/* Forwards a new window to shard. */
+static void forward_window(MinitermDispatcher *dispatcher, Shard *shard,
+	GApplicationCommandLine *command_line);
+/* Starts a shard without windows if there is room and none is idle. */
+static void ensure_spare(MinitermDispatcher *dispatcher);
+static bool start_shard(MinitermDispatcher *dispatcher, Shard *shard);
+/* Sends command_line to shard, or queues it until the shard runs. */
+static void forward(Shard *shard, GApplicationCommandLine *command_line,
+	bool header);
+static void forward_cb(GObject *source, GAsyncResult *result,
+	gpointer user_data);
+/* Fails the command lines waiting for shard. */
+static void fail_waiting(Shard *shard, const char *message);
+/* Holds the application while any shard runs. */
+static void update_hold(MinitermDispatcher *dispatcher);
+/*
+ * Stops the spare shards once no shard with windows is left, they'd keep
+ * miniterm running forever. A daemon keeps them.
+ */
+static void stop_spares(MinitermDispatcher *dispatcher);
+
+static void shard_appeared_cb(GDBusConnection *connection, const char *name,
+	const char *owner, gpointer user_data);
+static void shard_vanished_cb(
+	GDBusConnection *connection, const char *name, gpointer user_data);
+static void shard_exit_cb(GPid pid, int status, gpointer user_data);
+
+static void
+miniterm_shard_command_line_init(MinitermShardCommandLine *command_line)
+{
+	MinitermShardCommandLinePrivate *priv =
+		miniterm_shard_command_line_get_instance_private(command_line);
+	priv->invocation = NULL;
+	priv->out = g_string_new(NULL);
+	priv->err = g_string_new(NULL);
+}
+
+static void
+miniterm_shard_command_line_class_init(MinitermShardCommandLineClass *kclass)
+{
+	GObjectClass *object_class = G_OBJECT_CLASS(kclass);
+	GApplicationCommandLineClass *command_line_class =
+		G_APPLICATION_COMMAND_LINE_CLASS(kclass);
+	object_class->finalize = miniterm_shard_command_line_finalize;
+	command_line_class->print_literal =
+		miniterm_shard_command_line_print_literal;
+	command_line_class->printerr_literal =
+		miniterm_shard_command_line_printerr_literal;
+}
+
+static void
+miniterm_shard_command_line_finalize(GObject *command_line)
+{
+	MinitermShardCommandLinePrivate *priv =
+		miniterm_shard_command_line_get_instance_private(
+			MINITERM_SHARD_COMMAND_LINE(command_line));
+	g_dbus_method_invocation_return_value(priv->invocation,
+		g_variant_new("(iss)",
+			g_application_command_line_get_exit_status(
+				G_APPLICATION_COMMAND_LINE(command_line)),
+			priv->out->str, priv->err->str));
+	g_string_free(priv->out, TRUE);
+	g_string_free(priv->err, TRUE);
+	G_OBJECT_CLASS(miniterm_shard_command_line_parent_class)
+		->finalize(command_line);
+}
+
+static void
+miniterm_shard_command_line_print_literal(
+	GApplicationCommandLine *command_line, const char *message)
+{
+	MinitermShardCommandLinePrivate *priv =
+		miniterm_shard_command_line_get_instance_private(
+			MINITERM_SHARD_COMMAND_LINE(command_line));
+	g_string_append(priv->out, message);
+}
+
+static void
+miniterm_shard_command_line_printerr_literal(
+	GApplicationCommandLine *command_line, const char *message)
+{
+	MinitermShardCommandLinePrivate *priv =
+		miniterm_shard_command_line_get_instance_private(
+			MINITERM_SHARD_COMMAND_LINE(command_line));
+	g_string_append(priv->err, message);
+}
+
+char *
+miniterm_shard_get_id(int index)
+{
+	return g_strdup_printf("us.laelath.miniterm.Shard%d", index);
+}
+
+unsigned int
+miniterm_shard_register(GApplication *app, GDBusConnection *connection,
+	const char *object_path, GError **error)
+{
+	GDBusNodeInfo *info = g_dbus_node_info_new_for_xml(shard_xml, error);
+	if (info == NULL)
+		return 0;
+	const unsigned int registration = g_dbus_connection_register_object(
+		connection, object_path, info->interfaces[0], &shard_vtable,
+		app, NULL, error);
+	g_dbus_node_info_unref(info);
+	/* Stay up as a spare until the dispatcher sends something. */
+	if (registration != 0)
+		g_application_hold(app);
+	return registration;
+}
+
+static void
+shard_method_cb(GDBusConnection *connection, const char *sender,
+	const char *object_path, const char *interface_name,
+	const char *method_name, GVariant *parameters,
+	GDBusMethodInvocation *invocation, gpointer user_data)
+{
+	(void)connection;
+	(void)sender;
+	(void)object_path;
+	(void)interface_name;
+	(void)method_name;
+	/* CommandLine is the only method, GDBus rejects anything else. */
+	static bool released = false;
+	GApplication *app = G_APPLICATION(user_data);
+	GVariant *arguments = NULL;
+	GVariant *platform_data = NULL;
+	g_variant_get(parameters, "(@aay@a{sv})", &arguments, &platform_data);
+	GApplicationCommandLine *command_line =
+		g_object_new(MINITERM_TYPE_SHARD_COMMAND_LINE, "arguments",
+			arguments, "platform-data", platform_data, NULL);
+	g_variant_unref(arguments);
+	g_variant_unref(platform_data);
+	MinitermShardCommandLinePrivate *priv =
+		miniterm_shard_command_line_get_instance_private(
+			MINITERM_SHARD_COMMAND_LINE(command_line));
+	priv->invocation = invocation;
+
+	int status = 0;
+	g_signal_emit_by_name(app, "command-line", command_line, &status);
+	g_object_unref(command_line);
+	/* From now on the shard lives as long as its windows. */
+	if (!released) {
+		released = true;
+		g_application_release(app);
+	}
+}
+
+MinitermDispatcher *
+miniterm_dispatcher_new(
+	GApplication *app, GDBusConnection *connection, int count)
+{
+	MinitermDispatcher *dispatcher = g_new(MinitermDispatcher, 1);
+	dispatcher->app = app;
+	dispatcher->connection = g_object_ref(connection);
+	dispatcher->executable = g_file_read_link("/proc/self/exe", NULL);
+	if (dispatcher->executable == NULL)
+		dispatcher->executable = g_strdup("miniterm");
+	dispatcher->shards = g_new(Shard, count);
+	dispatcher->count = count;
+	dispatcher->last = -1;
+	dispatcher->holding = false;
+	dispatcher->keep_spare = false;
+	dispatcher->cancellable = g_cancellable_new();
+	for (int i = 0; i < count; ++i) {
+		Shard *shard = &dispatcher->shards[i];
+		shard->index = i;
+		shard->name = miniterm_shard_get_id(i);
+		/* GApplication exports its objects at the id as a path. */
+		shard->path = g_strdelimit(
+			g_strconcat("/", shard->name, NULL), ".", '/');
+		shard->dispatcher = dispatcher;
+		shard->pid = 0;
+		shard->exit_source = 0;
+		shard->running = false;
+		shard->starting = false;
+		shard->used = false;
+		g_queue_init(&shard->waiting);
+		/* Shards left by an earlier dispatcher are picked up too. */
+		shard->watch = g_bus_watch_name_on_connection(connection,
+			shard->name, G_BUS_NAME_WATCHER_FLAGS_NONE,
+			shard_appeared_cb, shard_vanished_cb, shard, NULL);
+	}
+	return dispatcher;
+}
+
+void
+miniterm_dispatcher_free(MinitermDispatcher *dispatcher)
+{
+	/* Picks still waiting fail once their queries are cancelled. */
+	g_cancellable_cancel(dispatcher->cancellable);
+	g_object_unref(dispatcher->cancellable);
+	for (int i = 0; i < dispatcher->count; ++i) {
+		Shard *shard = &dispatcher->shards[i];
+		g_bus_unwatch_name(shard->watch);
+		if (shard->exit_source != 0)
+			g_source_remove(shard->exit_source);
+		fail_waiting(shard, "miniterm is shutting down");
+		g_free(shard->name);
+		g_free(shard->path);
+	}
+	if (dispatcher->holding)
+		g_application_release(dispatcher->app);
+	g_object_unref(dispatcher->connection);
+	g_free(dispatcher->executable);
+	g_free(dispatcher->shards);
+	g_free(dispatcher);
+}
+
+void
+miniterm_dispatcher_keep_spare(MinitermDispatcher *dispatcher)
+{
+	dispatcher->keep_spare = true;
+	ensure_spare(dispatcher);
+}
+
+void
+miniterm_dispatcher_forward(MinitermDispatcher *dispatcher,
+	GApplicationCommandLine *command_line, bool tab, bool usage)
+{
+	if (usage) {
+		for (int i = 0; i < dispatcher->count; ++i) {
+			if (dispatcher->shards[i].running)
+				forward(&dispatcher->shards[i], command_line,
+					true);
+		}
+		return;
+	}
+	if (tab && dispatcher->last >= 0) {
+		Shard *shard = &dispatcher->shards[dispatcher->last];
+		if (shard->running || shard->starting) {
+			forward_window(dispatcher, shard, command_line);
+			return;
+		}
+	}
+	pick_shard(dispatcher, command_line);
+}
+
+static void
+pick_shard(
+	MinitermDispatcher *dispatcher, GApplicationCommandLine *command_line)
+{
+	Pick *pick = g_new(Pick, 1);
+	pick->dispatcher = dispatcher;
+	pick->cancellable = g_object_ref(dispatcher->cancellable);
+	pick->command_line = g_object_ref(command_line);
+	/* Held until all queries are sent, in case none is. */
+	pick->pending = 1;
+	pick->best = NULL;
+	pick->best_load = 0;
+	for (int i = 0; i < dispatcher->count; ++i) {
+		Shard *shard = &dispatcher->shards[i];
+		if (!shard->running)
+			continue;
+		Query *query = g_new(Query, 1);
+		query->pick = pick;
+		query->shard = shard;
+		++pick->pending;
+		/* A shard too busy to answer is the last one to add to. */
+		g_dbus_connection_call(dispatcher->connection, shard->name,
+			shard->path, STATS_INTERFACE, "GetStats", NULL,
+			G_VARIANT_TYPE("(aa{sv})"),
+			G_DBUS_CALL_FLAGS_NO_AUTO_START, SHARD_QUERY_TIMEOUT,
+			dispatcher->cancellable, load_cb, query);
+	}
+	if (--pick->pending == 0)
+		finish_pick(pick);
+}
+
+static void
+load_cb(GObject *source, GAsyncResult *result, gpointer user_data)
+{
+	Query *query = user_data;
+	Pick *pick = query->pick;
+	GVariant *reply = g_dbus_connection_call_finish(
+		G_DBUS_CONNECTION(source), result, NULL);
+	if (reply != NULL) {
+		const double load = get_load(reply);
+		if (pick->best == NULL || load < pick->best_load) {
+			pick->best = query->shard;
+			pick->best_load = load;
+		}
+		g_variant_unref(reply);
+	}
+	g_free(query);
+	if (--pick->pending == 0)
+		finish_pick(pick);
+}
+
+static void
+finish_pick(Pick *pick)
+{
+	GApplicationCommandLine *command_line = pick->command_line;
+	if (g_cancellable_is_cancelled(pick->cancellable)) {
+		g_application_command_line_printerr(
+			command_line, "miniterm is shutting down\n");
+		g_application_command_line_set_exit_status(
+			command_line, EXIT_FAILURE);
+	} else {
+		MinitermDispatcher *dispatcher = pick->dispatcher;
+		/* The shard may have gone away while the others answered. */
+		Shard *shard = pick->best != NULL && pick->best->running
+			? pick->best
+			: get_fallback(dispatcher);
+		if (shard != NULL) {
+			forward_window(dispatcher, shard, command_line);
+		} else {
+			g_application_command_line_printerr(
+				command_line, "No shard could be started\n");
+			g_application_command_line_set_exit_status(
+				command_line, EXIT_FAILURE);
+		}
+	}
+	g_object_unref(command_line);
+	g_object_unref(pick->cancellable);
+	g_free(pick);
+}
+
+static Shard *
+get_fallback(MinitermDispatcher *dispatcher)
+{
+	/* Nothing answered, prefer a shard that comes up fresh. */
+	for (int i = 0; i < dispatcher->count; ++i) {
+		if (dispatcher->shards[i].starting)
+			return &dispatcher->shards[i];
+	}
+	for (int i = 0; i < dispatcher->count; ++i) {
+		Shard *shard = &dispatcher->shards[i];
+		if (!shard->running && start_shard(dispatcher, shard))
+			return shard;
+	}
+	for (int i = 0; i < dispatcher->count; ++i) {
+		if (dispatcher->shards[i].running)
+			return &dispatcher->shards[i];
+	}
+	return NULL;
+}
+
+static double
+get_load(GVariant *reply)
+{
+	GVariantIter *terminals = NULL;
+	g_variant_get(reply, "(aa{sv})", &terminals);
+	double load = 0;
+	GVariant *terminal;
+	while ((terminal = g_variant_iter_next_value(terminals)) != NULL) {
+		double rate = 0;
+		g_variant_lookup(terminal, "bytes-per-second", "d", &rate);
+		load += 1 + rate / (1024 * 1024);
+		g_variant_unref(terminal);
+	}
+	g_variant_iter_free(terminals);
+	return load;
+}
+
+static void
+forward_window(MinitermDispatcher *dispatcher, Shard *shard,
+	GApplicationCommandLine *command_line)
+{
+	shard->used = true;
+	dispatcher->last = shard->index;
+	forward(shard, command_line, false);
+	ensure_spare(dispatcher);
+}
+
+static void
+ensure_spare(MinitermDispatcher *dispatcher)
+{
+	Shard *free_shard = NULL;
+	for (int i = 0; i < dispatcher->count; ++i) {
+		Shard *shard = &dispatcher->shards[i];
+		if ((shard->running || shard->starting) && !shard->used)
+			return;
+		if (free_shard == NULL && !shard->running && !shard->starting)
+			free_shard = shard;
+	}
+	if (free_shard != NULL)
+		start_shard(dispatcher, free_shard);
+}
+
+static bool
+start_shard(MinitermDispatcher *dispatcher, Shard *shard)
+{
+	char *argv[] = {dispatcher->executable, NULL};
+	char *index = g_strdup_printf("%d", shard->index);
+	char **envp = g_environ_setenv(
+		g_get_environ(), "MINITERM_SHARD", index, TRUE);
+	g_free(index);
+	GError *error = NULL;
+	const bool started = g_spawn_async(NULL, argv, envp,
+		G_SPAWN_SEARCH_PATH | G_SPAWN_DO_NOT_REAP_CHILD, NULL, NULL,
+		&shard->pid, &error);
+	g_strfreev(envp);
+	if (!started) {
+		g_printerr("Failed to start shard %d: %s\n", shard->index,
+			error->message);
+		g_error_free(error);
+		return false;
+	}
+	shard->exit_source =
+		g_child_watch_add(shard->pid, shard_exit_cb, shard);
+	shard->starting = true;
+	update_hold(dispatcher);
+	return true;
+}
+
+static void
+forward(Shard *shard, GApplicationCommandLine *command_line, bool header)
+{
+	if (!shard->running) {
+		g_queue_push_tail(&shard->waiting, g_object_ref(command_line));
+		return;
+	}
+	char **arguments =
+		g_application_command_line_get_arguments(command_line, NULL);
+	GVariant *platform_data =
+		g_application_command_line_get_platform_data(command_line);
+	if (platform_data == NULL)
+		platform_data = g_variant_ref_sink(
+			g_variant_new_array(G_VARIANT_TYPE("{sv}"), NULL, 0));
+	Forward *data = g_new(Forward, 1);
+	data->command_line = g_object_ref(command_line);
+	data->index = shard->index;
+	data->header = header;
+	/* The shard answers once the child was spawned. */
+	g_dbus_connection_call(shard->dispatcher->connection, shard->name,
+		shard->path, SHARD_INTERFACE, "CommandLine",
+		g_variant_new("(@aay@a{sv})",
+			g_variant_new_bytestring_array(
+				(const char *const *)arguments, -1),
+			platform_data),
+		G_VARIANT_TYPE("(iss)"), G_DBUS_CALL_FLAGS_NO_AUTO_START, -1,
+		NULL, forward_cb, data);
+	g_variant_unref(platform_data);
+	g_strfreev(arguments);
+}
+
+static void
+forward_cb(GObject *source, GAsyncResult *result, gpointer user_data)
+{
+	Forward *data = user_data;
+	GError *error = NULL;
+	GVariant *reply = g_dbus_connection_call_finish(
+		G_DBUS_CONNECTION(source), result, &error);
+	if (reply != NULL) {
+		int status = 0;
+		const char *out = NULL;
+		const char *err = NULL;
+		g_variant_get(reply, "(i&s&s)", &status, &out, &err);
+		if (data->header)
+			g_application_command_line_print(
+				data->command_line, "shard %d:\n", data->index);
+		if (*out != '\0')
+			g_application_command_line_print(
+				data->command_line, "%s", out);
+		if (*err != '\0')
+			g_application_command_line_printerr(
+				data->command_line, "%s", err);
+		if (status != EXIT_SUCCESS)
+			g_application_command_line_set_exit_status(
+				data->command_line, status);
+		g_variant_unref(reply);
+	} else {
+		g_application_command_line_printerr(data->command_line,
+			"Failed to reach shard %d: %s\n", data->index,
+			error->message);
+		g_application_command_line_set_exit_status(
+			data->command_line, EXIT_FAILURE);
+		g_error_free(error);
+	}
+	g_object_unref(data->command_line);
+	g_free(data);
+}
+
+static void
+fail_waiting(Shard *shard, const char *message)
+{
+	GApplicationCommandLine *command_line;
+	while ((command_line = g_queue_pop_head(&shard->waiting)) != NULL) {
+		g_application_command_line_printerr(command_line,
+			"Shard %d failed: %s\n", shard->index, message);
+		g_application_command_line_set_exit_status(
+			command_line, EXIT_FAILURE);
+		g_object_unref(command_line);
+	}
+}
+
+static void
+update_hold(MinitermDispatcher *dispatcher)
+{
+	bool active = false;
+	for (int i = 0; i < dispatcher->count; ++i) {
+		const Shard *shard = &dispatcher->shards[i];
+		active = active || shard->running || shard->starting;
+	}
+	if (active && !dispatcher->holding)
+		g_application_hold(dispatcher->app);
+	else if (!active && dispatcher->holding)
+		g_application_release(dispatcher->app);
+	dispatcher->holding = active;
+}
+
+static void
+stop_spares(MinitermDispatcher *dispatcher)
+{
+	if (dispatcher->keep_spare)
+		return;
+	for (int i = 0; i < dispatcher->count; ++i) {
+		const Shard *shard = &dispatcher->shards[i];
+		if ((shard->running || shard->starting) && shard->used)
+			return;
+	}
+	for (int i = 0; i < dispatcher->count; ++i) {
+		if (dispatcher->shards[i].pid != 0)
+			kill(dispatcher->shards[i].pid, SIGTERM);
+	}
+}
+
+static void
+shard_appeared_cb(GDBusConnection *connection, const char *name,
+	const char *owner, gpointer user_data)
+{
+	(void)connection;
+	(void)name;
+	(void)owner;
+	Shard *shard = user_data;
+	shard->running = true;
+	shard->starting = false;
+	GApplicationCommandLine *command_line;
+	while ((command_line = g_queue_pop_head(&shard->waiting)) != NULL) {
+		forward(shard, command_line, false);
+		g_object_unref(command_line);
+	}
+	update_hold(shard->dispatcher);
+}
+
+static void
+shard_vanished_cb(
+	GDBusConnection *connection, const char *name, gpointer user_data)
+{
+	(void)connection;
+	(void)name;
+	Shard *shard = user_data;
+	/* The name isn't taken yet right after starting. */
+	if (!shard->running)
+		return;
+	shard->running = false;
+	shard->used = false;
+	stop_spares(shard->dispatcher);
+	update_hold(shard->dispatcher);
+}
+
+static void
+shard_exit_cb(GPid pid, int status, gpointer user_data)
+{
+	(void)status;
+	Shard *shard = user_data;
+	g_spawn_close_pid(pid);
+	shard->pid = 0;
+	shard->exit_source = 0;
+	if (shard->starting) {
+		shard->starting = false;
+		shard->used = false;
+		fail_waiting(shard, "exited before it was ready");
+		stop_spares(shard->dispatcher);
+		update_hold(shard->dispatcher);
+	}
+}
@@ -0,0 +1,71 @@
+/*
+ * Copyright (c) 2018 Jason Waataja
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef MINITERM_SHARD_H
+#define MINITERM_SHARD_H
+
+#include <gio/gio.h>
+#include <stdbool.h>
+
+/*
+ * In sharded mode the primary instance is a dispatcher that hosts no windows
+ * itself. It forwards each command line to one of several worker processes,
+ * the shards, which are separate GApplications named after their index.
+ */
+
+typedef struct _MinitermDispatcher MinitermDispatcher;
+
+/* Returns the newly allocated application id of the shard with index. */
+char *miniterm_shard_get_id(int index);
+/*
+ * Exports the interface the dispatcher forwards command lines through. Each
+ * forwarded command line is emitted as "command-line" on app, as a remote
+ * command line. The shard is held until the first one arrives. Returns the
+ * registration id, or 0 and sets error.
+ */
+unsigned int miniterm_shard_register(GApplication *app,
+	GDBusConnection *connection, const char *object_path, GError **error);
+
+/*
+ * Returns a dispatcher spreading windows over count shards, which are started
+ * as needed. The application is held while any shard runs.
+ */
+MinitermDispatcher *miniterm_dispatcher_new(
+	GApplication *app, GDBusConnection *connection, int count);
+/* Stops watching the shards, they keep running. */
+void miniterm_dispatcher_free(MinitermDispatcher *dispatcher);
+/*
+ * Starts a shard without windows unless one already runs, so the next window
+ * doesn't wait for a shard to start, and keeps it running once the last
+ * window is closed.
+ */
+void miniterm_dispatcher_keep_spare(MinitermDispatcher *dispatcher);
+/*
+ * Forwards command_line to the least loaded shard, or with tab set to the
+ * shard that opened the last window. The running shards are asked for their
+ * load in parallel, without blocking. With usage set, it is forwarded to every
+ * shard to report its scrollback usage.
+ */
+void miniterm_dispatcher_forward(MinitermDispatcher *dispatcher,
+	GApplicationCommandLine *command_line, bool tab, bool usage);
+
+#endif /* MINITERM_SHARD_H */
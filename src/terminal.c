@@ -22,29 +22,175 @@
 
 #include "terminal.h"
 
-#include <sys/stat.h>
+#include <glib/gstdio.h>
+#include <math.h>
+#include <signal.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
 
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#include "application.h"
+#include "capture.h"
 #include "config.h"
+#include "export.h"
+#include "hibernate.h"
+#include "links.h"
+#include "log.h"
+#include "modes.h"
+#include "paste.h"
+#include "proxy.h"
+#include "search.h"
+#include "trace.h"
+#include "window.h"
+#include "zygote.h"
 
 struct _MinitermTerminal {
 	VteTerminal parent;
 };
 
+/* The caller's callback while a spawn is running. */
+typedef struct {
+	MinitermTerminal *terminal;
+	/* Whether the spawn helper runs the child rather than vte. */
+	bool zygote;
+	/* Whether the proxy reads the pty rather than vte. */
+	bool proxy;
+	MinitermSpawnCallback callback;
+	gpointer user_data;
+} SpawnData;
+
+/* How much drawing is held back for a terminal. */
+typedef enum {
+	THROTTLE_NONE,
+	/* Redraw at most every UNFOCUSED_REDRAW_INTERVAL. */
+	THROTTLE_SLOW,
+	/* Don't redraw until the window is visible again. */
+	THROTTLE_SUSPEND,
+} Throttle;
+
 typedef struct _MinitermTerminalPrivate MinitermTerminalPrivate;
 
 struct _MinitermTerminalPrivate {
+	unsigned int id;
 	/* Title passed from command line. The value NULL indicates no title. */
 	char *cmd_title;
+	/* Command of the last spawn. NULL indicates the user's shell. */
+	char *command;
 	int default_font_size;
+	/* The applied settings snapshot. NULL until settings are first set. */
+	MinitermSettings *settings;
+	/* 0 until a child is spawned. */
+	GPid child_pid;
+	/* Whether the child is watched by the spawn helper rather than vte. */
+	bool zygote_child;
+	/* Watch of a child spawned on the proxy's pty. 0 indicates none. */
+	unsigned int child_watch;
+	/* Reads the pty when flood control is on, otherwise NULL. */
+	MinitermProxy *proxy;
+	/* The pty the proxy reads, vte has none then. */
+	VtePty *proxy_pty;
+	/* Log file passed from the command line, otherwise NULL. */
+	char *log_path;
+	/* Gets the child's output from the proxy, NULL if not logging. */
+	MinitermLog *log;
+	/* Capture file passed from the command line, otherwise NULL. */
+	char *capture_path;
+	/* Records the child's output from the proxy, NULL if not capturing. */
+	MinitermCapture *capture;
+	/* Status of the exited child while the proxy drains its output. */
+	int exit_status;
+	/* Set by dispose, a spawn can still finish after that. */
+	bool disposed;
+	/* Set by the scrollback budget. Negative indicates no limit. */
+	long scrollback_limit;
+	/* File holding the contents while hibernated, otherwise NULL. */
+	char *hibernate_path;
+	/*
+	 * The save into a new hibernate_path, or the restore from it while
+	 * waking. NULL indicates neither.
+	 */
+	MinitermHibernate *hibernate;
+	/* Output held back while waking. NULL indicates none. */
+	GByteArray *held_output;
+	/* Timeout that hibernates the unfocused terminal. 0 indicates none. */
+	unsigned int hibernate_source;
+	/* Modes the child set, followed in its output by the proxy. */
+	MinitermModes *modes;
+	/*
+	 * Timeout that applies a size change once it settled, the old grid is
+	 * kept until then. 0 indicates none.
+	 */
+	unsigned int resize_source;
+	/* Set once the size settled, until the next allocation. */
+	bool resize_settled;
+
+	/* State of window, tracked for throttling. */
+	bool window_hidden;
+	bool window_obscured;
+	/*
+	 * The last frame drawn while throttled, painted instead of drawing
+	 * again until a redraw is due. NULL indicates none.
+	 */
+	cairo_surface_t *snapshot;
+	int snapshot_width;
+	int snapshot_height;
+	/* Timeout that lets a throttled terminal redraw. 0 indicates none. */
+	unsigned int redraw_source;
+
+	/* Counters, see MinitermTerminalStats. */
+	guint64 bytes_read;
+	double byte_rate;
+	gint64 byte_rate_time;
+	guint64 frames;
+	gint64 process_time;
+	gint64 draw_time;
+	/* When the pty became readable, or 0 if output was processed since. */
+	gint64 output_time;
+	/* When the current frame started drawing, 0 if none is. */
+	gint64 draw_start;
+	/*
+	 * Samples the output of a pty vte reads itself, either watching it or
+	 * waiting for vte to read. 0 indicates neither.
+	 */
+	unsigned int stats_watch;
+	/* Bytes already counted that were still queued in the pty. */
+	int stats_queued;
+	/* Overlay label showing the counters, NULL until first shown. */
+	GtkWidget *stats_label;
+	/* Timeout refreshing stats_label while shown. 0 indicates none. */
+	unsigned int stats_source;
+	/* The search bar, NULL until first shown. */
+	MinitermSearch *search;
+	/* Pastes the clipboard, NULL until the first paste. */
+	MinitermPaste *paste;
+	/* Exports of the scrollback still running. */
+	GList *exports;
+
+	/* Histograms by MinitermLatencyStage. NULL when not measuring. */
+	MinitermHistogram *latency;
+	/*
+	 * The keystroke being timed. Times are 0 for stages it hasn't reached
+	 * and the delay is negative if the event time is unusable.
+	 */
+	gint64 key_time;
+	gint64 key_delay;
+	gint64 commit_time;
+	gint64 echo_time;
+	bool echo_processed;
 
 	/*
 	 * The following references are not owned and shouldn't be refed or
 	 * unrefed. This object is actually owned by window.
 	 */
 	GtkWindow *window;
+	GtkWidget *container;
 	GtkWidget *scrolled_window;
 
 	/* Signal handlers. 0 indicates no signal connected. */
+	unsigned long exit_handler;
 	unsigned long bell_handler;
 	unsigned long focus_in_handler;
 	unsigned long focus_out_handler;
@@ -54,7 +200,18 @@ struct _MinitermTerminalPrivate {
 G_DEFINE_TYPE_WITH_PRIVATE(
 	MinitermTerminal, miniterm_terminal, VTE_TYPE_TERMINAL)
 
+static void miniterm_terminal_dispose(GObject *terminal);
 static void miniterm_terminal_finalize(GObject *terminal);
+/* Focus handlers that wake the terminal and start the hibernation timer. */
+static gboolean miniterm_terminal_focus_in(
+	GtkWidget *widget, GdkEventFocus *event);
+static gboolean miniterm_terminal_focus_out(
+	GtkWidget *widget, GdkEventFocus *event);
+/* Keeps the grid while the size changes, according to the rewrap setting. */
+static void miniterm_terminal_size_allocate(
+	GtkWidget *widget, GtkAllocation *allocation);
+/* Draws the snapshot instead of the contents while throttled. */
+static gboolean miniterm_terminal_draw(GtkWidget *widget, cairo_t *cr);
 
 /*
  * Sets the terminal's settings from the given settings. Ensures that all
@@ -62,10 +219,77 @@ static void miniterm_terminal_finalize(GObject *terminal);
  */
 static void update_from_settings(
 	MinitermTerminal *terminal, MinitermSettings *settings);
+/* Shows the search bar, creating it the first time. */
+static void show_search(MinitermTerminal *terminal);
+/* Starts pasting the clipboard into the child. */
+static void paste_clipboard(MinitermTerminal *terminal);
+/* Asks for a file to export the scrollback to. */
+static void export_to_file(MinitermTerminal *terminal);
+static void export_response_cb(
+	GtkDialog *dialog, int response, gpointer user_data);
+/* Pipes the scrollback to the configured export command. */
+static void export_to_command(MinitermTerminal *terminal);
+static void export_done_cb(
+	MinitermExport *export, const GError *error, gpointer user_data);
+/* Applies the configured scrollback, capped by the scrollback budget. */
+static void update_scrollback_lines(MinitermTerminal *terminal);
 
 /* Returns a GtkScrolledWindow containing widget. */
 static GtkWidget *make_scrolled_window(GtkScrollable *widget,
 	GtkPolicyType hbar_policy, GtkPolicyType vbar_policy);
+/*
+ * Sends the spawn to the helper on a new pty. Returns false if vte has to
+ * spawn the child instead.
+ */
+static bool zygote_spawn(MinitermTerminal *terminal,
+	const char *working_directory, char **argv, char **environment,
+	SpawnData *data);
+/*
+ * Spawns the child on a new pty read by the proxy. Returns false if nothing
+ * needs the proxy or it couldn't be started.
+ */
+static bool proxy_spawn(MinitermTerminal *terminal,
+	const char *working_directory, char **argv, char **environment,
+	SpawnData *data);
+/* Returns a new pty with the size of terminal, or NULL on failure. */
+static VtePty *new_pty(MinitermTerminal *terminal);
+/* Returns a new environment with the variables vte sets for its children. */
+static char **get_child_environment(char **environment);
+/*
+ * Starts reading pty through a proxy if flood control, logging, capturing or
+ * hibernation is on. Returns false if vte should read it instead.
+ */
+static bool start_proxy(MinitermTerminal *terminal, VtePty *pty);
+/* Opens the log the output should go to. Returns NULL if there is none. */
+static MinitermLog *open_log(MinitermTerminal *terminal);
+/* Opens the capture file. Returns NULL if there is none. */
+static MinitermCapture *open_capture(MinitermTerminal *terminal);
+/* Callbacks finishing miniterm_terminal_spawn(). */
+static void spawn_cb(
+	VteTerminal *vte, GPid pid, GError *error, gpointer user_data);
+static void zygote_spawn_cb(GPid pid, int error, gpointer user_data);
+static void pty_spawn_cb(
+	GObject *source, GAsyncResult *result, gpointer user_data);
+static void spawn_finish(SpawnData *data, GPid pid, GError *error);
+/* Callbacks for the exit of a child vte doesn't watch. */
+static void zygote_exit_cb(GPid pid, int status, gpointer user_data);
+static void child_watch_cb(GPid pid, int status, gpointer user_data);
+/* Reports a child the spawn helper left behind as exited. */
+static void orphan_eof_cb(MinitermTerminal *terminal, gpointer user_data);
+/* Reaps a child whose terminal is gone. */
+static void reap_cb(GPid pid, int status, gpointer user_data);
+/* Emits child-exited once the proxy handled the child's last output. */
+static void child_exited(MinitermTerminal *terminal, int status);
+static void proxy_drained_cb(gpointer user_data);
+/* Proxy callbacks standing in for vte's own pty handling. */
+static void tee_cb(const char *data, size_t length, gpointer user_data);
+static void proxy_output_cb(
+	const char *data, size_t length, gpointer user_data);
+static void proxy_flood_cb(bool flooding, gpointer user_data);
+static void proxy_commit_cb(MinitermTerminal *terminal, char *text,
+	unsigned int size, gpointer user_data);
+static void proxy_size_cb(
+	GtkWidget *terminal, GdkRectangle *allocation, gpointer user_data);
 /* Callback to set window urgency hint on beep events. */
 static void window_urgency_hint_cb(
 	MinitermTerminal *terminal, gpointer user_data);
@@ -75,30 +299,179 @@ static gboolean window_focus_cb(GtkWindow *window);
 static void window_title_cb(MinitermTerminal *terminal);
 /* Callback to react to key press events. */
 static gboolean key_press_cb(MinitermTerminal *terminal, GdkEventKey *event);
+/* Callback to open the link under the pointer on Ctrl+click. */
+static gboolean button_press_cb(
+	MinitermTerminal *terminal, GdkEventButton *event);
 static void exit_cb(
 	MinitermTerminal *terminal, gint status, gpointer user_data);
 
+/* Opens a new tab next to terminal, in the same directory. */
+static void open_tab(MinitermTerminal *terminal);
+/* Returns whether window is a MinitermWindow with more than one tab. */
+static bool has_other_tabs(GtkWindow *window);
+/* Callback to close a new tab whose child couldn't be spawned. */
+static void tab_spawn_cb(MinitermTerminal *tab, GPid pid, GError *error,
+	gpointer user_data);
+
 /* Increases the font size of the terminal. */
 static void increase_font_size(MinitermTerminal *terminal);
 /* Decreases the font size of the terminal. */
 static void decrease_font_size(MinitermTerminal *terminal);
 /* Resets the font size of the terminal. */
 static void reset_font_size(MinitermTerminal *terminal);
+/* Sets the font of the terminal and the other tabs in its window. */
+static void set_window_font(
+	MinitermTerminal *terminal, const PangoFontDescription *font);
 
 /* Clears all signal handlers if they exist. */
 static void clear_signal_handlers(MinitermTerminal *terminal);
 
+/* Returns how much drawing should be held back for terminal right now. */
+static Throttle get_throttle(MinitermTerminal *terminal);
+/* Drops the snapshot once the terminal isn't throttled anymore. */
+static void update_throttle(MinitermTerminal *terminal);
+/* Lets a throttled terminal redraw once the interval has passed. */
+static void schedule_redraw(MinitermTerminal *terminal);
+static gboolean redraw_cb(gpointer user_data);
+/* Callbacks that track the state of the window. */
+static gboolean window_state_cb(
+	GtkWidget *window, GdkEventWindowState *event, gpointer user_data);
+static gboolean window_visibility_cb(
+	GtkWidget *window, GdkEventVisibility *event, gpointer user_data);
+static void window_active_cb(
+	GObject *window, GParamSpec *pspec, gpointer user_data);
+/* Callbacks that track the terminal itself. */
+static void throttle_map_cb(GtkWidget *terminal, gpointer user_data);
+static void throttle_contents_cb(
+	MinitermTerminal *terminal, gpointer user_data);
+
+/* Counts length bytes of output that are about to be processed. */
+static void record_output(MinitermTerminal *terminal, size_t length);
+/*
+ * Watches the pty of a terminal without a proxy for output. The watch runs
+ * just before vte reads, counting what is queued, and is set up again once
+ * vte read it.
+ */
+static void watch_output(MinitermTerminal *terminal);
+static gboolean stats_output_cb(
+	int fd, GIOCondition condition, gpointer user_data);
+/* Runs after vte's read, watching again unless vte held back. */
+static gboolean stats_read_cb(gpointer user_data);
+/* Returns the bytes of output queued in the pty, 0 if unknown. */
+static int get_queued(int fd);
+/* Ends timing the processing of output, at least part of it is shown now. */
+static void stats_contents_cb(MinitermTerminal *terminal, gpointer user_data);
+/*
+ * Ends timing the processing of output that only changed the title, rang the
+ * bell or moved the cursor, since no contents change follows for it.
+ */
+static void stats_processed_cb(MinitermTerminal *terminal, gpointer user_data);
+static gboolean stats_draw_cb(
+	GtkWidget *terminal, cairo_t *cr, gpointer user_data);
+static gboolean stats_draw_after_cb(
+	GtkWidget *terminal, cairo_t *cr, gpointer user_data);
+/* Starts timing a keystroke unless one is already being timed. */
+static void latency_key_press(MinitermTerminal *terminal, GdkEventKey *event);
+static void latency_commit_cb(MinitermTerminal *terminal, char *text,
+	unsigned int size, gpointer user_data);
+/* Records the keystroke once the frame showing its echo is drawn. */
+static void latency_frame(MinitermTerminal *terminal);
+static void latency_reset(MinitermTerminal *terminal);
+/* Returns the byte rate decayed to now. */
+static double get_byte_rate(MinitermTerminalPrivate *priv, gint64 now);
+/* Timeout callback refreshing the overlay. */
+static gboolean update_stats_label(gpointer user_data);
+
+/* Timeout callback that moves the contents of the terminal to a file. */
+static gboolean hibernate_cb(gpointer user_data);
+/* Callback to apply the size a terminal settled on. */
+static gboolean resize_cb(gpointer user_data);
+/* Returns the file the terminal hibernates into, to be freed. */
+static char *get_hibernate_path(MinitermTerminal *terminal);
+/* Called once the contents are saved to the hibernate path. */
+static void hibernated_cb(
+	MinitermHibernate *hibernate, const GError *error, gpointer user_data);
+/* Starts restoring the contents of a hibernated terminal. */
+static void wake(MinitermTerminal *terminal);
+/* Called once the contents are restored from hibernate_path. */
+static void restored_cb(
+	MinitermHibernate *hibernate, const GError *error, gpointer user_data);
+/* Returns whether the contents are being restored. */
+static bool is_waking(MinitermTerminal *terminal);
+/* Draws the contents as they are into the snapshot. */
+static void take_snapshot(MinitermTerminal *terminal);
+
+/* One-shot callbacks recording the first output and frame when tracing. */
+static void trace_first_output_cb(
+	MinitermTerminal *terminal, gpointer user_data);
+static gboolean trace_first_draw_cb(
+	GtkWidget *widget, cairo_t *cr, gpointer user_data);
+
 static void
 miniterm_terminal_init(MinitermTerminal *terminal)
 {
+	static unsigned int last_id = 0;
 	MinitermTerminalPrivate *priv =
 		miniterm_terminal_get_instance_private(terminal);
+	priv->id = ++last_id;
 	priv->cmd_title = NULL;
+	priv->command = NULL;
 	priv->default_font_size = 0;
+	priv->settings = NULL;
+
+	priv->child_pid = 0;
+	priv->child_watch = 0;
+	priv->proxy = NULL;
+	priv->proxy_pty = NULL;
+	priv->log_path = NULL;
+	priv->log = NULL;
+	priv->capture_path = NULL;
+	priv->capture = NULL;
+	priv->exit_status = 0;
+	priv->scrollback_limit = -1;
+	priv->hibernate_path = NULL;
+	priv->hibernate = NULL;
+	priv->held_output = NULL;
+	priv->hibernate_source = 0;
+	priv->modes = miniterm_modes_new();
+	priv->resize_source = 0;
+	priv->resize_settled = false;
+
+	priv->window_hidden = false;
+	priv->window_obscured = false;
+	priv->snapshot = NULL;
+	priv->snapshot_width = 0;
+	priv->snapshot_height = 0;
+	priv->redraw_source = 0;
+
+	priv->bytes_read = 0;
+	priv->byte_rate = 0;
+	priv->byte_rate_time = 0;
+	priv->frames = 0;
+	priv->process_time = 0;
+	priv->draw_time = 0;
+	priv->output_time = 0;
+	priv->draw_start = 0;
+	priv->stats_watch = 0;
+	priv->stats_queued = 0;
+	priv->stats_label = NULL;
+	priv->stats_source = 0;
+	priv->search = NULL;
+	priv->paste = NULL;
+	priv->exports = NULL;
+
+	priv->latency = NULL;
+	priv->key_time = 0;
+	priv->key_delay = -1;
+	priv->commit_time = 0;
+	priv->echo_time = 0;
+	priv->echo_processed = false;
 
 	priv->window = NULL;
+	priv->container = NULL;
 	priv->scrolled_window = NULL;
 
+	priv->exit_handler = 0;
 	priv->bell_handler = 0;
 	priv->focus_in_handler = 0;
 	priv->focus_out_handler = 0;
@@ -111,13 +484,130 @@ miniterm_terminal_init(MinitermTerminal *terminal)
 		VTE_TERMINAL(terminal), WORD_CHARS);
 	g_signal_connect(
 		terminal, "key-press-event", G_CALLBACK(key_press_cb), NULL);
+	g_signal_connect(terminal, "button-press-event",
+		G_CALLBACK(button_press_cb), NULL);
+#if VTE_CHECK_VERSION(0, 52, 0)
+	/* Don't keep a timer running for blinking text nobody is looking at. */
+	vte_terminal_set_text_blink_mode(
+		VTE_TERMINAL(terminal), VTE_TEXT_BLINK_FOCUSED);
+#endif
+	g_signal_connect(terminal, "map", G_CALLBACK(throttle_map_cb), NULL);
+	g_signal_connect(terminal, "unmap", G_CALLBACK(throttle_map_cb), NULL);
+	g_signal_connect(terminal, "contents-changed",
+		G_CALLBACK(throttle_contents_cb), NULL);
+	g_signal_connect(terminal, "contents-changed",
+		G_CALLBACK(stats_contents_cb), NULL);
+	g_signal_connect(terminal, "window-title-changed",
+		G_CALLBACK(stats_processed_cb), NULL);
+	g_signal_connect(
+		terminal, "bell", G_CALLBACK(stats_processed_cb), NULL);
+	g_signal_connect(terminal, "cursor-moved",
+		G_CALLBACK(stats_processed_cb), NULL);
+	g_signal_connect(terminal, "draw", G_CALLBACK(stats_draw_cb), NULL);
+	g_signal_connect(
+		terminal, "commit", G_CALLBACK(latency_commit_cb), NULL);
+	g_signal_connect(
+		terminal, "commit", G_CALLBACK(proxy_commit_cb), NULL);
+	g_signal_connect_after(
+		terminal, "size-allocate", G_CALLBACK(proxy_size_cb), NULL);
+	g_signal_connect_after(
+		terminal, "draw", G_CALLBACK(stats_draw_after_cb), NULL);
+	if (miniterm_trace_enabled()) {
+		g_signal_connect(terminal, "contents-changed",
+			G_CALLBACK(trace_first_output_cb), NULL);
+		g_signal_connect_after(terminal, "draw",
+			G_CALLBACK(trace_first_draw_cb), NULL);
+	}
 }
 
 static void
 miniterm_terminal_class_init(MinitermTerminalClass *kclass)
 {
 	GObjectClass *object_class = G_OBJECT_CLASS(kclass);
+	GtkWidgetClass *widget_class = GTK_WIDGET_CLASS(kclass);
+	object_class->dispose = miniterm_terminal_dispose;
 	object_class->finalize = miniterm_terminal_finalize;
+	widget_class->focus_in_event = miniterm_terminal_focus_in;
+	widget_class->focus_out_event = miniterm_terminal_focus_out;
+	widget_class->size_allocate = miniterm_terminal_size_allocate;
+	widget_class->draw = miniterm_terminal_draw;
+}
+
+static void
+miniterm_terminal_dispose(GObject *terminal)
+{
+	MinitermTerminalPrivate *priv = miniterm_terminal_get_instance_private(
+		MINITERM_TERMINAL(terminal));
+	if (priv->hibernate_source != 0) {
+		g_source_remove(priv->hibernate_source);
+		priv->hibernate_source = 0;
+	}
+	if (priv->resize_source != 0) {
+		g_source_remove(priv->resize_source);
+		priv->resize_source = 0;
+	}
+	g_clear_pointer(&priv->hibernate, miniterm_hibernate_free);
+	g_clear_pointer(&priv->held_output, g_byte_array_unref);
+	if (priv->hibernate_path != NULL) {
+		g_unlink(priv->hibernate_path);
+		g_free(priv->hibernate_path);
+		priv->hibernate_path = NULL;
+	}
+	if (priv->stats_watch != 0) {
+		g_source_remove(priv->stats_watch);
+		priv->stats_watch = 0;
+	}
+	if (priv->stats_source != 0) {
+		g_source_remove(priv->stats_source);
+		priv->stats_source = 0;
+	}
+	if (priv->search != NULL) {
+		miniterm_search_free(priv->search);
+		priv->search = NULL;
+	}
+	if (priv->paste != NULL) {
+		miniterm_paste_free(priv->paste);
+		priv->paste = NULL;
+	}
+	g_list_free_full(priv->exports, (GDestroyNotify)miniterm_export_free);
+	priv->exports = NULL;
+	priv->disposed = true;
+	/* Vte only hangs up on children it spawned on its own pty. */
+	if (priv->zygote_child) {
+		miniterm_zygote_unwatch(priv->child_pid);
+		kill(priv->child_pid, SIGHUP);
+		priv->zygote_child = false;
+	}
+	if (priv->child_watch != 0) {
+		g_source_remove(priv->child_watch);
+		priv->child_watch = 0;
+		kill(priv->child_pid, SIGHUP);
+		g_child_watch_add(priv->child_pid, reap_cb, NULL);
+	}
+	/* Don't let a slow disk hold up stopping the proxy. */
+	if (priv->log != NULL)
+		miniterm_log_close(priv->log);
+	if (priv->capture != NULL)
+		miniterm_capture_close(priv->capture);
+	if (priv->proxy != NULL) {
+		miniterm_proxy_free(priv->proxy);
+		priv->proxy = NULL;
+	}
+	if (priv->log != NULL) {
+		miniterm_log_free(priv->log);
+		priv->log = NULL;
+	}
+	if (priv->capture != NULL) {
+		miniterm_capture_free(priv->capture);
+		priv->capture = NULL;
+	}
+	g_clear_object(&priv->proxy_pty);
+	if (priv->redraw_source != 0) {
+		g_source_remove(priv->redraw_source);
+		priv->redraw_source = 0;
+	}
+	g_clear_pointer(&priv->snapshot, cairo_surface_destroy);
+	G_OBJECT_CLASS(miniterm_terminal_parent_class)->dispose(terminal);
 }
 
 static void
@@ -126,9 +616,144 @@ miniterm_terminal_finalize(GObject *terminal)
 	MinitermTerminalPrivate *priv = miniterm_terminal_get_instance_private(
 		MINITERM_TERMINAL(terminal));
 	g_free(priv->cmd_title);
+	g_free(priv->command);
+	g_free(priv->log_path);
+	g_free(priv->capture_path);
+	g_free(priv->latency);
+	miniterm_modes_free(priv->modes);
+	if (priv->settings != NULL)
+		miniterm_settings_unref(priv->settings);
 	G_OBJECT_CLASS(miniterm_terminal_parent_class)->finalize(terminal);
 }
 
+static gboolean
+miniterm_terminal_focus_in(GtkWidget *widget, GdkEventFocus *event)
+{
+	MinitermTerminal *terminal = MINITERM_TERMINAL(widget);
+	MinitermTerminalPrivate *priv =
+		miniterm_terminal_get_instance_private(terminal);
+	if (priv->hibernate_source != 0) {
+		g_source_remove(priv->hibernate_source);
+		priv->hibernate_source = 0;
+	}
+	wake(terminal);
+	return GTK_WIDGET_CLASS(miniterm_terminal_parent_class)
+		->focus_in_event(widget, event);
+}
+
+static gboolean
+miniterm_terminal_focus_out(GtkWidget *widget, GdkEventFocus *event)
+{
+	MinitermTerminalPrivate *priv = miniterm_terminal_get_instance_private(
+		MINITERM_TERMINAL(widget));
+	if (priv->settings != NULL && priv->settings->hibernate_after > 0
+		&& priv->hibernate_source == 0)
+		priv->hibernate_source = g_timeout_add_seconds(
+			priv->settings->hibernate_after, hibernate_cb, widget);
+	return GTK_WIDGET_CLASS(miniterm_terminal_parent_class)
+		->focus_out_event(widget, event);
+}
+
+static void
+miniterm_terminal_size_allocate(GtkWidget *widget, GtkAllocation *allocation)
+{
+	MinitermTerminalPrivate *priv = miniterm_terminal_get_instance_private(
+		MINITERM_TERMINAL(widget));
+	VteTerminal *vte = VTE_TERMINAL(widget);
+	GtkAllocation current;
+	gtk_widget_get_allocation(widget, &current);
+	const glong char_width = vte_terminal_get_char_width(vte);
+	const glong char_height = vte_terminal_get_char_height(vte);
+	GtkStyleContext *context = gtk_widget_get_style_context(widget);
+	GtkBorder padding;
+	gtk_style_context_get_padding(
+		context, gtk_style_context_get_state(context), &padding);
+	const int padding_width = padding.left + padding.right;
+	const int padding_height = padding.top + padding.bottom;
+	/*
+	 * The first allocation sizes the grid right away, as do later ones
+	 * that don't change it. A waking terminal keeps its grid until the
+	 * contents are restored, which sizes it again.
+	 */
+	const bool waking = is_waking(MINITERM_TERMINAL(widget));
+	if (priv->settings == NULL || current.width <= 1
+		|| char_width <= 0 || char_height <= 0
+		|| (!waking
+			&& (priv->settings->rewrap == MINITERM_REWRAP_FULL
+				|| priv->resize_settled))
+		|| ((allocation->width - padding_width) / char_width
+			       == vte_terminal_get_column_count(vte)
+			&& (allocation->height - padding_height) / char_height
+				== vte_terminal_get_row_count(vte))) {
+		priv->resize_settled = false;
+		if (priv->resize_source != 0) {
+			g_source_remove(priv->resize_source);
+			priv->resize_source = 0;
+		}
+		const glong columns = vte_terminal_get_column_count(vte);
+		const glong rows = vte_terminal_get_row_count(vte);
+		GTK_WIDGET_CLASS(miniterm_terminal_parent_class)
+			->size_allocate(widget, allocation);
+		/*
+		 * Restore the scrollback of a hibernated terminal above the
+		 * screen as vte resized it, so it is rewrapped to the new
+		 * size too.
+		 */
+		if (vte_terminal_get_column_count(vte) != columns
+			|| vte_terminal_get_row_count(vte) != rows)
+			wake(MINITERM_TERMINAL(widget));
+		return;
+	}
+	/*
+	 * Vte rewraps the scrollback and the child redraws for every size it
+	 * gets, so hand it one that keeps the grid until the size settles.
+	 */
+	if (priv->resize_source != 0) {
+		g_source_remove(priv->resize_source);
+		priv->resize_source = 0;
+	}
+	if (!waking)
+		priv->resize_source =
+			g_timeout_add(RESIZE_DELAY, resize_cb, widget);
+	GtkAllocation kept = *allocation;
+	kept.width = vte_terminal_get_column_count(vte) * char_width
+		+ padding_width;
+	kept.height =
+		vte_terminal_get_row_count(vte) * char_height + padding_height;
+	GTK_WIDGET_CLASS(miniterm_terminal_parent_class)
+		->size_allocate(widget, &kept);
+}
+
+static gboolean
+miniterm_terminal_draw(GtkWidget *widget, cairo_t *cr)
+{
+	MinitermTerminal *terminal = MINITERM_TERMINAL(widget);
+	MinitermTerminalPrivate *priv =
+		miniterm_terminal_get_instance_private(terminal);
+	GtkWidgetClass *parent_class =
+		GTK_WIDGET_CLASS(miniterm_terminal_parent_class);
+	if (get_throttle(terminal) == THROTTLE_NONE) {
+		g_clear_pointer(&priv->snapshot, cairo_surface_destroy);
+		return parent_class->draw(widget, cr);
+	}
+	/*
+	 * Only the terminal holds back, the rest of the window and parts of it
+	 * that are uncovered are still drawn, from the snapshot. A new size
+	 * can't wait for the next redraw, unless the terminal is waking and
+	 * would show half restored contents.
+	 */
+	const int width = gtk_widget_get_allocated_width(widget);
+	const int height = gtk_widget_get_allocated_height(widget);
+	if (priv->snapshot == NULL
+		|| (!is_waking(terminal)
+			&& (priv->snapshot_width != width
+				|| priv->snapshot_height != height)))
+		take_snapshot(terminal);
+	cairo_set_source_surface(cr, priv->snapshot, 0, 0);
+	cairo_paint(cr);
+	return FALSE;
+}
+
 MinitermTerminal *
 miniterm_terminal_new(bool keep, const char *title, GtkWindow *window)
 {
@@ -137,205 +762,1120 @@ miniterm_terminal_new(bool keep, const char *title, GtkWindow *window)
 		miniterm_terminal_get_instance_private(terminal);
 	priv->cmd_title = g_strdup(title);
 	priv->window = window;
+	/* The overlay holds the statistics shown over the terminal. */
+	priv->container = gtk_overlay_new();
 	GtkWidget *box = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 0);
-	gtk_container_add(GTK_CONTAINER(priv->window), box);
 	priv->scrolled_window = make_scrolled_window(
 		GTK_SCROLLABLE(terminal), GTK_POLICY_NEVER, GTK_POLICY_NEVER);
-	gtk_box_pack_start(GTK_BOX(box), priv->scrolled_window, TRUE, TRUE, 0);
-	if (!keep)
-		g_signal_connect(
-			terminal, "child-exited", G_CALLBACK(exit_cb), window);
+	gtk_box_pack_start(
+		GTK_BOX(box), priv->scrolled_window, TRUE, TRUE, 0);
+	gtk_container_add(GTK_CONTAINER(priv->container), box);
+	miniterm_terminal_set_keep(terminal, keep);
+
+	/* Disconnected when the terminal goes away. */
+	gtk_widget_add_events(GTK_WIDGET(window), GDK_VISIBILITY_NOTIFY_MASK);
+	g_signal_connect_object(window, "window-state-event",
+		G_CALLBACK(window_state_cb), terminal, 0);
+	g_signal_connect_object(window, "visibility-notify-event",
+		G_CALLBACK(window_visibility_cb), terminal, 0);
+	g_signal_connect_object(window, "notify::is-active",
+		G_CALLBACK(window_active_cb), terminal, 0);
 	return terminal;
 }
 
-static void
-update_from_settings(MinitermTerminal *terminal, MinitermSettings *settings)
+unsigned int
+miniterm_terminal_get_id(MinitermTerminal *terminal)
 {
 	MinitermTerminalPrivate *priv =
 		miniterm_terminal_get_instance_private(terminal);
-	vte_terminal_set_audible_bell(
-		VTE_TERMINAL(terminal), settings->audible_bell);
-	vte_terminal_set_scrollback_lines(
-		VTE_TERMINAL(terminal), settings->scrollback_lines);
-	vte_terminal_set_mouse_autohide(
-		VTE_TERMINAL(terminal), settings->autohide_mouse);
-	clear_signal_handlers(terminal);
-	if (settings->urgent_on_bell) {
-		priv->bell_handler = g_signal_connect(terminal, "bell",
-			G_CALLBACK(window_urgency_hint_cb), NULL);
-		priv->focus_in_handler = g_signal_connect(priv->window,
-			"focus-in-event", G_CALLBACK(window_focus_cb), NULL);
-		priv->focus_out_handler = g_signal_connect(priv->window,
-			"focus-out-event", G_CALLBACK(window_focus_cb), NULL);
-	}
-	if (settings->dynamic_window_title && !priv->cmd_title)
-		priv->window_title_changed_handler =
-			g_signal_connect(terminal, "window-title-changed",
-				G_CALLBACK(window_title_cb), NULL);
-	if (settings->font_name != NULL) {
-		PangoFontDescription *font =
-			pango_font_description_from_string(settings->font_name);
-		vte_terminal_set_font(VTE_TERMINAL(terminal), font);
-		priv->default_font_size = pango_font_description_get_size(font);
-		if (priv->default_font_size == 0)
-			priv->default_font_size = 12 * PANGO_SCALE;
-		pango_font_description_free(font);
+	return priv->id;
+}
+
+GtkWidget *
+miniterm_terminal_get_container(MinitermTerminal *terminal)
+{
+	MinitermTerminalPrivate *priv =
+		miniterm_terminal_get_instance_private(terminal);
+	return priv->container;
+}
+
+const char *
+miniterm_terminal_get_title(MinitermTerminal *terminal)
+{
+	MinitermTerminalPrivate *priv =
+		miniterm_terminal_get_instance_private(terminal);
+	if (priv->cmd_title != NULL)
+		return priv->cmd_title;
+	if (priv->settings != NULL && priv->settings->dynamic_window_title) {
+		const char *title =
+			vte_terminal_get_window_title(VTE_TERMINAL(terminal));
+		if (title != NULL && *title != '\0')
+			return title;
 	}
-	if (settings->columns > 0 || settings->rows > 0) {
-		int cols = vte_terminal_get_row_count(VTE_TERMINAL(terminal));
-		int rows =
-			vte_terminal_get_column_count(VTE_TERMINAL(terminal));
-		if (settings->columns > 0)
-			cols = settings->columns;
-		if (settings->rows > 0)
-			rows = settings->rows;
-		vte_terminal_set_size(VTE_TERMINAL(terminal), cols, rows);
+	return "miniterm";
+}
+
+char *
+miniterm_terminal_get_cwd(MinitermTerminal *terminal)
+{
+	MinitermTerminalPrivate *priv =
+		miniterm_terminal_get_instance_private(terminal);
+	/* Prefer what the shell reported with OSC 7. */
+	const char *uri =
+		vte_terminal_get_current_directory_uri(VTE_TERMINAL(terminal));
+	if (uri != NULL) {
+		char *cwd = g_filename_from_uri(uri, NULL, NULL);
+		if (cwd != NULL)
+			return cwd;
 	}
-	if (settings->has_colors)
-		vte_terminal_set_colors(VTE_TERMINAL(terminal),
-			&settings->fg_color, &settings->bg_color,
-			settings->color_palette, MINITERM_COLOR_COUNT);
-	/* Never use a horizontal scrollbar. */
-	gtk_scrolled_window_set_policy(
-		GTK_SCROLLED_WINDOW(priv->scrolled_window), GTK_POLICY_NEVER,
-		settings->scrollbar_type);
+	if (priv->child_pid == 0)
+		return NULL;
+	char *proc_path = g_strdup_printf("/proc/%d/cwd", priv->child_pid);
+	char *cwd = g_file_read_link(proc_path, NULL);
+	g_free(proc_path);
+	return cwd;
 }
 
-bool
-miniterm_terminal_load_settings(MinitermTerminal *terminal)
-{
-	char *config_dir =
-		g_strconcat(g_get_user_config_dir(), "/miniterm", NULL);
-	char *config_path = g_strconcat(config_dir, "/miniterm.conf", NULL);
-	GKeyFile *config_file = g_key_file_new();
-	MinitermSettings settings;
-	miniterm_settings_init(&settings);
-	if (g_key_file_load_from_file(config_file, config_path, 0, NULL)) {
-		miniterm_settings_set_from_key_file(&settings, config_file);
-	} else {
-		mkdir(config_dir, 0777);
-		miniterm_write_default_settings(config_path);
-	}
-	miniterm_settings_set_from_key_file(&settings, config_file);
-	update_from_settings(terminal, &settings);
-	miniterm_settings_destroy(&settings);
-	g_key_file_free(config_file);
-	g_free(config_path);
-	g_free(config_dir);
-	return true;
+const char *
+miniterm_terminal_get_command(MinitermTerminal *terminal)
+{
+	MinitermTerminalPrivate *priv =
+		miniterm_terminal_get_instance_private(terminal);
+	return priv->command;
 }
 
-static void
-window_urgency_hint_cb(MinitermTerminal *terminal, gpointer user_data)
+const char *
+miniterm_terminal_get_command_title(MinitermTerminal *terminal)
 {
-	(void)user_data;
-	gtk_window_set_urgency_hint(
-		GTK_WINDOW(gtk_widget_get_toplevel(GTK_WIDGET(terminal))),
-		TRUE);
+	MinitermTerminalPrivate *priv =
+		miniterm_terminal_get_instance_private(terminal);
+	return priv->cmd_title;
 }
 
-static gboolean
-window_focus_cb(GtkWindow *window)
+bool
+miniterm_terminal_get_keep(MinitermTerminal *terminal)
 {
-	gtk_window_set_urgency_hint(window, FALSE);
-	return FALSE;
+	MinitermTerminalPrivate *priv =
+		miniterm_terminal_get_instance_private(terminal);
+	return priv->exit_handler == 0;
 }
 
-static void
-window_title_cb(MinitermTerminal *terminal)
+bool
+miniterm_terminal_save_contents(
+	MinitermTerminal *terminal, const char *path, GError **error)
 {
-	gtk_window_set_title(
-		GTK_WINDOW(gtk_widget_get_toplevel(GTK_WIDGET(terminal))),
-		vte_terminal_get_window_title(VTE_TERMINAL(terminal)));
+	MinitermTerminalPrivate *priv =
+		miniterm_terminal_get_instance_private(terminal);
+	if (is_waking(terminal))
+		return miniterm_hibernate_save_restoring(
+			priv->hibernate, path, error);
+	return miniterm_hibernate_save_all(
+		VTE_TERMINAL(terminal), priv->hibernate_path, path, error);
 }
 
-static gboolean
-key_press_cb(MinitermTerminal *terminal, GdkEventKey *event)
+void
+miniterm_terminal_spawn(MinitermTerminal *terminal,
+	const char *working_directory, const char *command, char **environment,
+	MinitermSpawnCallback callback, gpointer user_data)
 {
-	VteTerminal *vte = VTE_TERMINAL(terminal);
-	const guint key = gdk_keyval_to_lower(event->keyval);
-	const guint modifiers =
-		event->state & gtk_accelerator_get_default_mod_mask();
-	if ((modifiers == (GDK_CONTROL_MASK | GDK_SHIFT_MASK))) {
-		switch (key) {
-		case GDK_KEY_c:
-#if VTE_CHECK_VERSION(0, 50, 0)
-			vte_terminal_copy_clipboard_format(
-				VTE_TERMINAL(terminal), VTE_FORMAT_TEXT);
-#else
-			vte_terminal_copy_clipboard(vte);
-#endif
-			return TRUE;
-		case GDK_KEY_v:
-			vte_terminal_paste_clipboard(vte);
-			return TRUE;
-		case GDK_KEY_plus:
-			increase_font_size(terminal);
-			return TRUE;
-		case GDK_KEY_r:
-			miniterm_terminal_load_settings(terminal);
-			return TRUE;
-		}
-	} else if (modifiers == GDK_CONTROL_MASK) {
-		switch (key) {
-		case GDK_KEY_minus:
-			decrease_font_size(terminal);
-			return TRUE;
-		case GDK_KEY_equal:
-			reset_font_size(terminal);
-			return TRUE;
-		}
+	miniterm_trace("spawn", miniterm_terminal_get_id(terminal));
+	char **command_argv = NULL;
+	char *shell = NULL;
+	GError *error = NULL;
+	MinitermTerminalPrivate *priv =
+		miniterm_terminal_get_instance_private(terminal);
+	g_free(priv->command);
+	priv->command = g_strdup(command);
+	/* Parse command into array */
+	if (!command)
+		command = shell = vte_get_user_shell();
+	bool parsed = g_shell_parse_argv(command, NULL, &command_argv, &error);
+	g_free(shell);
+	if (!parsed) {
+		g_prefix_error(&error, "Failed to parse command: ");
+		if (callback != NULL)
+			callback(terminal, -1, error, user_data);
+		g_error_free(error);
+		return;
 	}
-	return FALSE;
+	SpawnData *data = g_new(SpawnData, 1);
+	data->terminal = g_object_ref(terminal);
+	data->zygote = false;
+	data->proxy = false;
+	data->callback = callback;
+	data->user_data = user_data;
+	if (zygote_spawn(terminal, working_directory, command_argv, environment,
+		    data)
+		|| proxy_spawn(terminal, working_directory, command_argv,
+			environment, data)) {
+		g_strfreev(command_argv);
+		return;
+	}
+	/*
+	 * Vte creates the pty and forks without waiting for the child to exec.
+	 * Without G_SPAWN_LEAVE_DESCRIPTORS_OPEN all descriptors but the
+	 * standard streams are closed in the child, so it doesn't inherit the
+	 * ptys of other terminals.
+	 */
+	vte_terminal_spawn_async(VTE_TERMINAL(terminal), VTE_PTY_DEFAULT,
+		working_directory, command_argv, environment,
+		G_SPAWN_SEARCH_PATH, NULL, NULL, NULL, -1, NULL, spawn_cb,
+		data);
+	g_strfreev(command_argv);
 }
 
-static void
-exit_cb(MinitermTerminal *terminal, gint status, gpointer user_data)
+static bool
+zygote_spawn(MinitermTerminal *terminal, const char *working_directory,
+	char **argv, char **environment, SpawnData *data)
 {
-	(void)status;
-	gtk_window_close(GTK_WINDOW(user_data));
+	if (!miniterm_zygote_running())
+		return false;
+	VtePty *pty = new_pty(terminal);
+	if (pty == NULL)
+		return false;
+	char **child_environment = get_child_environment(environment);
+	data->zygote = miniterm_zygote_spawn(vte_pty_get_fd(pty),
+		working_directory, argv, child_environment, zygote_spawn_cb,
+		data);
+	g_strfreev(child_environment);
+	if (data->zygote) {
+		data->proxy = start_proxy(terminal, pty);
+		if (!data->proxy)
+			vte_terminal_set_pty(VTE_TERMINAL(terminal), pty);
+	}
+	g_object_unref(pty);
+	return data->zygote;
 }
 
-static void
-increase_font_size(MinitermTerminal *terminal)
+static bool
+proxy_spawn(MinitermTerminal *terminal, const char *working_directory,
+	char **argv, char **environment, SpawnData *data)
 {
-	PangoFontDescription *font = pango_font_description_copy_static(
-		vte_terminal_get_font(VTE_TERMINAL(terminal)));
-	pango_font_description_set_size(
-		font, (pango_font_description_get_size(font) / PANGO_SCALE + 1)
-			      * PANGO_SCALE);
-	vte_terminal_set_font(VTE_TERMINAL(terminal), font);
-	pango_font_description_free(font);
+	VtePty *pty = new_pty(terminal);
+	if (pty == NULL)
+		return false;
+	data->proxy = start_proxy(terminal, pty);
+	if (!data->proxy) {
+		g_object_unref(pty);
+		return false;
+	}
+	/* Unlike vte_terminal_spawn_async(), this leaves the child to us. */
+	char **child_environment = get_child_environment(environment);
+	vte_pty_spawn_async(pty, working_directory, argv, child_environment,
+		G_SPAWN_SEARCH_PATH, NULL, NULL, NULL, -1, NULL, pty_spawn_cb,
+		data);
+	g_strfreev(child_environment);
+	g_object_unref(pty);
+	return true;
 }
 
-static void
-decrease_font_size(MinitermTerminal *terminal)
+static VtePty *
+new_pty(MinitermTerminal *terminal)
 {
-	PangoFontDescription *font = pango_font_description_copy_static(
-		vte_terminal_get_font(VTE_TERMINAL(terminal)));
-	const gint size =
-		pango_font_description_get_size(font) / PANGO_SCALE - 1;
-	if (size > 0) {
-		pango_font_description_set_size(font, size * PANGO_SCALE);
-		vte_terminal_set_font(VTE_TERMINAL(terminal), font);
-	}
-	pango_font_description_free(font);
+	VtePty *pty = vte_pty_new_sync(VTE_PTY_DEFAULT, NULL, NULL);
+	if (pty != NULL)
+		vte_pty_set_size(pty,
+			vte_terminal_get_row_count(VTE_TERMINAL(terminal)),
+			vte_terminal_get_column_count(VTE_TERMINAL(terminal)),
+			NULL);
+	return pty;
 }
 
-static void
-reset_font_size(MinitermTerminal *terminal)
+static char **
+get_child_environment(char **environment)
+{
+	/* Vte sets these for the children it spawns. */
+	char **child_environment = environment != NULL
+		? g_strdupv(environment)
+		: g_get_environ();
+	char *version = g_strdup_printf("%u",
+		vte_get_major_version() * 10000 + vte_get_minor_version() * 100
+			+ vte_get_micro_version());
+	child_environment = g_environ_setenv(
+		child_environment, "TERM", TERMINFO, TRUE);
+	child_environment = g_environ_setenv(
+		child_environment, "COLORTERM", "truecolor", TRUE);
+	child_environment = g_environ_setenv(
+		child_environment, "VTE_VERSION", version, TRUE);
+	g_free(version);
+	return child_environment;
+}
+
+static bool
+start_proxy(MinitermTerminal *terminal, VtePty *pty)
 {
 	MinitermTerminalPrivate *priv =
 		miniterm_terminal_get_instance_private(terminal);
-	PangoFontDescription *font = pango_font_description_copy_static(
-		vte_terminal_get_font(VTE_TERMINAL(terminal)));
-	pango_font_description_set_size(font, priv->default_font_size);
-	vte_terminal_set_font(VTE_TERMINAL(terminal), font);
-	pango_font_description_free(font);
+	if (priv->settings == NULL)
+		return false;
+	/*
+	 * Logging and capturing need the proxy too, to see the output, and
+	 * hibernation to follow the modes it sets and wake on it.
+	 */
+	priv->log = open_log(terminal);
+	priv->capture = open_capture(terminal);
+	const bool tee = priv->log != NULL || priv->capture != NULL;
+	if (priv->settings->flood_threshold <= 0
+		&& priv->settings->hibernate_after <= 0 && !tee)
+		return false;
+	priv->proxy = miniterm_proxy_new(vte_pty_get_fd(pty),
+		priv->settings->flood_threshold * 1024.0 * 1024.0,
+		tee ? tee_cb : NULL, proxy_output_cb, proxy_flood_cb, terminal);
+	if (priv->proxy == NULL) {
+		if (priv->log != NULL) {
+			miniterm_log_free(priv->log);
+			priv->log = NULL;
+		}
+		if (priv->capture != NULL) {
+			miniterm_capture_free(priv->capture);
+			priv->capture = NULL;
+		}
+		return false;
+	}
+	priv->proxy_pty = g_object_ref(pty);
+	return true;
 }
 
-static void
-clear_signal_handlers(MinitermTerminal *terminal)
+static MinitermLog *
+open_log(MinitermTerminal *terminal)
+{
+	MinitermTerminalPrivate *priv =
+		miniterm_terminal_get_instance_private(terminal);
+	MinitermSettings *settings = priv->settings;
+	char *path = NULL;
+	if (priv->log_path != NULL) {
+		path = g_strdup(priv->log_path);
+	} else if (settings->log_directory != NULL) {
+		GDateTime *now = g_date_time_new_now_local();
+		char *time = g_date_time_format(now, "%Y%m%d-%H%M%S");
+		char *name = g_strdup_printf("miniterm-%s-%d-%u.log", time,
+			(int)getpid(), priv->id);
+		g_mkdir_with_parents(settings->log_directory, 0700);
+		path = g_build_filename(settings->log_directory, name, NULL);
+		g_free(name);
+		g_free(time);
+		g_date_time_unref(now);
+	} else {
+		return NULL;
+	}
+	GError *error = NULL;
+	MinitermLog *log = miniterm_log_new(path, settings->log_timestamps,
+		(gint64)settings->log_rotate_mb * 1024 * 1024, &error);
+	if (log == NULL) {
+		g_printerr("%s\n", error->message);
+		g_error_free(error);
+	}
+	g_free(path);
+	return log;
+}
+
+static MinitermCapture *
+open_capture(MinitermTerminal *terminal)
+{
+	MinitermTerminalPrivate *priv =
+		miniterm_terminal_get_instance_private(terminal);
+	if (priv->capture_path == NULL)
+		return NULL;
+	GError *error = NULL;
+	MinitermCapture *capture = miniterm_capture_new(priv->capture_path,
+		vte_terminal_get_column_count(VTE_TERMINAL(terminal)),
+		vte_terminal_get_row_count(VTE_TERMINAL(terminal)), &error);
+	if (capture == NULL) {
+		g_printerr("%s\n", error->message);
+		g_error_free(error);
+	}
+	return capture;
+}
+
+static void
+spawn_cb(VteTerminal *vte, GPid pid, GError *error, gpointer user_data)
+{
+	(void)vte;
+	spawn_finish(user_data, pid, error);
+}
+
+static void
+zygote_spawn_cb(GPid pid, int error, gpointer user_data)
+{
+	if (error == 0) {
+		spawn_finish(user_data, pid, NULL);
+		return;
+	}
+	GError *spawn_error = g_error_new(G_IO_ERROR,
+		g_io_error_from_errno(error),
+		"Failed to execute child process: %s", g_strerror(error));
+	spawn_finish(user_data, -1, spawn_error);
+	g_error_free(spawn_error);
+}
+
+static void
+pty_spawn_cb(GObject *source, GAsyncResult *result, gpointer user_data)
+{
+	GPid pid = -1;
+	GError *error = NULL;
+	if (!vte_pty_spawn_finish(VTE_PTY(source), result, &pid, &error))
+		pid = -1;
+	spawn_finish(user_data, pid, error);
+	if (error != NULL)
+		g_error_free(error);
+}
+
+static void
+spawn_finish(SpawnData *data, GPid pid, GError *error)
+{
+	MinitermTerminal *terminal = data->terminal;
+	MinitermTerminalPrivate *priv =
+		miniterm_terminal_get_instance_private(terminal);
+	if (error == NULL && (data->zygote || data->proxy) && priv->disposed) {
+		kill(pid, SIGHUP);
+		if (!data->zygote)
+			g_child_watch_add(pid, reap_cb, NULL);
+	} else if (error == NULL) {
+		priv->child_pid = pid;
+		/* Vte already watches the children it spawned on its pty. */
+		if (data->zygote) {
+			priv->zygote_child = true;
+			miniterm_zygote_watch(pid, zygote_exit_cb, terminal);
+		} else if (data->proxy) {
+			priv->child_watch = g_child_watch_add(
+				pid, child_watch_cb, terminal);
+		}
+		if (!data->proxy && !priv->disposed)
+			watch_output(terminal);
+	}
+	if (data->callback != NULL)
+		data->callback(terminal, pid, error, data->user_data);
+	g_object_unref(terminal);
+	g_free(data);
+}
+
+static void
+zygote_exit_cb(GPid pid, int status, gpointer user_data)
+{
+	(void)pid;
+	MinitermTerminal *terminal = MINITERM_TERMINAL(user_data);
+	MinitermTerminalPrivate *priv =
+		miniterm_terminal_get_instance_private(terminal);
+	priv->zygote_child = false;
+	if (status != -1) {
+		child_exited(terminal, status);
+		return;
+	}
+	/*
+	 * The helper died and left the child behind, it is gone once nothing
+	 * holds the pty open any more. Its status is lost.
+	 */
+	priv->exit_status = 0;
+	if (priv->proxy != NULL)
+		miniterm_proxy_drain_to_end(priv->proxy, proxy_drained_cb);
+	else
+		g_signal_connect(
+			terminal, "eof", G_CALLBACK(orphan_eof_cb), NULL);
+}
+
+static void
+child_watch_cb(GPid pid, int status, gpointer user_data)
+{
+	MinitermTerminal *terminal = MINITERM_TERMINAL(user_data);
+	MinitermTerminalPrivate *priv =
+		miniterm_terminal_get_instance_private(terminal);
+	g_spawn_close_pid(pid);
+	priv->child_watch = 0;
+	child_exited(terminal, status);
+}
+
+static void
+orphan_eof_cb(MinitermTerminal *terminal, gpointer user_data)
+{
+	(void)user_data;
+	g_signal_handlers_disconnect_by_func(terminal, orphan_eof_cb, NULL);
+	g_signal_emit_by_name(terminal, "child-exited", 0);
+}
+
+static void
+reap_cb(GPid pid, int status, gpointer user_data)
+{
+	(void)status;
+	(void)user_data;
+	g_spawn_close_pid(pid);
+}
+
+static void
+child_exited(MinitermTerminal *terminal, int status)
+{
+	MinitermTerminalPrivate *priv =
+		miniterm_terminal_get_instance_private(terminal);
+	if (priv->proxy == NULL) {
+		g_signal_emit_by_name(terminal, "child-exited", status);
+		return;
+	}
+	priv->exit_status = status;
+	miniterm_proxy_drain(priv->proxy, proxy_drained_cb);
+}
+
+static void
+proxy_drained_cb(gpointer user_data)
+{
+	MinitermTerminal *terminal = MINITERM_TERMINAL(user_data);
+	MinitermTerminalPrivate *priv =
+		miniterm_terminal_get_instance_private(terminal);
+	g_signal_emit_by_name(terminal, "child-exited", priv->exit_status);
+}
+
+static void
+tee_cb(const char *data, size_t length, gpointer user_data)
+{
+	/* The log and capture outlive the proxy thread calling this. */
+	MinitermTerminalPrivate *priv = miniterm_terminal_get_instance_private(
+		MINITERM_TERMINAL(user_data));
+	if (priv->log != NULL)
+		miniterm_log_write(priv->log, data, length);
+	if (priv->capture != NULL)
+		miniterm_capture_write(priv->capture, data, length);
+}
+
+static void
+proxy_output_cb(const char *data, size_t length, gpointer user_data)
+{
+	MinitermTerminal *terminal = MINITERM_TERMINAL(user_data);
+	MinitermTerminalPrivate *priv =
+		miniterm_terminal_get_instance_private(terminal);
+	wake(terminal);
+	record_output(terminal, length);
+	miniterm_modes_scan(priv->modes, data, length);
+	/* The proxy is paused while waking, but this was already on its way. */
+	if (is_waking(terminal)) {
+		if (priv->held_output == NULL)
+			priv->held_output = g_byte_array_new();
+		g_byte_array_append(
+			priv->held_output, (const guint8 *)data, length);
+		return;
+	}
+	vte_terminal_feed(VTE_TERMINAL(terminal), data, length);
+}
+
+static void
+proxy_flood_cb(bool flooding, gpointer user_data)
+{
+	(void)flooding;
+	MinitermTerminal *terminal = MINITERM_TERMINAL(user_data);
+	update_throttle(terminal);
+	if (get_throttle(terminal) == THROTTLE_SLOW)
+		schedule_redraw(terminal);
+}
+
+static void
+proxy_commit_cb(MinitermTerminal *terminal, char *text, unsigned int size,
+	gpointer user_data)
+{
+	(void)user_data;
+	MinitermTerminalPrivate *priv =
+		miniterm_terminal_get_instance_private(terminal);
+	/* Vte emits commit even without a pty of its own. */
+	if (priv->proxy != NULL)
+		miniterm_proxy_write(priv->proxy, text, size);
+}
+
+static void
+proxy_size_cb(
+	GtkWidget *terminal, GdkRectangle *allocation, gpointer user_data)
+{
+	(void)allocation;
+	(void)user_data;
+	MinitermTerminalPrivate *priv = miniterm_terminal_get_instance_private(
+		MINITERM_TERMINAL(terminal));
+	const long rows = vte_terminal_get_row_count(VTE_TERMINAL(terminal));
+	const long columns =
+		vte_terminal_get_column_count(VTE_TERMINAL(terminal));
+	/* The kernel only signals the child if the size changed. */
+	if (priv->proxy_pty != NULL)
+		vte_pty_set_size(priv->proxy_pty, rows, columns, NULL);
+	if (priv->capture != NULL)
+		miniterm_capture_resize(priv->capture, columns, rows);
+}
+
+void
+miniterm_terminal_set_log(MinitermTerminal *terminal, const char *path)
+{
+	MinitermTerminalPrivate *priv =
+		miniterm_terminal_get_instance_private(terminal);
+	g_free(priv->log_path);
+	priv->log_path = g_strdup(path);
+}
+
+void
+miniterm_terminal_set_capture(MinitermTerminal *terminal, const char *path)
+{
+	MinitermTerminalPrivate *priv =
+		miniterm_terminal_get_instance_private(terminal);
+	g_free(priv->capture_path);
+	priv->capture_path = g_strdup(path);
+}
+
+void
+miniterm_terminal_set_keep(MinitermTerminal *terminal, bool keep)
+{
+	MinitermTerminalPrivate *priv =
+		miniterm_terminal_get_instance_private(terminal);
+	if (keep && priv->exit_handler != 0) {
+		g_signal_handler_disconnect(terminal, priv->exit_handler);
+		priv->exit_handler = 0;
+	} else if (!keep && priv->exit_handler == 0) {
+		priv->exit_handler = g_signal_connect(terminal, "child-exited",
+			G_CALLBACK(exit_cb), priv->window);
+	}
+}
+
+void
+miniterm_terminal_set_title(MinitermTerminal *terminal, const char *title)
+{
+	MinitermTerminalPrivate *priv =
+		miniterm_terminal_get_instance_private(terminal);
+	g_free(priv->cmd_title);
+	priv->cmd_title = g_strdup(title);
+	if (title != NULL)
+		window_title_cb(terminal);
+	/* Reconnect the dynamic title handler as needed. */
+	if (priv->settings != NULL)
+		update_from_settings(terminal, priv->settings);
+}
+
+void
+miniterm_terminal_set_scrollback_limit(MinitermTerminal *terminal, long limit)
+{
+	MinitermTerminalPrivate *priv =
+		miniterm_terminal_get_instance_private(terminal);
+	if (limit == priv->scrollback_limit)
+		return;
+	priv->scrollback_limit = limit;
+	if (priv->settings != NULL)
+		update_scrollback_lines(terminal);
+}
+
+long
+miniterm_terminal_get_scrollback_used(MinitermTerminal *terminal)
+{
+	/* The adjustment spans the stored history plus the visible rows. */
+	GtkAdjustment *adjustment =
+		gtk_scrollable_get_vadjustment(GTK_SCROLLABLE(terminal));
+	const double lines = gtk_adjustment_get_upper(adjustment)
+		- gtk_adjustment_get_lower(adjustment)
+		- gtk_adjustment_get_page_size(adjustment);
+	return MAX((long)lines, 0);
+}
+
+size_t
+miniterm_terminal_get_line_size(MinitermTerminal *terminal)
+{
+	return (size_t)MAX(vte_terminal_get_column_count(
+			   VTE_TERMINAL(terminal)), 1)
+		* SCROLLBACK_CELL_SIZE;
+}
+
+void
+miniterm_terminal_get_stats(
+	MinitermTerminal *terminal, MinitermTerminalStats *stats)
+{
+	MinitermTerminalPrivate *priv =
+		miniterm_terminal_get_instance_private(terminal);
+	stats->id = priv->id;
+	stats->child_pid = priv->child_pid;
+	stats->bytes_read = priv->bytes_read;
+	stats->bytes_per_second =
+		get_byte_rate(priv, g_get_monotonic_time());
+	stats->frames = priv->frames;
+	stats->process_time = priv->process_time;
+	stats->draw_time = priv->draw_time;
+	stats->scrollback_lines =
+		miniterm_terminal_get_scrollback_used(terminal);
+	stats->scrollback_size = stats->scrollback_lines
+		* miniterm_terminal_get_line_size(terminal);
+}
+
+const MinitermHistogram *
+miniterm_terminal_get_latency(MinitermTerminal *terminal)
+{
+	MinitermTerminalPrivate *priv =
+		miniterm_terminal_get_instance_private(terminal);
+	return priv->latency;
+}
+
+void
+miniterm_terminal_toggle_stats(MinitermTerminal *terminal)
+{
+	MinitermTerminalPrivate *priv =
+		miniterm_terminal_get_instance_private(terminal);
+	if (priv->stats_label == NULL) {
+		priv->stats_label = gtk_label_new(NULL);
+		gtk_widget_set_halign(priv->stats_label, GTK_ALIGN_END);
+		gtk_widget_set_valign(priv->stats_label, GTK_ALIGN_START);
+		gtk_overlay_add_overlay(
+			GTK_OVERLAY(priv->container), priv->stats_label);
+	}
+	if (priv->stats_source != 0) {
+		g_source_remove(priv->stats_source);
+		priv->stats_source = 0;
+		gtk_widget_hide(priv->stats_label);
+	} else {
+		update_stats_label(terminal);
+		priv->stats_source =
+			g_timeout_add_seconds(1, update_stats_label, terminal);
+		gtk_widget_show(priv->stats_label);
+	}
+}
+
+static void
+show_search(MinitermTerminal *terminal)
+{
+	MinitermTerminalPrivate *priv =
+		miniterm_terminal_get_instance_private(terminal);
+	if (priv->search == NULL)
+		priv->search = miniterm_search_new(
+			VTE_TERMINAL(terminal), GTK_OVERLAY(priv->container));
+	miniterm_search_show(priv->search);
+}
+
+static void
+paste_clipboard(MinitermTerminal *terminal)
+{
+	MinitermTerminalPrivate *priv =
+		miniterm_terminal_get_instance_private(terminal);
+	/*
+	 * Without a child there is nothing to pace the paste by, and without
+	 * the proxy it isn't known whether to bracket it.
+	 */
+	if (priv->proxy == NULL) {
+		vte_terminal_paste_clipboard(VTE_TERMINAL(terminal));
+		return;
+	}
+	if (priv->paste == NULL)
+		priv->paste = miniterm_paste_new(VTE_TERMINAL(terminal),
+			GTK_OVERLAY(priv->container), priv->modes);
+	miniterm_paste_clipboard(priv->paste, priv->proxy);
+}
+
+static void
+export_to_file(MinitermTerminal *terminal)
+{
+	MinitermTerminalPrivate *priv =
+		miniterm_terminal_get_instance_private(terminal);
+	GtkWidget *dialog = gtk_file_chooser_dialog_new("Export Scrollback",
+		priv->window, GTK_FILE_CHOOSER_ACTION_SAVE, "_Cancel",
+		GTK_RESPONSE_CANCEL, "_Save", GTK_RESPONSE_ACCEPT, NULL);
+	GtkFileChooser *chooser = GTK_FILE_CHOOSER(dialog);
+	gtk_file_chooser_set_do_overwrite_confirmation(chooser, TRUE);
+	gtk_file_chooser_set_current_name(chooser, "scrollback.txt");
+	char *cwd = miniterm_terminal_get_cwd(terminal);
+	if (cwd != NULL)
+		gtk_file_chooser_set_current_folder(chooser, cwd);
+	g_free(cwd);
+#if GTK_CHECK_VERSION(3, 22, 0)
+	gtk_file_chooser_add_choice(chooser, "colors",
+		"Keep colors as escape sequences", NULL, NULL);
+	gtk_file_chooser_set_choice(chooser, "colors",
+		priv->settings != NULL && priv->settings->export_colors
+			? "true"
+			: "false");
+#endif
+	gtk_window_set_destroy_with_parent(GTK_WINDOW(dialog), TRUE);
+	/* Not connected to the terminal closing meanwhile. */
+	g_signal_connect_object(dialog, "response",
+		G_CALLBACK(export_response_cb), terminal, 0);
+	gtk_widget_show(dialog);
+}
+
+static void
+export_response_cb(GtkDialog *dialog, int response, gpointer user_data)
+{
+	MinitermTerminal *terminal = MINITERM_TERMINAL(user_data);
+	MinitermTerminalPrivate *priv =
+		miniterm_terminal_get_instance_private(terminal);
+	GtkFileChooser *chooser = GTK_FILE_CHOOSER(dialog);
+	if (response == GTK_RESPONSE_ACCEPT && !priv->disposed) {
+		GFile *file = gtk_file_chooser_get_file(chooser);
+#if GTK_CHECK_VERSION(3, 22, 0)
+		const char *choice =
+			gtk_file_chooser_get_choice(chooser, "colors");
+		const bool colors = g_strcmp0(choice, "true") == 0;
+#else
+		const bool colors =
+			priv->settings != NULL && priv->settings->export_colors;
+#endif
+		priv->exports = g_list_prepend(priv->exports,
+			miniterm_export_to_file(VTE_TERMINAL(terminal), file,
+				colors, export_done_cb, terminal));
+		g_object_unref(file);
+	}
+	gtk_widget_destroy(GTK_WIDGET(dialog));
+}
+
+static void
+export_to_command(MinitermTerminal *terminal)
+{
+	MinitermTerminalPrivate *priv =
+		miniterm_terminal_get_instance_private(terminal);
+	if (priv->settings == NULL || priv->settings->export_command == NULL) {
+		gtk_widget_error_bell(GTK_WIDGET(terminal));
+		return;
+	}
+	char *cwd = miniterm_terminal_get_cwd(terminal);
+	priv->exports = g_list_prepend(priv->exports,
+		miniterm_export_to_command(VTE_TERMINAL(terminal),
+			priv->settings->export_command, cwd,
+			priv->settings->export_colors, export_done_cb,
+			terminal));
+	g_free(cwd);
+}
+
+static void
+export_done_cb(MinitermExport *export, const GError *error, gpointer user_data)
+{
+	MinitermTerminalPrivate *priv = miniterm_terminal_get_instance_private(
+		MINITERM_TERMINAL(user_data));
+	if (error != NULL)
+		g_printerr("Failed to export the scrollback: %s\n",
+			error->message);
+	priv->exports = g_list_remove(priv->exports, export);
+	miniterm_export_free(export);
+}
+
+static void
+update_scrollback_lines(MinitermTerminal *terminal)
+{
+	MinitermTerminalPrivate *priv =
+		miniterm_terminal_get_instance_private(terminal);
+	/* Shrinking drops the oldest lines and releases their storage. */
+	long lines = priv->settings->scrollback_lines;
+	if (priv->scrollback_limit >= 0)
+		lines = MIN(lines, priv->scrollback_limit);
+	if (priv->hibernate_path != NULL && priv->hibernate == NULL)
+		lines = 0;
+	vte_terminal_set_scrollback_lines(VTE_TERMINAL(terminal), lines);
+}
+
+static void
+update_from_settings(MinitermTerminal *terminal, MinitermSettings *settings)
+{
+	MinitermTerminalPrivate *priv =
+		miniterm_terminal_get_instance_private(terminal);
+	vte_terminal_set_audible_bell(
+		VTE_TERMINAL(terminal), settings->audible_bell);
+	update_scrollback_lines(terminal);
+	const bool measure_latency =
+		settings->measure_latency || miniterm_latency_env_enabled();
+	if (measure_latency && priv->latency == NULL) {
+		priv->latency =
+			g_new0(MinitermHistogram, MINITERM_LATENCY_STAGES);
+	} else if (!measure_latency && priv->latency != NULL) {
+		g_clear_pointer(&priv->latency, g_free);
+		latency_reset(terminal);
+	}
+	vte_terminal_set_mouse_autohide(
+		VTE_TERMINAL(terminal), settings->autohide_mouse);
+#if !VTE_CHECK_VERSION(0, 58, 0)
+	/* Newer vte always rewraps, so off then acts like lazy. */
+	vte_terminal_set_rewrap_on_resize(VTE_TERMINAL(terminal),
+		settings->rewrap != MINITERM_REWRAP_OFF);
+#endif
+	if (priv->proxy != NULL)
+		miniterm_proxy_set_flood_threshold(priv->proxy,
+			settings->flood_threshold * 1024.0 * 1024.0);
+	clear_signal_handlers(terminal);
+	if (settings->urgent_on_bell) {
+		priv->bell_handler = g_signal_connect(terminal, "bell",
+			G_CALLBACK(window_urgency_hint_cb), NULL);
+		priv->focus_in_handler = g_signal_connect(priv->window,
+			"focus-in-event", G_CALLBACK(window_focus_cb), NULL);
+		priv->focus_out_handler = g_signal_connect(priv->window,
+			"focus-out-event", G_CALLBACK(window_focus_cb), NULL);
+	}
+	if (settings->dynamic_window_title && !priv->cmd_title)
+		priv->window_title_changed_handler =
+			g_signal_connect(terminal, "window-title-changed",
+				G_CALLBACK(window_title_cb), NULL);
+	if (settings->font != NULL) {
+		vte_terminal_set_font(VTE_TERMINAL(terminal), settings->font);
+		priv->default_font_size =
+			pango_font_description_get_size(settings->font);
+		if (priv->default_font_size == 0)
+			priv->default_font_size = 12 * PANGO_SCALE;
+	}
+	if (settings->has_colors)
+		vte_terminal_set_colors(VTE_TERMINAL(terminal),
+			&settings->fg_color, &settings->bg_color,
+			settings->color_palette, MINITERM_COLOR_COUNT);
+	/* Never use a horizontal scrollbar. */
+	gtk_scrolled_window_set_policy(
+		GTK_SCROLLED_WINDOW(priv->scrolled_window), GTK_POLICY_NEVER,
+		settings->scrollbar_type);
+	/* Vte keeps its own references to the shared regexes. */
+	vte_terminal_match_remove_all(VTE_TERMINAL(terminal));
+	GPtrArray *links = miniterm_links_compile(settings->link_patterns);
+	for (guint i = 0; i < links->len; ++i)
+		vte_terminal_match_add_regex(
+			VTE_TERMINAL(terminal), links->pdata[i], 0);
+	g_ptr_array_unref(links);
+}
+
+void
+miniterm_terminal_set_settings(
+	MinitermTerminal *terminal, MinitermSettings *settings)
+{
+	MinitermTerminalPrivate *priv =
+		miniterm_terminal_get_instance_private(terminal);
+	const bool is_first = priv->settings == NULL;
+	miniterm_settings_ref(settings);
+	if (priv->settings != NULL)
+		miniterm_settings_unref(priv->settings);
+	priv->settings = settings;
+	update_from_settings(terminal, settings);
+
+	/* Don't undo the user's resizing when settings are reloaded. */
+	if (is_first && (settings->columns > 0 || settings->rows > 0)) {
+		int cols =
+			vte_terminal_get_column_count(VTE_TERMINAL(terminal));
+		int rows = vte_terminal_get_row_count(VTE_TERMINAL(terminal));
+		if (settings->columns > 0)
+			cols = settings->columns;
+		if (settings->rows > 0)
+			rows = settings->rows;
+		vte_terminal_set_size(VTE_TERMINAL(terminal), cols, rows);
+	}
+}
+
+static void
+window_urgency_hint_cb(MinitermTerminal *terminal, gpointer user_data)
+{
+	(void)user_data;
+	gtk_window_set_urgency_hint(
+		GTK_WINDOW(gtk_widget_get_toplevel(GTK_WIDGET(terminal))),
+		TRUE);
+}
+
+static gboolean
+window_focus_cb(GtkWindow *window)
+{
+	gtk_window_set_urgency_hint(window, FALSE);
+	return FALSE;
+}
+
+static void
+window_title_cb(MinitermTerminal *terminal)
+{
+	MinitermTerminalPrivate *priv =
+		miniterm_terminal_get_instance_private(terminal);
+	/* Only the current tab sets the window title. */
+	if (MINITERM_IS_WINDOW(priv->window))
+		miniterm_window_update_title(
+			MINITERM_WINDOW(priv->window), terminal);
+	else
+		gtk_window_set_title(
+			priv->window, miniterm_terminal_get_title(terminal));
+}
+
+static gboolean
+key_press_cb(MinitermTerminal *terminal, GdkEventKey *event)
+{
+	VteTerminal *vte = VTE_TERMINAL(terminal);
+	latency_key_press(terminal, event);
+	const guint key = gdk_keyval_to_lower(event->keyval);
+	const guint modifiers =
+		event->state & gtk_accelerator_get_default_mod_mask();
+	MinitermTerminalPrivate *priv =
+		miniterm_terminal_get_instance_private(terminal);
+	if (key == GDK_KEY_Escape && modifiers == 0 && priv->paste != NULL
+		&& miniterm_paste_is_active(priv->paste)) {
+		miniterm_paste_cancel(priv->paste);
+		return TRUE;
+	}
+	if ((modifiers == (GDK_CONTROL_MASK | GDK_SHIFT_MASK))) {
+		switch (key) {
+		case GDK_KEY_c:
+#if VTE_CHECK_VERSION(0, 50, 0)
+			vte_terminal_copy_clipboard_format(
+				vte, VTE_FORMAT_TEXT);
+#else
+			vte_terminal_copy_clipboard(vte);
+#endif
+			return TRUE;
+		case GDK_KEY_v:
+			paste_clipboard(terminal);
+			return TRUE;
+		case GDK_KEY_a:
+			priv->exports = g_list_prepend(priv->exports,
+				miniterm_export_to_clipboard(
+					vte, export_done_cb, terminal));
+			return TRUE;
+		case GDK_KEY_s:
+			export_to_file(terminal);
+			return TRUE;
+		case GDK_KEY_e:
+			export_to_command(terminal);
+			return TRUE;
+		case GDK_KEY_plus:
+			increase_font_size(terminal);
+			return TRUE;
+		case GDK_KEY_r:
+			miniterm_application_reload_settings(
+				MINITERM_APPLICATION(
+					g_application_get_default()));
+			return TRUE;
+		case GDK_KEY_t:
+			open_tab(terminal);
+			return TRUE;
+		case GDK_KEY_i:
+			miniterm_terminal_toggle_stats(terminal);
+			return TRUE;
+		case GDK_KEY_f:
+			show_search(terminal);
+			return TRUE;
+		}
+	} else if (modifiers == GDK_CONTROL_MASK) {
+		switch (key) {
+		case GDK_KEY_minus:
+			decrease_font_size(terminal);
+			return TRUE;
+		case GDK_KEY_equal:
+			reset_font_size(terminal);
+			return TRUE;
+		case GDK_KEY_Page_Up:
+		case GDK_KEY_Page_Down:
+			/* Leave the keys to the child without other tabs. */
+			if (!has_other_tabs(priv->window))
+				return FALSE;
+			miniterm_window_switch_tab(
+				MINITERM_WINDOW(priv->window),
+				key == GDK_KEY_Page_Up ? -1 : 1);
+			return TRUE;
+		}
+	}
+	return FALSE;
+}
+
+static gboolean
+button_press_cb(MinitermTerminal *terminal, GdkEventButton *event)
+{
+	const guint modifiers =
+		event->state & gtk_accelerator_get_default_mod_mask();
+	if (event->type != GDK_BUTTON_PRESS
+		|| event->button != GDK_BUTTON_PRIMARY
+		|| modifiers != GDK_CONTROL_MASK)
+		return FALSE;
+	char *link = vte_terminal_match_check_event(
+		VTE_TERMINAL(terminal), (GdkEvent *)event, NULL);
+	if (link == NULL)
+		return FALSE;
+	MinitermTerminalPrivate *priv =
+		miniterm_terminal_get_instance_private(terminal);
+	char *cwd = miniterm_terminal_get_cwd(terminal);
+	miniterm_links_open(GTK_WIDGET(terminal), link, cwd,
+		priv->settings != NULL ? priv->settings->link_command : NULL);
+	g_free(cwd);
+	g_free(link);
+	return TRUE;
+}
+
+static void
+exit_cb(MinitermTerminal *terminal, gint status, gpointer user_data)
+{
+	(void)status;
+	if (MINITERM_IS_WINDOW(user_data))
+		miniterm_window_remove_terminal(
+			MINITERM_WINDOW(user_data), terminal);
+	else
+		gtk_window_close(GTK_WINDOW(user_data));
+}
+
+static void
+open_tab(MinitermTerminal *terminal)
+{
+	MinitermTerminalPrivate *priv =
+		miniterm_terminal_get_instance_private(terminal);
+	if (!MINITERM_IS_WINDOW(priv->window))
+		return;
+	MinitermWindow *window = MINITERM_WINDOW(priv->window);
+	char *cwd = miniterm_terminal_get_cwd(terminal);
+	MinitermTerminal *tab =
+		miniterm_window_add_terminal(window, false, NULL);
+	miniterm_window_spawn(window, tab, cwd, NULL, NULL, tab_spawn_cb, NULL);
+	g_free(cwd);
+}
+
+static bool
+has_other_tabs(GtkWindow *window)
+{
+	if (!MINITERM_IS_WINDOW(window))
+		return false;
+	GList *terminals =
+		miniterm_window_get_terminals(MINITERM_WINDOW(window));
+	return terminals != NULL && terminals->next != NULL;
+}
+
+static void
+tab_spawn_cb(MinitermTerminal *tab, GPid pid, GError *error, gpointer user_data)
+{
+	(void)pid;
+	(void)user_data;
+	if (error == NULL)
+		return;
+	g_printerr("%s\n", error->message);
+	/* The tab might have been closed in the meantime. */
+	GtkWidget *window = gtk_widget_get_toplevel(GTK_WIDGET(tab));
+	if (MINITERM_IS_WINDOW(window))
+		miniterm_window_remove_terminal(MINITERM_WINDOW(window), tab);
+}
+
+static void
+increase_font_size(MinitermTerminal *terminal)
+{
+	PangoFontDescription *font = pango_font_description_copy_static(
+		vte_terminal_get_font(VTE_TERMINAL(terminal)));
+	pango_font_description_set_size(
+		font, (pango_font_description_get_size(font) / PANGO_SCALE + 1)
+			      * PANGO_SCALE);
+	set_window_font(terminal, font);
+	pango_font_description_free(font);
+}
+
+static void
+decrease_font_size(MinitermTerminal *terminal)
+{
+	PangoFontDescription *font = pango_font_description_copy_static(
+		vte_terminal_get_font(VTE_TERMINAL(terminal)));
+	const gint size =
+		pango_font_description_get_size(font) / PANGO_SCALE - 1;
+	if (size > 0) {
+		pango_font_description_set_size(font, size * PANGO_SCALE);
+		set_window_font(terminal, font);
+	}
+	pango_font_description_free(font);
+}
+
+static void
+reset_font_size(MinitermTerminal *terminal)
+{
+	MinitermTerminalPrivate *priv =
+		miniterm_terminal_get_instance_private(terminal);
+	PangoFontDescription *font = pango_font_description_copy_static(
+		vte_terminal_get_font(VTE_TERMINAL(terminal)));
+	pango_font_description_set_size(font, priv->default_font_size);
+	set_window_font(terminal, font);
+	pango_font_description_free(font);
+}
+
+static void
+set_window_font(MinitermTerminal *terminal, const PangoFontDescription *font)
+{
+	MinitermTerminalPrivate *priv =
+		miniterm_terminal_get_instance_private(terminal);
+	if (MINITERM_IS_WINDOW(priv->window))
+		miniterm_window_set_font(MINITERM_WINDOW(priv->window), font);
+	else
+		vte_terminal_set_font(VTE_TERMINAL(terminal), font);
+}
+
+static void
+clear_signal_handlers(MinitermTerminal *terminal)
 {
 	MinitermTerminalPrivate *priv =
 		miniterm_terminal_get_instance_private(terminal);
@@ -360,6 +1900,25 @@ clear_signal_handlers(MinitermTerminal *terminal)
 	}
 }
 
+static void
+trace_first_output_cb(MinitermTerminal *terminal, gpointer user_data)
+{
+	miniterm_trace("first-output", miniterm_terminal_get_id(terminal));
+	g_signal_handlers_disconnect_by_func(
+		terminal, trace_first_output_cb, user_data);
+}
+
+static gboolean
+trace_first_draw_cb(GtkWidget *widget, cairo_t *cr, gpointer user_data)
+{
+	(void)cr;
+	MinitermTerminal *terminal = MINITERM_TERMINAL(widget);
+	miniterm_trace("first-draw", miniterm_terminal_get_id(terminal));
+	g_signal_handlers_disconnect_by_func(
+		widget, trace_first_draw_cb, user_data);
+	return FALSE;
+}
+
 static GtkWidget *
 make_scrolled_window(GtkScrollable *widget, GtkPolicyType hbar_policy,
 	GtkPolicyType vbar_policy)
@@ -384,3 +1943,532 @@ make_scrolled_window(GtkScrollable *widget, GtkPolicyType hbar_policy,
 	gtk_container_add(GTK_CONTAINER(scrolled_window), GTK_WIDGET(widget));
 	return scrolled_window;
 }
+
+static gboolean
+resize_cb(gpointer user_data)
+{
+	MinitermTerminalPrivate *priv = miniterm_terminal_get_instance_private(
+		MINITERM_TERMINAL(user_data));
+	priv->resize_source = 0;
+	priv->resize_settled = true;
+	gtk_widget_queue_resize(GTK_WIDGET(user_data));
+	return G_SOURCE_REMOVE;
+}
+
+static gboolean
+hibernate_cb(gpointer user_data)
+{
+	MinitermTerminal *terminal = MINITERM_TERMINAL(user_data);
+	MinitermTerminalPrivate *priv =
+		miniterm_terminal_get_instance_private(terminal);
+	priv->hibernate_source = 0;
+	/*
+	 * Only shells with history are worth hibernating. Full screen programs
+	 * use the alternate screen, which has no scrollback and is not what is
+	 * saved, and only the proxy tells whether it is shown.
+	 */
+	if (priv->proxy == NULL
+		|| miniterm_modes_get_alternate_screen(priv->modes)
+		|| priv->hibernate_path != NULL || priv->hibernate != NULL
+		|| gtk_widget_has_focus(GTK_WIDGET(terminal))
+		|| (priv->search != NULL
+			&& miniterm_search_is_active(priv->search))
+		|| (priv->paste != NULL
+			&& miniterm_paste_is_active(priv->paste))
+		|| priv->exports != NULL
+		|| miniterm_terminal_get_scrollback_used(terminal) == 0)
+		return G_SOURCE_REMOVE;
+
+	char *path = get_hibernate_path(terminal);
+	char *directory = g_path_get_dirname(path);
+	g_mkdir_with_parents(directory, 0700);
+	g_free(directory);
+	priv->hibernate = miniterm_hibernate_save(
+		VTE_TERMINAL(terminal), path, hibernated_cb, terminal);
+	g_free(path);
+	return G_SOURCE_REMOVE;
+}
+
+static char *
+get_hibernate_path(MinitermTerminal *terminal)
+{
+	MinitermTerminalPrivate *priv =
+		miniterm_terminal_get_instance_private(terminal);
+	char *name = g_strdup_printf("%d-%u.gz", (int)getpid(), priv->id);
+	char *path = g_build_filename(
+		g_get_user_runtime_dir(), "miniterm", name, NULL);
+	g_free(name);
+	return path;
+}
+
+static void
+hibernated_cb(
+	MinitermHibernate *hibernate, const GError *error, gpointer user_data)
+{
+	(void)hibernate;
+	MinitermTerminal *terminal = MINITERM_TERMINAL(user_data);
+	MinitermTerminalPrivate *priv =
+		miniterm_terminal_get_instance_private(terminal);
+	g_clear_pointer(&priv->hibernate, miniterm_hibernate_free);
+	if (error != NULL) {
+		g_printerr("Failed to hibernate terminal: %s\n",
+			error->message);
+		return;
+	}
+	priv->hibernate_path = get_hibernate_path(terminal);
+	update_scrollback_lines(terminal);
+#ifdef __GLIBC__
+	/* Hand the freed scrollback back to the system. */
+	malloc_trim(0);
+#endif
+	miniterm_trace("hibernate", priv->id);
+}
+
+static void
+wake(MinitermTerminal *terminal)
+{
+	MinitermTerminalPrivate *priv =
+		miniterm_terminal_get_instance_private(terminal);
+	/* Output could push rows out of the scrollback before they're saved. */
+	if (priv->hibernate != NULL && priv->hibernate_path == NULL) {
+		g_clear_pointer(&priv->hibernate, miniterm_hibernate_free);
+		return;
+	}
+	if (priv->hibernate_path == NULL || priv->hibernate != NULL)
+		return;
+	/* Show the screen as it is until the scrollback is back above it. */
+	if (gtk_widget_get_mapped(GTK_WIDGET(terminal)))
+		take_snapshot(terminal);
+	priv->hibernate = miniterm_hibernate_restore(VTE_TERMINAL(terminal),
+		priv->hibernate_path, restored_cb, terminal);
+	update_scrollback_lines(terminal);
+	if (priv->proxy != NULL)
+		miniterm_proxy_set_paused(priv->proxy, true);
+	update_throttle(terminal);
+}
+
+static void
+restored_cb(
+	MinitermHibernate *hibernate, const GError *error, gpointer user_data)
+{
+	(void)hibernate;
+	MinitermTerminal *terminal = MINITERM_TERMINAL(user_data);
+	MinitermTerminalPrivate *priv =
+		miniterm_terminal_get_instance_private(terminal);
+	if (error != NULL)
+		g_printerr("Failed to restore terminal: %s\n", error->message);
+	g_clear_pointer(&priv->hibernate, miniterm_hibernate_free);
+	g_unlink(priv->hibernate_path);
+	g_clear_pointer(&priv->hibernate_path, g_free);
+	if (priv->held_output != NULL) {
+		vte_terminal_feed(VTE_TERMINAL(terminal),
+			(const char *)priv->held_output->data,
+			priv->held_output->len);
+		g_clear_pointer(&priv->held_output, g_byte_array_unref);
+	}
+	if (priv->proxy != NULL)
+		miniterm_proxy_set_paused(priv->proxy, false);
+	/* The next draw shows the restored contents. */
+	g_clear_pointer(&priv->snapshot, cairo_surface_destroy);
+	gtk_widget_queue_draw(GTK_WIDGET(terminal));
+	update_throttle(terminal);
+	/* Apply the size that was held back meanwhile. */
+	priv->resize_settled = true;
+	gtk_widget_queue_resize(GTK_WIDGET(terminal));
+	miniterm_trace("wake", priv->id);
+}
+
+static bool
+is_waking(MinitermTerminal *terminal)
+{
+	MinitermTerminalPrivate *priv =
+		miniterm_terminal_get_instance_private(terminal);
+	return priv->hibernate != NULL && priv->hibernate_path != NULL;
+}
+
+static void
+take_snapshot(MinitermTerminal *terminal)
+{
+	MinitermTerminalPrivate *priv =
+		miniterm_terminal_get_instance_private(terminal);
+	GtkWidget *widget = GTK_WIDGET(terminal);
+	const int width = gtk_widget_get_allocated_width(widget);
+	const int height = gtk_widget_get_allocated_height(widget);
+	g_clear_pointer(&priv->snapshot, cairo_surface_destroy);
+	priv->snapshot = gdk_window_create_similar_surface(
+		gtk_widget_get_window(widget), CAIRO_CONTENT_COLOR_ALPHA,
+		width, height);
+	priv->snapshot_width = width;
+	priv->snapshot_height = height;
+	cairo_t *cr = cairo_create(priv->snapshot);
+	GTK_WIDGET_CLASS(miniterm_terminal_parent_class)->draw(widget, cr);
+	cairo_destroy(cr);
+}
+
+static Throttle
+get_throttle(MinitermTerminal *terminal)
+{
+	MinitermTerminalPrivate *priv =
+		miniterm_terminal_get_instance_private(terminal);
+	/* Unmapped terminals, like inactive tabs, don't draw anyway. */
+	if (priv->window == NULL
+		|| !gtk_widget_get_mapped(GTK_WIDGET(terminal)))
+		return THROTTLE_NONE;
+	/* A waking terminal shows the snapshot until it is done. */
+	if (priv->window_hidden || priv->window_obscured
+		|| is_waking(terminal))
+		return THROTTLE_SUSPEND;
+	/* A flooded terminal jump-scrolls, skipping the frames in between. */
+	if (!gtk_window_is_active(priv->window)
+		|| (priv->proxy != NULL
+			&& miniterm_proxy_get_flooding(priv->proxy)))
+		return THROTTLE_SLOW;
+	return THROTTLE_NONE;
+}
+
+static void
+update_throttle(MinitermTerminal *terminal)
+{
+	MinitermTerminalPrivate *priv =
+		miniterm_terminal_get_instance_private(terminal);
+	const Throttle throttle = get_throttle(terminal);
+	if (throttle != THROTTLE_SLOW && priv->redraw_source != 0) {
+		g_source_remove(priv->redraw_source);
+		priv->redraw_source = 0;
+	}
+	/* Catch up on everything that changed while throttled. */
+	if (throttle == THROTTLE_NONE && priv->snapshot != NULL) {
+		g_clear_pointer(&priv->snapshot, cairo_surface_destroy);
+		gtk_widget_queue_draw(GTK_WIDGET(terminal));
+	}
+}
+
+static void
+schedule_redraw(MinitermTerminal *terminal)
+{
+	MinitermTerminalPrivate *priv =
+		miniterm_terminal_get_instance_private(terminal);
+	if (priv->redraw_source == 0)
+		priv->redraw_source = g_timeout_add(
+			UNFOCUSED_REDRAW_INTERVAL, redraw_cb, terminal);
+}
+
+static gboolean
+redraw_cb(gpointer user_data)
+{
+	MinitermTerminal *terminal = MINITERM_TERMINAL(user_data);
+	MinitermTerminalPrivate *priv =
+		miniterm_terminal_get_instance_private(terminal);
+	priv->redraw_source = 0;
+	/* The next draw takes a new snapshot. */
+	g_clear_pointer(&priv->snapshot, cairo_surface_destroy);
+	gtk_widget_queue_draw(GTK_WIDGET(terminal));
+	return G_SOURCE_REMOVE;
+}
+
+static gboolean
+window_state_cb(
+	GtkWidget *window, GdkEventWindowState *event, gpointer user_data)
+{
+	(void)window;
+	MinitermTerminal *terminal = MINITERM_TERMINAL(user_data);
+	MinitermTerminalPrivate *priv =
+		miniterm_terminal_get_instance_private(terminal);
+	priv->window_hidden = (event->new_window_state
+				      & (GDK_WINDOW_STATE_ICONIFIED
+					      | GDK_WINDOW_STATE_WITHDRAWN))
+		!= 0;
+	update_throttle(terminal);
+	return FALSE;
+}
+
+static gboolean
+window_visibility_cb(
+	GtkWidget *window, GdkEventVisibility *event, gpointer user_data)
+{
+	(void)window;
+	MinitermTerminal *terminal = MINITERM_TERMINAL(user_data);
+	MinitermTerminalPrivate *priv =
+		miniterm_terminal_get_instance_private(terminal);
+	priv->window_obscured = event->state == GDK_VISIBILITY_FULLY_OBSCURED;
+	update_throttle(terminal);
+	/* Newly uncovered parts of an unfocused window need drawing. */
+	if (get_throttle(terminal) == THROTTLE_SLOW)
+		schedule_redraw(terminal);
+	return FALSE;
+}
+
+static void
+window_active_cb(GObject *window, GParamSpec *pspec, gpointer user_data)
+{
+	(void)window;
+	(void)pspec;
+	update_throttle(MINITERM_TERMINAL(user_data));
+}
+
+static void
+throttle_map_cb(GtkWidget *terminal, gpointer user_data)
+{
+	(void)user_data;
+	update_throttle(MINITERM_TERMINAL(terminal));
+}
+
+static void
+throttle_contents_cb(MinitermTerminal *terminal, gpointer user_data)
+{
+	(void)user_data;
+	if (get_throttle(terminal) == THROTTLE_SLOW)
+		schedule_redraw(terminal);
+}
+
+static void
+record_output(MinitermTerminal *terminal, size_t length)
+{
+	MinitermTerminalPrivate *priv =
+		miniterm_terminal_get_instance_private(terminal);
+	const gint64 now = g_get_monotonic_time();
+	if (priv->commit_time != 0 && priv->echo_time == 0)
+		priv->echo_time = now;
+	/* An exponential moving average needs no timer to age. */
+	priv->byte_rate = get_byte_rate(priv, now) + length;
+	priv->byte_rate_time = now;
+	priv->bytes_read += length;
+	if (priv->output_time == 0)
+		priv->output_time = now;
+}
+
+static void
+watch_output(MinitermTerminal *terminal)
+{
+	MinitermTerminalPrivate *priv =
+		miniterm_terminal_get_instance_private(terminal);
+	VtePty *pty = vte_terminal_get_pty(VTE_TERMINAL(terminal));
+	if (priv->stats_watch != 0 || priv->proxy != NULL || pty == NULL)
+		return;
+	priv->stats_watch = g_unix_fd_add_full(VTE_READ_PRIORITY - 1,
+		vte_pty_get_fd(pty), G_IO_IN, stats_output_cb, terminal, NULL);
+}
+
+static gboolean
+stats_output_cb(int fd, GIOCondition condition, gpointer user_data)
+{
+	MinitermTerminal *terminal = MINITERM_TERMINAL(user_data);
+	MinitermTerminalPrivate *priv =
+		miniterm_terminal_get_instance_private(terminal);
+	const int queued = get_queued(fd);
+	/* A hung up pty has nothing more once vte read the rest. */
+	if (queued == 0 && (condition & (G_IO_HUP | G_IO_ERR)) != 0) {
+		priv->stats_watch = 0;
+		return G_SOURCE_REMOVE;
+	}
+	if (queued > priv->stats_queued)
+		record_output(terminal, queued - priv->stats_queued);
+	priv->stats_queued = queued;
+	/* Sources of one priority run in the order they were added. */
+	priv->stats_watch = g_idle_add_full(
+		VTE_READ_PRIORITY, stats_read_cb, terminal, NULL);
+	return G_SOURCE_REMOVE;
+}
+
+static gboolean
+stats_read_cb(gpointer user_data)
+{
+	MinitermTerminal *terminal = MINITERM_TERMINAL(user_data);
+	MinitermTerminalPrivate *priv =
+		miniterm_terminal_get_instance_private(terminal);
+	priv->stats_watch = 0;
+	VtePty *pty = vte_terminal_get_pty(VTE_TERMINAL(terminal));
+	if (pty == NULL)
+		return G_SOURCE_REMOVE;
+	/*
+	 * Vte reads all it can at once, so what is queued now is new. If the
+	 * queue didn't shrink vte held back until it processed what it has,
+	 * watching again right away would count the same output over and over.
+	 */
+	if (get_queued(vte_pty_get_fd(pty)) < priv->stats_queued) {
+		priv->stats_queued = 0;
+		watch_output(terminal);
+	}
+	return G_SOURCE_REMOVE;
+}
+
+static int
+get_queued(int fd)
+{
+	int queued = 0;
+	if (ioctl(fd, FIONREAD, &queued) != 0 || queued < 0)
+		return 0;
+	return queued;
+}
+
+static void
+stats_contents_cb(MinitermTerminal *terminal, gpointer user_data)
+{
+	MinitermTerminalPrivate *priv =
+		miniterm_terminal_get_instance_private(terminal);
+	stats_processed_cb(terminal, user_data);
+	if (priv->echo_time != 0)
+		priv->echo_processed = true;
+}
+
+static void
+stats_processed_cb(MinitermTerminal *terminal, gpointer user_data)
+{
+	(void)user_data;
+	MinitermTerminalPrivate *priv =
+		miniterm_terminal_get_instance_private(terminal);
+	if (priv->output_time != 0) {
+		priv->process_time +=
+			g_get_monotonic_time() - priv->output_time;
+		priv->output_time = 0;
+	}
+	/* Having processed its input, vte reads again. */
+	watch_output(terminal);
+}
+
+static gboolean
+stats_draw_cb(GtkWidget *terminal, cairo_t *cr, gpointer user_data)
+{
+	(void)cr;
+	(void)user_data;
+	MinitermTerminalPrivate *priv = miniterm_terminal_get_instance_private(
+		MINITERM_TERMINAL(terminal));
+	priv->draw_start = g_get_monotonic_time();
+	return FALSE;
+}
+
+static gboolean
+stats_draw_after_cb(GtkWidget *terminal, cairo_t *cr, gpointer user_data)
+{
+	(void)cr;
+	(void)user_data;
+	MinitermTerminalPrivate *priv = miniterm_terminal_get_instance_private(
+		MINITERM_TERMINAL(terminal));
+	if (priv->draw_start != 0) {
+		priv->draw_time += g_get_monotonic_time() - priv->draw_start;
+		priv->draw_start = 0;
+	}
+	++priv->frames;
+	if (priv->echo_processed)
+		latency_frame(MINITERM_TERMINAL(terminal));
+	return FALSE;
+}
+
+static double
+get_byte_rate(MinitermTerminalPrivate *priv, gint64 now)
+{
+	const double elapsed = (now - priv->byte_rate_time) / 1e6;
+	return priv->byte_rate * exp(-elapsed);
+}
+
+static gboolean
+update_stats_label(gpointer user_data)
+{
+	MinitermTerminal *terminal = MINITERM_TERMINAL(user_data);
+	MinitermTerminalPrivate *priv =
+		miniterm_terminal_get_instance_private(terminal);
+	MinitermTerminalStats stats;
+	miniterm_terminal_get_stats(terminal, &stats);
+	char *markup = g_markup_printf_escaped(
+		"<span font_family=\"monospace\" background=\"#000000\" "
+		"foreground=\"#ffffff\">"
+		" pid        %d \n"
+		" read       %.1f MiB \n"
+		" rate       %.1f KiB/s \n"
+		" frames     %" G_GUINT64_FORMAT " \n"
+		" processing %.1f s \n"
+		" drawing    %.1f s \n"
+		" scrollback %ld lines, %.1f MiB ",
+		(int)stats.child_pid, stats.bytes_read / (1024.0 * 1024.0),
+		stats.bytes_per_second / 1024.0, stats.frames,
+		stats.process_time / 1e6, stats.draw_time / 1e6,
+		stats.scrollback_lines,
+		stats.scrollback_size / (1024.0 * 1024.0));
+	GString *text = g_string_new(markup);
+	g_free(markup);
+	if (priv->latency != NULL) {
+		const MinitermHistogram *total =
+			&priv->latency[MINITERM_LATENCY_TOTAL];
+		g_string_append_printf(text,
+			"\n latency    p50 %.1f ms, p99 %.1f ms ",
+			miniterm_histogram_percentile(total, 50) / 1e3,
+			miniterm_histogram_percentile(total, 99) / 1e3);
+	}
+	g_string_append(text, "</span>");
+	gtk_label_set_markup(GTK_LABEL(priv->stats_label), text->str);
+	g_string_free(text, TRUE);
+	return G_SOURCE_CONTINUE;
+}
+
+static void
+latency_key_press(MinitermTerminal *terminal, GdkEventKey *event)
+{
+	MinitermTerminalPrivate *priv =
+		miniterm_terminal_get_instance_private(terminal);
+	if (priv->latency == NULL)
+		return;
+	const gint64 now = g_get_monotonic_time();
+	/*
+	 * Keys that don't send anything, like modifiers, are replaced by the
+	 * next one, keystrokes that never get echoed time out.
+	 */
+	if (priv->commit_time != 0
+		&& now - priv->key_time < LATENCY_TIMEOUT * 1000)
+		return;
+	latency_reset(terminal);
+	priv->key_time = now;
+	/*
+	 * Event times are in milliseconds of the monotonic clock on X11 and
+	 * Wayland, but only 32 bits wide.
+	 */
+	const guint32 delay = (guint32)(now / 1000) - event->time;
+	if (event->time != GDK_CURRENT_TIME && delay < LATENCY_TIMEOUT)
+		priv->key_delay = (gint64)delay * 1000;
+}
+
+static void
+latency_commit_cb(MinitermTerminal *terminal, char *text, unsigned int size,
+	gpointer user_data)
+{
+	(void)text;
+	(void)size;
+	(void)user_data;
+	MinitermTerminalPrivate *priv =
+		miniterm_terminal_get_instance_private(terminal);
+	if (priv->key_time != 0 && priv->commit_time == 0)
+		priv->commit_time = g_get_monotonic_time();
+}
+
+static void
+latency_frame(MinitermTerminal *terminal)
+{
+	MinitermTerminalPrivate *priv =
+		miniterm_terminal_get_instance_private(terminal);
+	const gint64 now = g_get_monotonic_time();
+	MinitermHistogram *latency = priv->latency;
+	const gint64 delay = MAX(priv->key_delay, 0);
+	if (priv->key_delay >= 0)
+		miniterm_histogram_add(
+			&latency[MINITERM_LATENCY_INPUT], priv->key_delay);
+	miniterm_histogram_add(&latency[MINITERM_LATENCY_COMMIT],
+		priv->commit_time - priv->key_time);
+	miniterm_histogram_add(&latency[MINITERM_LATENCY_ECHO],
+		priv->echo_time - priv->commit_time);
+	miniterm_histogram_add(
+		&latency[MINITERM_LATENCY_RENDER], now - priv->echo_time);
+	miniterm_histogram_add(&latency[MINITERM_LATENCY_TOTAL],
+		now - priv->key_time + delay);
+	latency_reset(terminal);
+}
+
+static void
+latency_reset(MinitermTerminal *terminal)
+{
+	MinitermTerminalPrivate *priv =
+		miniterm_terminal_get_instance_private(terminal);
+	priv->key_time = 0;
+	priv->key_delay = -1;
+	priv->commit_time = 0;
+	priv->echo_time = 0;
+	priv->echo_processed = false;
+}
@@ -27,22 +27,127 @@
 #include <stdbool.h>
 #include <vte/vte.h>
 
+#include "latency.h"
 #include "settings.h"
 
+/* Performance counters of a terminal. Times are in microseconds. */
+typedef struct {
+	unsigned int id;
+	/* 0 if no child was spawned. */
+	GPid child_pid;
+	/*
+	 * Counted as the proxy reads it, or sampled before each read for
+	 * terminals vte reads itself, which reads low under heavy output.
+	 */
+	guint64 bytes_read;
+	/* Averaged over about a second. */
+	double bytes_per_second;
+	guint64 frames;
+	/* From the pty becoming readable to vte having processed the output. */
+	gint64 process_time;
+	gint64 draw_time;
+	long scrollback_lines;
+	size_t scrollback_size;
+} MinitermTerminalStats;
+
 #define MINITERM_TYPE_TERMINAL (miniterm_terminal_get_type())
 G_DECLARE_FINAL_TYPE(
 	MinitermTerminal, miniterm_terminal, MINITERM, TERMINAL, VteTerminal)
 
 /*
- * The title may be NULL. Don't manually add the result of this function to the
- * window. This class will take care of it.
+ * Called once a spawn finished. On failure pid is -1 and error is set, it's
+ * freed after the callback returns.
+ */
+typedef void (*MinitermSpawnCallback)(MinitermTerminal *terminal, GPid pid,
+	GError *error, gpointer user_data);
+
+/*
+ * The title may be NULL. Add the widget returned by
+ * miniterm_terminal_get_container() to the window, not the terminal itself.
  */
 MinitermTerminal *miniterm_terminal_new(
 	bool keep, const char *title, GtkWindow *window);
+/* Returns a number that identifies the terminal for the process lifetime. */
+unsigned int miniterm_terminal_get_id(MinitermTerminal *terminal);
+/* Returns the widget holding the terminal and its scrollbar. */
+GtkWidget *miniterm_terminal_get_container(MinitermTerminal *terminal);
+/*
+ * Returns the title the window should have while this terminal is shown,
+ * respecting the title passed on the command line and the settings.
+ */
+const char *miniterm_terminal_get_title(MinitermTerminal *terminal);
+/*
+ * Returns the newly allocated working directory of the child, or NULL if it
+ * isn't known.
+ */
+char *miniterm_terminal_get_cwd(MinitermTerminal *terminal);
+/*
+ * Returns the command of the last spawn, or NULL if it was the user's shell.
+ */
+const char *miniterm_terminal_get_command(MinitermTerminal *terminal);
+/* Returns the title passed from the command line, or NULL if there is none. */
+const char *miniterm_terminal_get_command_title(MinitermTerminal *terminal);
+/* Returns whether the window stays open after the child exits. */
+bool miniterm_terminal_get_keep(MinitermTerminal *terminal);
+/*
+ * Writes the scrollback and screen to path like miniterm_hibernate_save(),
+ * also if the terminal is hibernated. Returns false and sets error on failure.
+ */
+bool miniterm_terminal_save_contents(
+	MinitermTerminal *terminal, const char *path, GError **error);
+/*
+ * Starts spawning command, or the user's shell if command is NULL, in a new
+ * pty without waiting for it. The environment may be NULL to inherit
+ * miniterm's. Only the standard streams are passed on to the child. The
+ * callback may be NULL, and is called before this returns if command can't be
+ * parsed.
+ */
+void miniterm_terminal_spawn(MinitermTerminal *terminal,
+	const char *working_directory, const char *command, char **environment,
+	MinitermSpawnCallback callback, gpointer user_data);
+/*
+ * Logs the output of the child spawned next to the file at path, instead of
+ * the configured log directory. The path may be NULL.
+ */
+void miniterm_terminal_set_log(MinitermTerminal *terminal, const char *path);
+/*
+ * Records the output of the child spawned next, and the size changes, to a
+ * capture at path. See capture.h. The path may be NULL.
+ */
+void miniterm_terminal_set_capture(
+	MinitermTerminal *terminal, const char *path);
+/* Sets whether the window stays open after the child exits. */
+void miniterm_terminal_set_keep(MinitermTerminal *terminal, bool keep);
+/*
+ * Sets the title passed from the command line, which also disables the dynamic
+ * window title. The title may be NULL.
+ */
+void miniterm_terminal_set_title(MinitermTerminal *terminal, const char *title);
+/*
+ * Applies settings to the terminal and keeps a reference to them. The default
+ * size is only applied the first time.
+ */
+void miniterm_terminal_set_settings(
+	MinitermTerminal *terminal, MinitermSettings *settings);
+/*
+ * Caps the scrollback below the configured number of lines. A negative limit
+ * removes the cap.
+ */
+void miniterm_terminal_set_scrollback_limit(
+	MinitermTerminal *terminal, long limit);
+/* Returns the number of scrollback lines currently stored. */
+long miniterm_terminal_get_scrollback_used(MinitermTerminal *terminal);
+/* Returns the estimated number of bytes one scrollback line takes. */
+size_t miniterm_terminal_get_line_size(MinitermTerminal *terminal);
+void miniterm_terminal_get_stats(
+	MinitermTerminal *terminal, MinitermTerminalStats *stats);
 /*
- * Loads from default path. Returns whether it succeeded. Currently, nothing
- * would cause it to return false.
+ * Returns the latency histograms, indexed by MinitermLatencyStage, or NULL if
+ * latency isn't being measured.
  */
-bool miniterm_terminal_load_settings(MinitermTerminal *terminal);
+const MinitermHistogram *miniterm_terminal_get_latency(
+	MinitermTerminal *terminal);
+/* Shows or hides the statistics overlay. */
+void miniterm_terminal_toggle_stats(MinitermTerminal *terminal);
 
 #endif /* MINITERM_TERMINAL_H */
@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2018 Jason Waataja
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "trace.h"
+
+#include <glib.h>
+#include <stdio.h>
+
+/* NULL if tracing is disabled or not set up yet. */
+static FILE *trace_file = NULL;
+static bool trace_initialized = false;
+
+static FILE *get_trace_file(void);
+
+bool
+miniterm_trace_enabled(void)
+{
+	return get_trace_file() != NULL;
+}
+
+void
+miniterm_trace(const char *event, unsigned int id)
+{
+	FILE *file = get_trace_file();
+	if (file == NULL)
+		return;
+	fprintf(file, "%s %" G_GINT64_FORMAT " %u\n", event, g_get_real_time(),
+		id);
+	fflush(file);
+}
+
+static FILE *
+get_trace_file(void)
+{
+	if (trace_initialized)
+		return trace_file;
+	trace_initialized = true;
+	const char *path = g_getenv("MINITERM_TRACE");
+	if (path == NULL || *path == '\0')
+		return NULL;
+	/* Append so the file can be truncated while miniterm runs. */
+	trace_file = fopen(path, "a");
+	if (trace_file == NULL)
+		g_printerr("Failed to open trace file: %s\n", path);
+	return trace_file;
+}
@@ -0,0 +1,40 @@
+/*
+ * Copyright (c) 2018 Jason Waataja
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef MINITERM_TRACE_H
+#define MINITERM_TRACE_H
+
+#include <stdbool.h>
+
+/*
+ * Startup tracing for benchmarks. When the MINITERM_TRACE environment variable
+ * names a file, each event is appended to it as a line of the form
+ * "EVENT MICROSECONDS ID", where the time is wall clock time so it can be
+ * compared to timestamps taken by other processes.
+ */
+
+/* Returns whether events are being recorded. */
+bool miniterm_trace_enabled(void);
+/* Records event for the terminal with the given id, or 0 for none. */
+void miniterm_trace(const char *event, unsigned int id);
+
+#endif /* MINITERM_TRACE_H */
@@ -0,0 +1,370 @@
+/*
+ * Copyright (c) 2018 Jason Waataja
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "window.h"
+
+#include <stdio.h>
+
+#ifdef GDK_WINDOWING_X11
+#include <gdk/gdkx.h>
+#endif
+
+#include "application.h"
+
+struct _MinitermWindow {
+	GtkApplicationWindow parent;
+};
+
+typedef struct _MinitermWindowPrivate MinitermWindowPrivate;
+
+struct _MinitermWindowPrivate {
+	GtkWidget *notebook;
+	/* Terminals in tab order. Not refed, they're owned by the notebook. */
+	GList *terminals;
+};
+
+G_DEFINE_TYPE_WITH_PRIVATE(
+	MinitermWindow, miniterm_window, GTK_TYPE_APPLICATION_WINDOW)
+
+/* Quits the application when the last visible window is closed. */
+static gboolean miniterm_window_delete_event(
+	GtkWidget *window, GdkEventAny *event);
+
+/* Callback to forget a terminal once its tab is gone. */
+static void terminal_destroy_cb(GtkWidget *terminal, gpointer user_data);
+/* Callback to make the window title and size follow the current tab. */
+static void switch_page_cb(GtkNotebook *notebook, GtkWidget *page,
+	guint page_num, gpointer user_data);
+/* Callback to keep the size increments in step with the font. */
+static void char_size_cb(
+	VteTerminal *vte, guint width, guint height, gpointer user_data);
+/* Callback to only show the tab bar when there is more than one tab. */
+static void page_count_cb(GtkNotebook *notebook, GtkWidget *child,
+	guint page_num, gpointer user_data);
+
+static MinitermTerminal *terminal_for_page(
+	MinitermWindow *window, GtkWidget *page);
+/* Sizes the window in whole cells of terminal. */
+static void update_geometry_hints(
+	MinitermWindow *window, MinitermTerminal *terminal);
+static void set_geometry_hints(VteTerminal *vte, GdkGeometry *hints);
+
+static void
+miniterm_window_init(MinitermWindow *window)
+{
+	MinitermWindowPrivate *priv =
+		miniterm_window_get_instance_private(window);
+	priv->terminals = NULL;
+	priv->notebook = gtk_notebook_new();
+	gtk_notebook_set_show_tabs(GTK_NOTEBOOK(priv->notebook), FALSE);
+	gtk_notebook_set_show_border(GTK_NOTEBOOK(priv->notebook), FALSE);
+	gtk_notebook_set_scrollable(GTK_NOTEBOOK(priv->notebook), TRUE);
+	g_signal_connect_after(priv->notebook, "switch-page",
+		G_CALLBACK(switch_page_cb), window);
+	g_signal_connect(priv->notebook, "page-added",
+		G_CALLBACK(page_count_cb), NULL);
+	g_signal_connect(priv->notebook, "page-removed",
+		G_CALLBACK(page_count_cb), NULL);
+	gtk_container_add(GTK_CONTAINER(window), priv->notebook);
+}
+
+static void
+miniterm_window_class_init(MinitermWindowClass *kclass)
+{
+	GtkWidgetClass *widget_class = GTK_WIDGET_CLASS(kclass);
+	widget_class->delete_event = miniterm_window_delete_event;
+}
+
+static gboolean
+miniterm_window_delete_event(GtkWidget *window, GdkEventAny *event)
+{
+	/* Hidden windows are prewarmed spares and don't keep miniterm open. */
+	GtkApplication *app = gtk_window_get_application(GTK_WINDOW(window));
+	if (app != NULL && gtk_widget_get_visible(window)) {
+		int count = 0;
+		GList *windows = gtk_application_get_windows(app);
+		for (GList *l = windows; l != NULL; l = l->next) {
+			if (gtk_widget_get_visible(GTK_WIDGET(l->data)))
+				++count;
+		}
+		if (count == 1
+			&& !miniterm_application_is_daemon(
+				MINITERM_APPLICATION(app)))
+			g_application_quit(G_APPLICATION(app));
+	}
+	GtkWidgetClass *parent_class =
+		GTK_WIDGET_CLASS(miniterm_window_parent_class);
+	if (parent_class->delete_event != NULL)
+		return parent_class->delete_event(window, event);
+	return FALSE;
+}
+
+MinitermWindow *
+miniterm_window_new(GtkApplication *app, bool keep, const char *title)
+{
+	MinitermWindow *window =
+		g_object_new(MINITERM_TYPE_WINDOW, "application", app, NULL);
+	MinitermWindowPrivate *priv =
+		miniterm_window_get_instance_private(window);
+
+	/* Try to set the rgba colormap so vte can use real transparency. */
+	GdkScreen *screen = gtk_window_get_screen(GTK_WINDOW(window));
+	GdkVisual *visual = gdk_screen_get_rgba_visual(screen);
+	if (visual != NULL)
+		gtk_widget_set_visual(GTK_WIDGET(window), visual);
+
+	/* Set window icon supplied by an icon theme. */
+	GdkPixbuf *icon =
+		miniterm_application_get_icon(MINITERM_APPLICATION(app));
+	if (icon)
+		gtk_window_set_icon(GTK_WINDOW(window), icon);
+
+	miniterm_window_add_terminal(window, keep, title);
+	/* Show everything but the window itself. */
+	gtk_widget_show(priv->notebook);
+	return window;
+}
+
+MinitermTerminal *
+miniterm_window_get_terminal(MinitermWindow *window)
+{
+	MinitermWindowPrivate *priv =
+		miniterm_window_get_instance_private(window);
+	GtkNotebook *notebook = GTK_NOTEBOOK(priv->notebook);
+	const int page = gtk_notebook_get_current_page(notebook);
+	if (page < 0)
+		return NULL;
+	return terminal_for_page(
+		window, gtk_notebook_get_nth_page(notebook, page));
+}
+
+MinitermTerminal *
+miniterm_window_add_terminal(
+	MinitermWindow *window, bool keep, const char *title)
+{
+	MinitermWindowPrivate *priv =
+		miniterm_window_get_instance_private(window);
+	MinitermTerminal *current = miniterm_window_get_terminal(window);
+	MinitermTerminal *terminal =
+		miniterm_terminal_new(keep, title, GTK_WINDOW(window));
+	priv->terminals = g_list_append(priv->terminals, terminal);
+	g_signal_connect(
+		terminal, "destroy", G_CALLBACK(terminal_destroy_cb), window);
+	g_signal_connect(terminal, "char-size-changed",
+		G_CALLBACK(char_size_cb), window);
+	miniterm_application_add_terminal(
+		MINITERM_APPLICATION(
+			gtk_window_get_application(GTK_WINDOW(window))),
+		terminal);
+	/*
+	 * Tabs use the same font description, so vte shares the font metrics
+	 * and glyph caches between them.
+	 */
+	if (current != NULL)
+		vte_terminal_set_font(VTE_TERMINAL(terminal),
+			vte_terminal_get_font(VTE_TERMINAL(current)));
+
+	GtkWidget *container = miniterm_terminal_get_container(terminal);
+	GtkWidget *label = gtk_label_new(NULL);
+	gtk_label_set_ellipsize(GTK_LABEL(label), PANGO_ELLIPSIZE_END);
+	gtk_label_set_width_chars(GTK_LABEL(label), 16);
+	gtk_widget_show_all(container);
+	/*
+	 * The notebook only maps the current page, so other tabs don't draw at
+	 * all.
+	 */
+	const int page = gtk_notebook_append_page(
+		GTK_NOTEBOOK(priv->notebook), container, label);
+	gtk_notebook_set_current_page(GTK_NOTEBOOK(priv->notebook), page);
+	miniterm_window_update_title(window, terminal);
+	return terminal;
+}
+
+GList *
+miniterm_window_get_terminals(MinitermWindow *window)
+{
+	MinitermWindowPrivate *priv =
+		miniterm_window_get_instance_private(window);
+	return priv->terminals;
+}
+
+void
+miniterm_window_remove_terminal(
+	MinitermWindow *window, MinitermTerminal *terminal)
+{
+	MinitermWindowPrivate *priv =
+		miniterm_window_get_instance_private(window);
+	if (priv->terminals == NULL || priv->terminals->next == NULL)
+		gtk_window_close(GTK_WINDOW(window));
+	else
+		gtk_widget_destroy(miniterm_terminal_get_container(terminal));
+}
+
+void
+miniterm_window_switch_tab(MinitermWindow *window, int offset)
+{
+	MinitermWindowPrivate *priv =
+		miniterm_window_get_instance_private(window);
+	GtkNotebook *notebook = GTK_NOTEBOOK(priv->notebook);
+	const int count = gtk_notebook_get_n_pages(notebook);
+	if (count == 0)
+		return;
+	const int page = gtk_notebook_get_current_page(notebook);
+	gtk_notebook_set_current_page(
+		notebook, ((page + offset) % count + count) % count);
+}
+
+void
+miniterm_window_set_font(
+	MinitermWindow *window, const PangoFontDescription *font)
+{
+	MinitermWindowPrivate *priv =
+		miniterm_window_get_instance_private(window);
+	for (GList *l = priv->terminals; l != NULL; l = l->next)
+		vte_terminal_set_font(VTE_TERMINAL(l->data), font);
+}
+
+void
+miniterm_window_update_title(
+	MinitermWindow *window, MinitermTerminal *terminal)
+{
+	MinitermWindowPrivate *priv =
+		miniterm_window_get_instance_private(window);
+	const char *title = miniterm_terminal_get_title(terminal);
+	GtkWidget *label = gtk_notebook_get_tab_label(
+		GTK_NOTEBOOK(priv->notebook),
+		miniterm_terminal_get_container(terminal));
+	if (label != NULL)
+		gtk_label_set_text(GTK_LABEL(label), title);
+	if (terminal == miniterm_window_get_terminal(window))
+		gtk_window_set_title(GTK_WINDOW(window), title);
+}
+
+void
+miniterm_window_spawn(MinitermWindow *window, MinitermTerminal *terminal,
+	const char *working_directory, const char *command,
+	const char *const *environment, MinitermSpawnCallback callback,
+	gpointer user_data)
+{
+	gtk_widget_realize(GTK_WIDGET(window));
+	char **child_environment = environment != NULL
+		? g_strdupv((char **)environment)
+		: g_get_environ();
+
+	/* Set the OS window id environment variable */
+#ifdef GDK_WINDOWING_X11
+	if (GDK_IS_X11_DISPLAY(gtk_widget_get_display(GTK_WIDGET(window)))) {
+		XID wid = GDK_WINDOW_XID(
+			gtk_widget_get_window(GTK_WIDGET(window)));
+		char wid_str[64];
+		snprintf(wid_str, 64, "%lu", wid);
+		child_environment = g_environ_setenv(
+			child_environment, "WINDOWID", wid_str, TRUE);
+	}
+#endif
+
+	miniterm_terminal_spawn(terminal, working_directory, command,
+		child_environment, callback, user_data);
+	g_strfreev(child_environment);
+}
+
+static void
+terminal_destroy_cb(GtkWidget *terminal, gpointer user_data)
+{
+	MinitermWindow *window = MINITERM_WINDOW(user_data);
+	MinitermWindowPrivate *priv =
+		miniterm_window_get_instance_private(window);
+	priv->terminals = g_list_remove(priv->terminals, terminal);
+}
+
+static void
+switch_page_cb(GtkNotebook *notebook, GtkWidget *page, guint page_num,
+	gpointer user_data)
+{
+	(void)notebook;
+	(void)page_num;
+	MinitermWindow *window = MINITERM_WINDOW(user_data);
+	MinitermTerminal *terminal = terminal_for_page(window, page);
+	if (terminal == NULL)
+		return;
+	gtk_window_set_title(
+		GTK_WINDOW(window), miniterm_terminal_get_title(terminal));
+	update_geometry_hints(window, terminal);
+	gtk_widget_grab_focus(GTK_WIDGET(terminal));
+}
+
+static void
+char_size_cb(VteTerminal *vte, guint width, guint height, gpointer user_data)
+{
+	(void)width;
+	(void)height;
+	MinitermWindow *window = MINITERM_WINDOW(user_data);
+	MinitermTerminal *terminal = MINITERM_TERMINAL(vte);
+	if (terminal == miniterm_window_get_terminal(window))
+		update_geometry_hints(window, terminal);
+}
+
+static void
+page_count_cb(GtkNotebook *notebook, GtkWidget *child, guint page_num,
+	gpointer user_data)
+{
+	(void)child;
+	(void)page_num;
+	(void)user_data;
+	gtk_notebook_set_show_tabs(
+		notebook, gtk_notebook_get_n_pages(notebook) > 1);
+}
+
+static MinitermTerminal *
+terminal_for_page(MinitermWindow *window, GtkWidget *page)
+{
+	MinitermWindowPrivate *priv =
+		miniterm_window_get_instance_private(window);
+	for (GList *l = priv->terminals; l != NULL; l = l->next) {
+		MinitermTerminal *terminal = MINITERM_TERMINAL(l->data);
+		if (miniterm_terminal_get_container(terminal) == page)
+			return terminal;
+	}
+	return NULL;
+}
+
+static void
+update_geometry_hints(MinitermWindow *window, MinitermTerminal *terminal)
+{
+	GdkGeometry geo_hints;
+	/* Apply geometry hints to handle terminal resizing */
+	set_geometry_hints(VTE_TERMINAL(terminal), &geo_hints);
+	gtk_window_set_geometry_hints(GTK_WINDOW(window), GTK_WIDGET(terminal),
+		&geo_hints,
+		GDK_HINT_RESIZE_INC | GDK_HINT_MIN_SIZE | GDK_HINT_BASE_SIZE);
+}
+
+static void
+set_geometry_hints(VteTerminal *vte, GdkGeometry *hints)
+{
+	hints->base_width = vte_terminal_get_char_width(vte);
+	hints->base_height = vte_terminal_get_char_height(vte);
+	hints->min_width = vte_terminal_get_char_width(vte);
+	hints->min_height = vte_terminal_get_char_height(vte);
+	hints->width_inc = vte_terminal_get_char_width(vte);
+	hints->height_inc = vte_terminal_get_char_height(vte);
+}
@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) 2018 Jason Waataja
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef MINITERM_WINDOW_H
+#define MINITERM_WINDOW_H
+
+#include <gtk/gtk.h>
+#include <stdbool.h>
+
+#include "terminal.h"
+
+#define MINITERM_TYPE_WINDOW (miniterm_window_get_type())
+G_DECLARE_FINAL_TYPE(MinitermWindow, miniterm_window, MINITERM, WINDOW,
+	GtkApplicationWindow)
+
+/*
+ * Creates a hidden window holding a new terminal that uses the settings of app,
+ * which must be a MinitermApplication. The title may be NULL.
+ */
+MinitermWindow *miniterm_window_new(
+	GtkApplication *app, bool keep, const char *title);
+/* Returns the terminal of the current tab. */
+MinitermTerminal *miniterm_window_get_terminal(MinitermWindow *window);
+/*
+ * Adds a terminal in a new tab and switches to it. Tabs share the font of the
+ * current tab and the application's settings. The title may be NULL.
+ */
+MinitermTerminal *miniterm_window_add_terminal(
+	MinitermWindow *window, bool keep, const char *title);
+/* Returns the terminals in tab order. The window owns the list. */
+GList *miniterm_window_get_terminals(MinitermWindow *window);
+/* Closes the tab of terminal, or the window if it is the last tab. */
+void miniterm_window_remove_terminal(
+	MinitermWindow *window, MinitermTerminal *terminal);
+/* Switches by offset tabs, wrapping around at either end. */
+void miniterm_window_switch_tab(MinitermWindow *window, int offset);
+/* Sets font for all tabs. */
+void miniterm_window_set_font(
+	MinitermWindow *window, const PangoFontDescription *font);
+/* Updates the tab label of terminal, and the window title if it's current. */
+void miniterm_window_update_title(
+	MinitermWindow *window, MinitermTerminal *terminal);
+/*
+ * Realizes the window and starts spawning command, or the user's shell if
+ * command is NULL, in terminal, which must belong to window. The child gets
+ * environment, or miniterm's if it is NULL, with WINDOWID set for the window.
+ * See miniterm_terminal_spawn().
+ */
+void miniterm_window_spawn(MinitermWindow *window, MinitermTerminal *terminal,
+	const char *working_directory, const char *command,
+	const char *const *environment, MinitermSpawnCallback callback,
+	gpointer user_data);
+
+#endif /* MINITERM_WINDOW_H */
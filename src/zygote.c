@@ -0,0 +1,525 @@
+/*
+ * Copyright (c) 2018 Jason Waataja
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/* For execvpe(), pipe2() and ptsname_r(). */
+#define _GNU_SOURCE
+
+#include "zygote.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <glib-unix.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "config.h"
+
+/* The descriptor of the socket in the helper. */
+#define HELPER_SOCKET 3
+
+/*
+ * A request is this header followed by the working directory, the arguments
+ * and the environment, each terminated by a null byte. The pty slave is
+ * passed along with SCM_RIGHTS.
+ */
+typedef struct {
+	guint32 serial;
+	guint32 argc;
+	guint32 envc;
+} Request;
+
+typedef enum {
+	/* The pid of a new child, or -1 and an errno value. */
+	REPLY_SPAWNED,
+	/* The wait status of an exited child. */
+	REPLY_EXITED,
+} ReplyType;
+
+typedef struct {
+	guint32 type;
+	guint32 serial;
+	gint32 pid;
+	gint32 value;
+} Reply;
+
+/* A spawn waiting for its reply. */
+typedef struct {
+	guint32 serial;
+	MinitermZygoteSpawnFunc spawned;
+	gpointer user_data;
+} Pending;
+
+typedef struct {
+	MinitermZygoteExitFunc exited;
+	gpointer user_data;
+} Watch;
+
+/*
+ * The helper is forked from a process that might already run other threads,
+ * so it avoids GLib and keeps its buffers static.
+ */
+static char request_buffer[ZYGOTE_MESSAGE_SIZE];
+/* The working directory, arguments and environment, each list null ended. */
+static char *request_strings[ZYGOTE_MAX_STRINGS + 3];
+
+/* -1 if the helper isn't running. */
+static int zygote_socket = -1;
+static GPid zygote_pid = -1;
+static unsigned int zygote_source = 0;
+static guint32 next_serial = 0;
+static GQueue pending = G_QUEUE_INIT;
+/* Maps pids to Watch. */
+static GHashTable *watches = NULL;
+
+/* Runs the helper until miniterm closes its end of the socket. */
+static void zygote_main(int socket) G_GNUC_NORETURN;
+/* Handles one request. Returns false once miniterm went away. */
+static bool handle_request(const sigset_t *child_mask);
+/* Splits the strings of a request. Returns false if it is malformed. */
+static bool parse_request(size_t len, const Request *request);
+/* Forks and executes the child, returning its pid or -1 and setting error. */
+static pid_t spawn_child(int pty, const char *working_directory, char **argv,
+	char **envp, const sigset_t *child_mask, int *error);
+/* Sets up the pty and executes argv. Only returns on failure. */
+static void exec_child(int pty, const char *working_directory, char **argv,
+	char **envp, const sigset_t *child_mask);
+/* Reports every child that exited. */
+static void reap_children(int signal_fd);
+static void send_reply(ReplyType type, guint32 serial, pid_t pid, int value);
+static void close_from(int lowest);
+
+/* Callback for replies from the helper. */
+static gboolean reply_cb(int fd, GIOCondition condition, gpointer user_data);
+static void fail_pending(int error);
+/* Tells the watchers of children the helper left behind. */
+static void orphan_watches(GHashTable *orphaned);
+
+bool
+miniterm_zygote_start(void)
+{
+	int fds[2];
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, fds) < 0) {
+		g_printerr("Failed to start spawn helper: %s\n",
+			g_strerror(errno));
+		return false;
+	}
+	const pid_t pid = fork();
+	if (pid == 0) {
+		close(fds[0]);
+		zygote_main(fds[1]);
+	}
+	close(fds[1]);
+	if (pid < 0) {
+		g_printerr("Failed to start spawn helper: %s\n",
+			g_strerror(errno));
+		close(fds[0]);
+		return false;
+	}
+	zygote_socket = fds[0];
+	zygote_pid = pid;
+	watches = g_hash_table_new_full(NULL, NULL, NULL, g_free);
+	zygote_source = g_unix_fd_add(zygote_socket,
+		G_IO_IN | G_IO_HUP | G_IO_ERR, reply_cb, NULL);
+	return true;
+}
+
+void
+miniterm_zygote_stop(void)
+{
+	if (zygote_socket < 0)
+		return;
+	if (zygote_source != 0)
+		g_source_remove(zygote_source);
+	zygote_source = 0;
+	/* The helper exits once it sees the socket closed. */
+	close(zygote_socket);
+	zygote_socket = -1;
+	waitpid(zygote_pid, NULL, 0);
+	zygote_pid = -1;
+	fail_pending(EPIPE);
+	g_hash_table_destroy(watches);
+	watches = NULL;
+}
+
+bool
+miniterm_zygote_running(void)
+{
+	return zygote_socket >= 0;
+}
+
+bool
+miniterm_zygote_spawn(int pty_master, const char *working_directory,
+	char **argv, char **envp, MinitermZygoteSpawnFunc spawned,
+	gpointer user_data)
+{
+	if (zygote_socket < 0 || argv == NULL || argv[0] == NULL)
+		return false;
+	char slave_name[64];
+	if (ptsname_r(pty_master, slave_name, sizeof(slave_name)) != 0)
+		return false;
+	const int slave = open(slave_name, O_RDWR | O_NOCTTY | O_CLOEXEC);
+	if (slave < 0)
+		return false;
+
+	Request request = {next_serial, g_strv_length(argv),
+		envp ? g_strv_length(envp) : 0};
+	GByteArray *message = g_byte_array_new();
+	g_byte_array_append(message, (guint8 *)&request, sizeof(request));
+	const char *cwd = working_directory ? working_directory : "";
+	g_byte_array_append(message, (guint8 *)cwd, strlen(cwd) + 1);
+	for (guint32 i = 0; i < request.argc; ++i)
+		g_byte_array_append(
+			message, (guint8 *)argv[i], strlen(argv[i]) + 1);
+	for (guint32 i = 0; i < request.envc; ++i)
+		g_byte_array_append(
+			message, (guint8 *)envp[i], strlen(envp[i]) + 1);
+
+	bool sent = false;
+	if (message->len <= ZYGOTE_MESSAGE_SIZE
+		&& request.argc + request.envc <= ZYGOTE_MAX_STRINGS) {
+		struct iovec iov = {message->data, message->len};
+		union {
+			struct cmsghdr align;
+			char buffer[CMSG_SPACE(sizeof(int))];
+		} control;
+		memset(&control, 0, sizeof(control));
+		struct msghdr msg = {0};
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+		msg.msg_control = control.buffer;
+		msg.msg_controllen = sizeof(control.buffer);
+		struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type = SCM_RIGHTS;
+		cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+		memcpy(CMSG_DATA(cmsg), &slave, sizeof(int));
+		ssize_t len;
+		do
+			len = sendmsg(zygote_socket, &msg, MSG_NOSIGNAL);
+		while (len < 0 && errno == EINTR);
+		sent = len >= 0;
+	}
+	g_byte_array_free(message, TRUE);
+	close(slave);
+	if (!sent)
+		return false;
+
+	Pending *spawn = g_new(Pending, 1);
+	spawn->serial = next_serial++;
+	spawn->spawned = spawned;
+	spawn->user_data = user_data;
+	g_queue_push_tail(&pending, spawn);
+	return true;
+}
+
+void
+miniterm_zygote_watch(
+	GPid pid, MinitermZygoteExitFunc exited, gpointer user_data)
+{
+	if (watches == NULL)
+		return;
+	Watch *watch = g_new(Watch, 1);
+	watch->exited = exited;
+	watch->user_data = user_data;
+	g_hash_table_insert(watches, GINT_TO_POINTER(pid), watch);
+}
+
+void
+miniterm_zygote_unwatch(GPid pid)
+{
+	if (watches != NULL)
+		g_hash_table_remove(watches, GINT_TO_POINTER(pid));
+}
+
+static void
+zygote_main(int socket)
+{
+	/* Keep out of the job control of the terminal miniterm started in. */
+	setsid();
+	signal(SIGHUP, SIG_DFL);
+	signal(SIGINT, SIG_DFL);
+	signal(SIGTERM, SIG_DFL);
+	if (socket != HELPER_SOCKET) {
+		dup2(socket, HELPER_SOCKET);
+		close(socket);
+	}
+	fcntl(HELPER_SOCKET, F_SETFD, FD_CLOEXEC);
+	/* Drop the display and D-Bus connections miniterm might have open. */
+	close_from(HELPER_SOCKET + 1);
+
+	sigset_t mask;
+	sigset_t child_mask;
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGCHLD);
+	sigprocmask(SIG_BLOCK, &mask, &child_mask);
+	const int signal_fd = signalfd(-1, &mask, SFD_CLOEXEC | SFD_NONBLOCK);
+	if (signal_fd < 0)
+		_exit(EXIT_FAILURE);
+
+	for (;;) {
+		struct pollfd fds[] = {
+			{HELPER_SOCKET, POLLIN, 0}, {signal_fd, POLLIN, 0}};
+		if (poll(fds, G_N_ELEMENTS(fds), -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			_exit(EXIT_FAILURE);
+		}
+		if (fds[1].revents & POLLIN)
+			reap_children(signal_fd);
+		if (fds[0].revents != 0 && !handle_request(&child_mask))
+			_exit(EXIT_SUCCESS);
+	}
+}
+
+static bool
+handle_request(const sigset_t *child_mask)
+{
+	struct iovec iov = {request_buffer, sizeof(request_buffer)};
+	union {
+		struct cmsghdr align;
+		char buffer[CMSG_SPACE(sizeof(int))];
+	} control;
+	struct msghdr msg = {0};
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control.buffer;
+	msg.msg_controllen = sizeof(control.buffer);
+	const ssize_t len = recvmsg(HELPER_SOCKET, &msg, MSG_CMSG_CLOEXEC);
+	if (len < 0)
+		return errno == EINTR || errno == EAGAIN;
+	if (len == 0)
+		return false;
+
+	int pty = -1;
+	struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+	if (cmsg != NULL && cmsg->cmsg_level == SOL_SOCKET
+		&& cmsg->cmsg_type == SCM_RIGHTS)
+		memcpy(&pty, CMSG_DATA(cmsg), sizeof(int));
+	Request request = {0};
+	if ((size_t)len >= sizeof(request))
+		memcpy(&request, request_buffer, sizeof(request));
+
+	int error = EINVAL;
+	pid_t pid = -1;
+	if (msg.msg_flags & (MSG_TRUNC | MSG_CTRUNC))
+		error = E2BIG;
+	else if (pty >= 0 && parse_request(len, &request))
+		pid = spawn_child(pty, request_strings[0],
+			&request_strings[1],
+			&request_strings[request.argc + 2], child_mask,
+			&error);
+	if (pty >= 0)
+		close(pty);
+	send_reply(REPLY_SPAWNED, request.serial, pid, pid < 0 ? error : 0);
+	return true;
+}
+
+static bool
+parse_request(size_t len, const Request *request)
+{
+	if (len < sizeof(*request) || request->argc == 0
+		|| request->argc + request->envc > ZYGOTE_MAX_STRINGS)
+		return false;
+	char *next = request_buffer + sizeof(*request);
+	char *const end = request_buffer + len;
+	size_t n = 0;
+	for (guint32 i = 0; i <= request->argc + request->envc; ++i) {
+		char *terminator = memchr(next, '\0', end - next);
+		if (terminator == NULL)
+			return false;
+		request_strings[n++] = next;
+		next = terminator + 1;
+		/* End the arguments before the environment starts. */
+		if (i == request->argc)
+			request_strings[n++] = NULL;
+	}
+	request_strings[n] = NULL;
+	return next == end;
+}
+
+static pid_t
+spawn_child(int pty, const char *working_directory, char **argv, char **envp,
+	const sigset_t *child_mask, int *error)
+{
+	/* Closed on exec, so reading it only returns data if exec failed. */
+	int status_pipe[2];
+	if (pipe2(status_pipe, O_CLOEXEC) < 0) {
+		*error = errno;
+		return -1;
+	}
+	const pid_t pid = fork();
+	if (pid == 0) {
+		close(status_pipe[0]);
+		exec_child(pty, working_directory, argv, envp, child_mask);
+		const int exec_error = errno;
+		ssize_t len;
+		do
+			len = write(status_pipe[1], &exec_error,
+				sizeof(exec_error));
+		while (len < 0 && errno == EINTR);
+		_exit(127);
+	}
+	close(status_pipe[1]);
+	if (pid < 0) {
+		*error = errno;
+		close(status_pipe[0]);
+		return -1;
+	}
+	int exec_error = 0;
+	ssize_t len;
+	do
+		len = read(status_pipe[0], &exec_error, sizeof(exec_error));
+	while (len < 0 && errno == EINTR);
+	close(status_pipe[0]);
+	if (len == sizeof(exec_error)) {
+		waitpid(pid, NULL, 0);
+		*error = exec_error;
+		return -1;
+	}
+	return pid;
+}
+
+static void
+exec_child(int pty, const char *working_directory, char **argv, char **envp,
+	const sigset_t *child_mask)
+{
+	sigprocmask(SIG_SETMASK, child_mask, NULL);
+	if (setsid() < 0 || ioctl(pty, TIOCSCTTY, 0) < 0)
+		return;
+	for (int fd = STDIN_FILENO; fd <= STDERR_FILENO; ++fd) {
+		if (dup2(pty, fd) < 0)
+			return;
+	}
+	if (pty > STDERR_FILENO)
+		close(pty);
+	if (*working_directory != '\0' && chdir(working_directory) < 0)
+		return;
+	execvpe(argv[0], argv, envp);
+}
+
+static void
+reap_children(int signal_fd)
+{
+	struct signalfd_siginfo info;
+	while (read(signal_fd, &info, sizeof(info)) == sizeof(info))
+		;
+	int status;
+	pid_t pid;
+	while ((pid = waitpid(-1, &status, WNOHANG)) > 0)
+		send_reply(REPLY_EXITED, 0, pid, status);
+}
+
+static void
+send_reply(ReplyType type, guint32 serial, pid_t pid, int value)
+{
+	const Reply reply = {type, serial, pid, value};
+	while (send(HELPER_SOCKET, &reply, sizeof(reply), MSG_NOSIGNAL) < 0
+		&& errno == EINTR)
+		;
+}
+
+static void
+close_from(int lowest)
+{
+#ifdef SYS_close_range
+	if (syscall(SYS_close_range, lowest, ~0U, 0) == 0)
+		return;
+#endif
+	const long max = sysconf(_SC_OPEN_MAX);
+	for (long fd = lowest; fd < MIN(max, 65536); ++fd)
+		close(fd);
+}
+
+static gboolean
+reply_cb(int fd, GIOCondition condition, gpointer user_data)
+{
+	(void)condition;
+	(void)user_data;
+	Reply reply;
+	const ssize_t len = recv(fd, &reply, sizeof(reply), MSG_DONTWAIT);
+	if (len < 0 && (errno == EINTR || errno == EAGAIN))
+		return G_SOURCE_CONTINUE;
+	if (len != sizeof(reply)) {
+		g_printerr("Spawn helper exited, spawning directly\n");
+		zygote_source = 0;
+		GHashTable *orphaned = watches;
+		watches = g_hash_table_new_full(NULL, NULL, NULL, g_free);
+		miniterm_zygote_stop();
+		orphan_watches(orphaned);
+		return G_SOURCE_REMOVE;
+	}
+
+	if (reply.type == REPLY_SPAWNED) {
+		Pending *spawn = g_queue_pop_head(&pending);
+		if (spawn == NULL || spawn->serial != reply.serial) {
+			g_printerr("Unexpected reply from spawn helper\n");
+			g_free(spawn);
+			return G_SOURCE_CONTINUE;
+		}
+		spawn->spawned(reply.pid, reply.pid < 0 ? reply.value : 0,
+			spawn->user_data);
+		g_free(spawn);
+	} else if (reply.type == REPLY_EXITED) {
+		Watch *watch = g_hash_table_lookup(
+			watches, GINT_TO_POINTER(reply.pid));
+		if (watch == NULL)
+			return G_SOURCE_CONTINUE;
+		g_hash_table_steal(watches, GINT_TO_POINTER(reply.pid));
+		watch->exited(reply.pid, reply.value, watch->user_data);
+		g_free(watch);
+	}
+	return G_SOURCE_CONTINUE;
+}
+
+static void
+fail_pending(int error)
+{
+	Pending *spawn;
+	while ((spawn = g_queue_pop_head(&pending)) != NULL) {
+		spawn->spawned(-1, error, spawn->user_data);
+		g_free(spawn);
+	}
+}
+
+static void
+orphan_watches(GHashTable *orphaned)
+{
+	GHashTableIter iter;
+	gpointer key;
+	gpointer value;
+	g_hash_table_iter_init(&iter, orphaned);
+	while (g_hash_table_iter_next(&iter, &key, &value)) {
+		Watch *watch = value;
+		g_hash_table_iter_steal(&iter);
+		watch->exited(GPOINTER_TO_INT(key), -1, watch->user_data);
+		g_free(watch);
+	}
+	g_hash_table_destroy(orphaned);
+}
@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) 2018 Jason Waataja
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef MINITERM_ZYGOTE_H
+#define MINITERM_ZYGOTE_H
+
+#include <glib.h>
+#include <stdbool.h>
+
+/*
+ * The spawn helper is a small process forked before GTK is initialized that
+ * forks and executes children on behalf of miniterm. Forking it stays cheap no
+ * matter how much memory miniterm itself uses. Children spawned through it are
+ * its children, not miniterm's, so their exits are forwarded by the helper.
+ */
+
+/*
+ * Called when a spawn finished, with the pid of the child, or -1 and an errno
+ * value on failure.
+ */
+typedef void (*MinitermZygoteSpawnFunc)(
+	GPid pid, int error, gpointer user_data);
+/*
+ * Called when a watched child exits, with its wait status. If the helper exits
+ * first, the child lives on without it and this is called right away with a
+ * status of -1, as its exit can't be reported any more.
+ */
+typedef void (*MinitermZygoteExitFunc)(
+	GPid pid, int status, gpointer user_data);
+
+/*
+ * Forks the helper. It must be called while the process is still small, before
+ * GTK is initialized. Returns false if the helper couldn't be started.
+ */
+bool miniterm_zygote_start(void);
+/* Stops the helper. Pending spawns fail with EPIPE. */
+void miniterm_zygote_stop(void);
+/* Returns whether spawns can go through the helper. */
+bool miniterm_zygote_running(void);
+/*
+ * Asks the helper to run argv with the slave of the pty master as its
+ * controlling terminal and standard streams. The working directory may be
+ * NULL. Returns false without calling spawned if the request couldn't be sent,
+ * in which case the caller should spawn the child itself.
+ */
+bool miniterm_zygote_spawn(int pty_master, const char *working_directory,
+	char **argv, char **envp, MinitermZygoteSpawnFunc spawned,
+	gpointer user_data);
+/* Calls exited once the child pid, spawned through the helper, exits. */
+void miniterm_zygote_watch(
+	GPid pid, MinitermZygoteExitFunc exited, gpointer user_data);
+/* Stops watching pid without calling its callback. */
+void miniterm_zygote_unwatch(GPid pid);
+
+#endif /* MINITERM_ZYGOTE_H */